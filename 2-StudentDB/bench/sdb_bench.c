@@ -0,0 +1,450 @@
+#define _GNU_SOURCE //posix_spawn file actions, mkdtemp()
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dirent.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// database include files
+#include "../db.h"
+
+// sdbsc benchmark driver.  Runs the sdbsc executable the way users do, one
+// process per operation, against a database in a scratch directory, and
+// reports the throughput and the latency percentiles of every operation as
+// one JSON object per line on stdout (progress goes to stderr):
+//
+//      {"dist":"uniform","op":"get","samples":1000,"seconds":0.912,
+//       "ops_per_sec":1096.5,"p50_us":880,"p99_us":1402,"max_us":2210}
+//
+// The first line describes the run.  For every id distribution the
+// database is bulk loaded with n - ops students, then
+//
+//      add       ops single adds of the remaining students (-a)
+//      get       ops lookups of random students (-f)
+//      count     reps counts (-c)
+//      print     reps full table prints to /dev/null (-p)
+//      delete    ops deletes of random students (-d)
+//      compress  reps compressions (-x), each of a freshly loaded file
+//
+// The bulk loads are reported as "load", one sample per load.  Latencies
+// are wall clock times of the whole sdbsc process, start up included.
+// SDBSC_* variables in the environment reach sdbsc unchanged, so for example
+// SDBSC_LAYOUT=hash benchmarks the hash layout.
+//
+// usage: sdb_bench [-x sdbsc] [-n students] [-o ops] [-r reps] [-s seed]
+//                  [-d uniform|clustered|sparse|all]
+#define BENCH_STUDENTS  20000
+#define BENCH_OPS       1000
+#define BENCH_REPS      10
+#define BENCH_CLUSTERS  16          //runs of consecutive ids, clustered ids
+
+extern char **environ;
+
+typedef struct bench {
+    const char *sdbsc;      //absolute path of the executable
+    const char *dir;        //scratch directory holding the database
+    int n;                  //students per distribution
+    int ops;                //samples of add, get and delete
+    int reps;               //samples of count, print and compress
+    uint64_t seed;
+    int max_id;
+} bench_t;
+
+// splitmix64, a small seedable generator so runs can be repeated
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static int random_below(uint64_t *state, int n)
+{
+    return (int)(next_random(state) % (uint64_t)n);
+}
+
+static void shuffle(int *ids, int n, uint64_t *state)
+{
+    for (int i = n - 1; i > 0; i--)
+    {
+        int j = random_below(state, i + 1);
+        int t = ids[i];
+        ids[i] = ids[j];
+        ids[j] = t;
+    }
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ *  make_ids
+ *      b:     the run
+ *      dist:  "uniform", "clustered" or "sparse"
+ *      ids:   where the b->n distinct ids are stored, in random order
+ *
+ *  uniform ids are drawn from the whole id range, clustered ids fill
+ *  BENCH_CLUSTERS runs of consecutive ids starting at random places, and
+ *  sparse ids are spread evenly over the id range.  Random ids are drawn
+ *  until b->n of them are distinct.
+ */
+static void make_ids(const bench_t *b, const char *dist, int *ids)
+{
+    uint64_t state = b->seed;
+    int range = b->max_id - MIN_STD_ID + 1;
+    int run = (b->n + BENCH_CLUSTERS - 1) / BENCH_CLUSTERS;
+    int n = 0;
+
+    if (strcmp(dist, "sparse") == 0)
+    {
+        for (; n < b->n; n++)
+            ids[n] = MIN_STD_ID + (int)((long long)n * range / b->n);
+    }
+
+    while (n < b->n)
+    {
+        if (strcmp(dist, "clustered") == 0)
+        {
+            int id = MIN_STD_ID + random_below(&state, range);
+            for (int k = 0; k < run && n < b->n && id <= b->max_id; k++)
+                ids[n++] = id++;
+        }
+        else
+        {
+            while (n < b->n)
+                ids[n++] = MIN_STD_ID + random_below(&state, range);
+        }
+
+        // drop the duplicates, the next round draws replacements
+        qsort(ids, n, sizeof(int), cmp_int);
+        int kept = 0;
+        for (int i = 0; i < n; i++)
+        {
+            if (kept == 0 || ids[kept - 1] != ids[i])
+                ids[kept++] = ids[i];
+        }
+        n = kept;
+    }
+
+    shuffle(ids, b->n, &state);
+}
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ *  run_sdbsc
+ *      b:      the run
+ *      argv:   arguments after the program name, NULL terminated
+ *      input:  file fed to stdin, NULL for /dev/null
+ *      ns:     set to the wall clock time of the process
+ *
+ *  Runs sdbsc in the scratch directory with its output discarded.
+ *
+ *  returns:  the exit status of sdbsc, -1 if it could not be run
+ */
+static int run_sdbsc(const bench_t *b, char *const argv[], const char *input, long long *ns)
+{
+    char *args[8];
+    posix_spawn_file_actions_t fa;
+    pid_t pid;
+    int status;
+    int n = 0;
+
+    args[n++] = (char *)b->sdbsc;
+    while (*argv != NULL && n < 7)
+        args[n++] = *argv++;
+    args[n] = NULL;
+
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_addopen(&fa, STDIN_FILENO, input ? input : "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&fa, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&fa, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addchdir_np(&fa, b->dir);
+
+    long long start = now_ns();
+    int rc = posix_spawn(&pid, b->sdbsc, &fa, NULL, args, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    if (rc != 0)
+        return -1;
+
+    while (waitpid(pid, &status, 0) == -1)
+    {
+        if (errno != EINTR)
+            return -1;
+    }
+    *ns = now_ns() - start;
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// runs sdbsc and stops the benchmark if it does not exit with status 0
+static long long must_run(const bench_t *b, char *const argv[], const char *input)
+{
+    long long ns;
+    int rc = run_sdbsc(b, argv, input, &ns);
+
+    if (rc != 0)
+    {
+        fprintf(stderr, "sdb_bench: sdbsc %s failed (exit %d)\n", argv[0], rc);
+        exit(1);
+    }
+    return ns;
+}
+
+static int cmp_ns(const void *a, const void *b)
+{
+    long long x = *(const long long *)a;
+    long long y = *(const long long *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ *  report
+ *      dist:  the id distribution
+ *      op:    the operation
+ *      ns:    wall clock time of each sample, sorted in place
+ *      n:     number of samples
+ *
+ *  Prints the result line of an operation, percentiles are nearest rank.
+ */
+static void report(const char *dist, const char *op, long long *ns, int n)
+{
+    long long total = 0;
+
+    qsort(ns, n, sizeof(long long), cmp_ns);
+    for (int i = 0; i < n; i++)
+        total += ns[i];
+
+    double seconds = total / 1e9;
+    long long p50 = ns[(n * 50 + 99) / 100 - 1];
+    long long p99 = ns[(n * 99 + 99) / 100 - 1];
+
+    printf("{\"dist\":\"%s\",\"op\":\"%s\",\"samples\":%d,\"seconds\":%.3f,"
+           "\"ops_per_sec\":%.1f,\"p50_us\":%lld,\"p99_us\":%lld,\"max_us\":%lld}\n",
+           dist, op, n, seconds, seconds > 0 ? n / seconds : 0.0,
+           p50 / 1000, p99 / 1000, ns[n - 1] / 1000);
+    fflush(stdout);
+}
+
+/*
+ *  load_db
+ *      b:    the run
+ *      ids:  students to load
+ *      n:    number of students
+ *
+ *  Empties the database and bulk loads the students from a roster file.
+ *
+ *  returns:  wall clock time of the bulk load
+ */
+static long long load_db(const bench_t *b, const int *ids, int n)
+{
+    char roster[PATH_MAX];
+    char *zero[] = {"-z", NULL};
+    char *bulk[] = {"-b", NULL};
+
+    snprintf(roster, sizeof(roster), "%s/roster.csv", b->dir);
+    FILE *fp = fopen(roster, "w");
+    if (fp == NULL)
+    {
+        perror("sdb_bench");
+        exit(1);
+    }
+    for (int i = 0; i < n; i++)
+        fprintf(fp, "%d,first%d,last%d,%d\n", ids[i], ids[i], ids[i], ids[i] % (MAX_STD_GPA + 1));
+    fclose(fp);
+
+    must_run(b, zero, NULL);
+    return must_run(b, bulk, roster);
+}
+
+// one distribution, see the top of the file
+static void bench_dist(const bench_t *b, const char *dist)
+{
+    int loaded = b->n - b->ops;
+    int samples = (b->ops > b->reps ? b->ops : b->reps) + 1;
+    int *ids = malloc(b->n * sizeof(int));
+    long long *ns = malloc(samples * sizeof(long long));
+    long long *loads = malloc(samples * sizeof(long long));
+    uint64_t state = b->seed ^ 0x5344425f42454e43ull;
+    char id[16], gpa[16], fname[32], lname[32];
+    int nloads = 0;
+
+    if (ids == NULL || ns == NULL || loads == NULL)
+    {
+        perror("sdb_bench");
+        exit(1);
+    }
+
+    fprintf(stderr, "sdb_bench: %s ids\n", dist);
+    make_ids(b, dist, ids);
+    loads[nloads++] = load_db(b, ids, loaded);
+
+    for (int i = 0; i < b->ops; i++)
+    {
+        int sid = ids[loaded + i];
+        char *add[] = {"-a", id, fname, lname, gpa, NULL};
+
+        snprintf(id, sizeof(id), "%d", sid);
+        snprintf(fname, sizeof(fname), "first%d", sid);
+        snprintf(lname, sizeof(lname), "last%d", sid);
+        snprintf(gpa, sizeof(gpa), "%d", sid % (MAX_STD_GPA + 1));
+        ns[i] = must_run(b, add, NULL);
+    }
+    report(dist, "add", ns, b->ops);
+
+    for (int i = 0; i < b->ops; i++)
+    {
+        char *get[] = {"-f", id, NULL};
+
+        snprintf(id, sizeof(id), "%d", ids[random_below(&state, b->n)]);
+        ns[i] = must_run(b, get, NULL);
+    }
+    report(dist, "get", ns, b->ops);
+
+    char *count[] = {"-c", NULL};
+    for (int i = 0; i < b->reps; i++)
+        ns[i] = must_run(b, count, NULL);
+    report(dist, "count", ns, b->reps);
+
+    char *print[] = {"-p", NULL};
+    for (int i = 0; i < b->reps; i++)
+        ns[i] = must_run(b, print, NULL);
+    report(dist, "print", ns, b->reps);
+
+    // every student is deleted at most once
+    shuffle(ids, b->n, &state);
+    for (int i = 0; i < b->ops; i++)
+    {
+        char *del[] = {"-d", id, NULL};
+
+        snprintf(id, sizeof(id), "%d", ids[i]);
+        ns[i] = must_run(b, del, NULL);
+    }
+    report(dist, "delete", ns, b->ops);
+
+    char *compress[] = {"-x", NULL};
+    for (int i = 0; i < b->reps; i++)
+    {
+        if (i > 0)
+            loads[nloads++] = load_db(b, ids, b->n);
+        ns[i] = must_run(b, compress, NULL);
+    }
+    report(dist, "compress", ns, b->reps);
+    report(dist, "load", loads, nloads);
+
+    free(ids);
+    free(ns);
+    free(loads);
+}
+
+// removes the scratch directory and the database files in it
+static void remove_dir(const char *dir)
+{
+    char path[PATH_MAX];
+    struct dirent *de;
+    DIR *d = opendir(dir);
+
+    if (d == NULL)
+        return;
+    while ((de = readdir(d)) != NULL)
+    {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        unlink(path);
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+static void usage(const char *exename)
+{
+    fprintf(stderr, "usage: %s [-x sdbsc] [-n students] [-o ops] [-r reps] [-s seed]\n"
+                    "       [-d uniform|clustered|sparse|all]\n", exename);
+}
+
+int main(int argc, char *argv[])
+{
+    static const char *dists[] = {"uniform", "clustered", "sparse"};
+    char sdbsc[PATH_MAX];
+    char dir[] = "/tmp/sdb_bench.XXXXXX";
+    const char *exe = "./sdbsc";
+    const char *dist = "all";
+    bench_t b = {NULL, NULL, BENCH_STUDENTS, BENCH_OPS, BENCH_REPS, 1, MAX_STD_ID};
+    int opt;
+
+    while ((opt = getopt(argc, argv, "x:n:o:r:s:d:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'x': exe = optarg; break;
+        case 'n': b.n = atoi(optarg); break;
+        case 'o': b.ops = atoi(optarg); break;
+        case 'r': b.reps = atoi(optarg); break;
+        case 's': b.seed = strtoull(optarg, NULL, 10); break;
+        case 'd': dist = optarg; break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    const char *layout = getenv("SDBSC_LAYOUT");
+    if (layout != NULL && strcmp(layout, "hash") == 0)
+        b.max_id = MAX_HASH_STD_ID;
+
+    if (b.n > b.max_id - MIN_STD_ID + 1)
+        b.n = b.max_id - MIN_STD_ID + 1;
+    if (b.ops < 1 || b.reps < 1 || b.ops > b.n)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (realpath(exe, sdbsc) == NULL || access(sdbsc, X_OK) != 0)
+    {
+        fprintf(stderr, "sdb_bench: cant run %s\n", exe);
+        return 1;
+    }
+    if (mkdtemp(dir) == NULL)
+    {
+        perror("sdb_bench");
+        return 1;
+    }
+    b.sdbsc = sdbsc;
+    b.dir = dir;
+
+    printf("{\"bench\":\"sdbsc\",\"students\":%d,\"ops\":%d,\"reps\":%d,\"seed\":%llu,"
+           "\"layout\":\"%s\"}\n", b.n, b.ops, b.reps, (unsigned long long)b.seed,
+           b.max_id == MAX_HASH_STD_ID ? "hash" : "direct");
+
+    for (size_t i = 0; i < sizeof(dists) / sizeof(dists[0]); i++)
+    {
+        if (strcmp(dist, "all") == 0 || strcmp(dist, dists[i]) == 0)
+            bench_dist(&b, dists[i]);
+    }
+
+    remove_dir(dir);
+    return 0;
+}
@@ -21,6 +21,7 @@ typedef struct student{
 #define MAX_STD_ID      100000
 #define MIN_STD_GPA     0
 #define MAX_STD_GPA     500
+#define MAX_HASH_STD_ID 999999999       //9 digit ids, hash layout files only
 
 //some useful constants you should consider using versus hard coding
 //in your program. 
@@ -28,8 +29,60 @@ static const student_t EMPTY_STUDENT_RECORD = {0};
 static const int STUDENT_RECORD_SIZE  = sizeof(struct student);
 static const int DELETED_STUDENT_ID = 0;
 
+// Database file header.  Student ids start at MIN_STD_ID so slot 0 of the
+// file (the first 64 bytes) never holds a student, which leaves room for a
+// header without changing the id * STUDENT_RECORD_SIZE record addressing.
+//  1. magic is larger than MAX_STD_ID so a header can never be mistaken for a
+//     student record.  Files without a header (slot 0 all zeros) were written
+//     by older versions and are searched by scanning.
+//  2. flags describe the record layout, see the DB_FLAG_* constants
+//  3. gen is bumped by every change to the records, sidecar files such as
+//     the occupancy bitmap remember the gen they match
+//  4. compact_next and compact_end are the progress of an online compaction
+//     (DB_FLAG_COMPACTING), zero otherwise
+//  5. snapshots is set while scans may be reading a snapshot of the file,
+//     changes then save the blocks they overwrite first (see sdb_snapshot.c)
+typedef struct db_header{
+    int magic;
+    int version;
+    int flags;
+    unsigned int gen;
+    int compact_next;       //first slot not compacted yet
+    int compact_end;        //one past the last compacted student
+    int snapshots;          //nonzero while snapshot readers may be active
+    char reserved[36];
+} db_header_t;
+
+#define DB_MAGIC        0x53444231      //"SDB1"
+#define DB_VERSION      1
+#define DB_FLAG_DIRECT  0x0001          //student id is at id * STUDENT_RECORD_SIZE
+#define DB_FLAG_COMPACT 0x0002          //students are packed from slot 1 sorted
+                                        //by id, see compress_db()
+#define DB_FLAG_HASH    0x0004          //students live in extendible hash
+                                        //buckets, see sdb_hash.c
+#define DB_FLAG_COMPACTING 0x0008       //a direct-slot file half way to
+                                        //DB_FLAG_COMPACT, see compact_online()
+#define DB_FLAG_PACKED  0x0010          //read only, variable length records
+                                        //behind an id index, see sdb_pack.c
+
+_Static_assert(sizeof(db_header_t) == sizeof(student_t),
+               "db header must fill exactly one record slot");
+
 
 #define DB_FILE     "student.db"            //name of database file
 #define TMP_DB_FILE ".tmp_student.db"       //for extra credit
+#define TMP_DB_PREFIX ".tmp_"       //temporary file of any database
+
+//sidecar files are named after the database file plus a suffix
+#define DB_BITMAP_SUFFIX    ".bitmap"       //occupancy bitmap
+#define DB_NAMES_SUFFIX     ".names"        //name index
+#define DB_GPA_SUFFIX       ".gpa"          //gpa range index
+#define DB_COLS_SUFFIX      ".cols"         //columnar id/gpa shadow
+#define DB_WAL_SUFFIX       ".wal"          //write-ahead log
+#define DB_HDIR_SUFFIX      ".hdir"         //hash directory
+#define DB_JOURNAL_SUFFIX   ".journal"      //online compaction step journal
+#define DB_SNAP_SUFFIX      ".snap"         //blocks saved for snapshot readers
+#define DB_CDC_SUFFIX       ".cdc"          //change data capture log
+#define DB_FOLLOW_SUFFIX    ".follow"       //a replica's position in the log it follows
 
 #endif
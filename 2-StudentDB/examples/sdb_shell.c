@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// database include files
+#include "../libsdb.h"
+
+// Example program linked with libsdb.a.  Keeps the database open and
+// runs one command per line of stdin, printing the result of each before
+// the next line is read:
+//
+//      get id                  prints the student
+//      add id first last gpa   adds a student
+//      del id                  deletes a student
+//      count                   prints the number of students
+//      stats                   prints the block cache hits and misses
+//
+// usage: sdb_shell [-c cache_blocks] [database]
+#define SHELL_LINE_MAX  256
+
+static void run_command(sdb_t *db, char *line)
+{
+    char cmd[16];
+    student_t s = {0};
+    int rc;
+
+    if (sscanf(line, "%15s", cmd) != 1)
+        return;
+
+    if (strcmp(cmd, "get") == 0 && sscanf(line, "%*s %d", &s.id) == 1)
+    {
+        int id = s.id;
+
+        rc = sdb_get(db, id, &s);
+        if (rc == NO_ERROR)
+            printf(STUDENT_PRINT_FMT_STRING, s.id, s.fname, s.lname, s.gpa / 100.0);
+        else if (rc == SRCH_NOT_FOUND)
+            printf(M_STD_NOT_FND_MSG, id);
+        else
+            printf(M_ERR_DB_READ);
+    }
+    else if (strcmp(cmd, "add") == 0 &&
+             sscanf(line, "%*s %d %23s %31s %d", &s.id, s.fname, s.lname, &s.gpa) == 4)
+    {
+        if (validate_range(s.id, s.gpa) != NO_ERROR)
+        {
+            printf(M_ERR_STD_RNG);
+            return;
+        }
+
+        rc = sdb_add(db, &s);
+        if (rc == NO_ERROR)
+            printf(M_STD_ADDED, s.id);
+        else if (rc == ERR_DB_OP)
+            printf(M_ERR_DB_ADD_DUP, s.id);
+        else
+            printf(M_ERR_DB_WRITE);
+    }
+    else if (strcmp(cmd, "del") == 0 && sscanf(line, "%*s %d", &s.id) == 1)
+    {
+        rc = sdb_del(db, s.id);
+        if (rc == NO_ERROR)
+            printf(M_STD_DEL_MSG, s.id);
+        else if (rc == SRCH_NOT_FOUND)
+            printf(M_STD_NOT_FND_MSG, s.id);
+        else
+            printf(M_ERR_DB_WRITE);
+    }
+    else if (strcmp(cmd, "count") == 0)
+    {
+        rc = sdb_count(db);
+        if (rc >= 0)
+            printf(M_DB_RECORD_CNT, rc);
+        else
+            printf(M_ERR_DB_READ);
+    }
+    else if (strcmp(cmd, "stats") == 0)
+    {
+        sdb_cache_stats_t st;
+
+        sdb_cache_stats(db, &st);
+        printf("cache hits: %ld misses: %ld\n", st.hits, st.misses);
+    }
+    else
+    {
+        printf("unknown command: %s", line);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    sdb_options_t opts = {0};
+    char line[SHELL_LINE_MAX];
+    sdb_t *db;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:")) != -1)
+    {
+        if (opt != 'c')
+        {
+            fprintf(stderr, "usage: %s [-c cache_blocks] [database]\n", argv[0]);
+            return EXIT_FAIL_ARGS;
+        }
+        opts.cache_blocks = atoi(optarg);
+    }
+
+    if (sdb_open((optind < argc) ? argv[optind] : DB_FILE, &opts, &db) != NO_ERROR)
+    {
+        printf(M_ERR_DB_OPEN);
+        return EXIT_FAIL_DB;
+    }
+
+    while (fgets(line, sizeof(line), stdin) != NULL)
+    {
+        run_command(db, line);
+        fflush(stdout);
+    }
+
+    sdb_close(db);
+    return EXIT_OK;
+}
@@ -0,0 +1,54 @@
+#ifndef __LIBSDB_H__
+#define __LIBSDB_H__
+
+// Embeddable student database.  libsdb.a holds the storage engine without
+// the command line front end, a program links it and works with a handle
+// instead of running sdbsc:
+//
+//      sdb_t *db;
+//      sdb_options_t opts = {.cache_blocks = 256};
+//
+//      if (sdb_open("student.db", &opts, &db) == NO_ERROR)
+//      {
+//          student_t s;
+//          if (sdb_get(db, 42, &s) == NO_ERROR)
+//              ...
+//          sdb_close(db);
+//      }
+//
+// The operations print nothing, they return one of the error codes of
+// sdbsc.h and hand back students through their arguments.  The engine keeps
+// one database per process (see db_map in sdbsc.c), so only one handle can
+// be open at a time, and a handle is used by one thread at a time.  Other
+// processes may use the same file at once, changes are locked as they are
+// for sdbsc (see sdb_lock.c).
+#include <stdbool.h>
+
+#include "db.h"
+#include "sdbsc.h"
+
+typedef struct sdb sdb_t;
+
+typedef struct sdb_options {
+    bool truncate;          //empty the database when it is opened
+    int cache_blocks;       //blocks of CACHE_BLOCK_SLOTS students cached for
+                            //sdb_get(), 0 turns the block cache off
+    int durability;         //WAL_SYNC (default) or WAL_LAZY, see sdb_wal.c
+} sdb_options_t;
+
+typedef struct sdb_cache_stats {
+    long hits;              //lookups answered from the block cache
+    long misses;            //lookups that read the file
+} sdb_cache_stats_t;
+
+int sdb_open(const char *path, const sdb_options_t *opts, sdb_t **db);
+int sdb_close(sdb_t *db);
+int sdb_get(sdb_t *db, int id, student_t *s);
+int sdb_get_many(sdb_t *db, const int *ids, int n, student_t *s, int *rcs);
+int sdb_add(sdb_t *db, const student_t *s);
+int sdb_del(sdb_t *db, int id);
+int sdb_count(sdb_t *db);
+int sdb_scan(sdb_t *db, int (*visit)(const student_t *, void *), void *arg);
+void sdb_cache_stats(sdb_t *db, sdb_cache_stats_t *st);
+
+#endif
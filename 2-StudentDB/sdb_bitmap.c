@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// Occupancy bitmap sidecar.  Bit n is set when student id n has a record in
+// a direct-slot database, so counting students is a popcount over about
+// 12.5KB and scans only visit occupied slots instead of the whole file.
+// The sidecar header is followed by BITMAP_WORDS 64 bit words.
+#define BITMAP_MAGIC    0x53444242      //"SDBB"
+#define BITMAP_WORDS    ((MAX_STD_ID + 64) / 64)
+#define BITMAP_SIZE     (sizeof(sidecar_header_t) + BITMAP_WORDS * sizeof(uint64_t))
+
+sidecar_t db_bitmap = {-1, NULL, 0};
+
+static uint64_t *bitmap_words(void)
+{
+    return (uint64_t *)(db_bitmap.base + sizeof(sidecar_header_t));
+}
+
+/*
+ *  open_bitmap
+ *      dbFile:  name of the database file, the sidecar is dbFile with
+ *               DB_BITMAP_SUFFIX appended
+ *
+ *  Opens (creating if needed) and maps the occupancy bitmap sidecar.  The
+ *  caller checks its generation against the database header and rebuilds
+ *  the bitmap if they differ.
+ *
+ *  returns:  NO_ERROR       bitmap mapped
+ *            ERR_DB_FILE    the sidecar could not be opened or mapped, the
+ *                           database is then used without it
+ */
+int open_bitmap(const char *dbFile)
+{
+    return open_sidecar(&db_bitmap, dbFile, DB_BITMAP_SUFFIX, BITMAP_MAGIC,
+                        BITMAP_SIZE, true);
+}
+
+// clears every bit, used before rebuilding the bitmap from the database
+void bitmap_clear_all(void)
+{
+    memset(bitmap_words(), 0, BITMAP_WORDS * sizeof(uint64_t));
+}
+
+/*
+ *  bitmap_set / bitmap_clear
+ *      id:  student id whose bit changes
+ *
+ *  Bits are updated atomically since other processes share the mapping.
+ *  Ids outside MIN_STD_ID..MAX_STD_ID, or a closed bitmap, are ignored.
+ */
+void bitmap_set(int id)
+{
+    if (db_bitmap.base != NULL && id >= MIN_STD_ID && id <= MAX_STD_ID)
+        __atomic_fetch_or(&bitmap_words()[id / 64], (uint64_t)1 << (id % 64), __ATOMIC_RELAXED);
+}
+
+void bitmap_clear(int id)
+{
+    if (db_bitmap.base != NULL && id >= MIN_STD_ID && id <= MAX_STD_ID)
+        __atomic_fetch_and(&bitmap_words()[id / 64], ~((uint64_t)1 << (id % 64)), __ATOMIC_RELAXED);
+}
+
+/*
+ *  bitmap_count
+ *
+ *  returns:  the number of occupied slots, a popcount over the bitmap
+ */
+int bitmap_count(void)
+{
+    const uint64_t *words = bitmap_words();
+    int count = 0;
+
+    for (int i = 0; i < BITMAP_WORDS; i++)
+        count += __builtin_popcountll(words[i]);
+
+    return count;
+}
+
+/*
+ *  bitmap_next
+ *      id:  where to start looking
+ *
+ *  returns:  the smallest occupied id >= id, or -1 if there is none
+ */
+int bitmap_next(int id)
+{
+    const uint64_t *words = bitmap_words();
+
+    if (id < 0)
+        id = 0;
+    if (id > MAX_STD_ID)
+        return -1;
+
+    int i = id / 64;
+    uint64_t word = words[i] & (~(uint64_t)0 << (id % 64));
+
+    for (;;)
+    {
+        if (word != 0)
+            return i * 64 + __builtin_ctzll(word);
+        if (++i == BITMAP_WORDS)
+            return -1;
+        word = words[i];
+    }
+}
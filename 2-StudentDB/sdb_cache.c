@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// Block cache.  A process that keeps the database open (the server, or a
+// program linked with libsdb) can keep copies of the blocks of
+// CACHE_BLOCK_SLOTS records its lookups read, so a repeated lookup of a hot
+// student is answered from memory instead of a locked pread().  Every
+// cached block remembers the generation of the database header it was read
+// at.  Every change bumps the generation before it touches a record (see
+// begin_update() in sdbsc.c), so a block is still current as long as the
+// header shows the generation it was read at, which get_student() checks
+// in the mapping without a system call.  Any change to the file therefore
+// drops the whole cache: it pays off for students read far more often than
+// the file changes.
+//
+// The cache is direct mapped, block b lives in entry b % nblocks, and is
+// off (0 entries) until cache_init() sizes it.
+typedef struct cache_entry {
+    int block;              //-1 when the entry is empty
+    unsigned int gen;       //db_header_t.gen the records were read at
+    student_t rec[CACHE_BLOCK_SLOTS];
+} cache_entry_t;
+
+static struct {
+    cache_entry_t *entries;
+    int nblocks;
+    long hits;
+    long misses;
+} db_cache = {NULL, 0, 0, 0};
+
+/*
+ *  cache_init
+ *      nblocks:  number of blocks to cache, 0 turns the cache off
+ *
+ *  Sizes the cache, the blocks cached so far are dropped.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE if out of memory, the cache is then off
+ */
+int cache_init(int nblocks)
+{
+    free(db_cache.entries);
+    db_cache.entries = NULL;
+    db_cache.nblocks = 0;
+    db_cache.hits = 0;
+    db_cache.misses = 0;
+
+    if (nblocks <= 0)
+        return NO_ERROR;
+
+    db_cache.entries = malloc((size_t)nblocks * sizeof(cache_entry_t));
+    if (db_cache.entries == NULL)
+        return ERR_DB_FILE;
+
+    db_cache.nblocks = nblocks;
+    cache_clear();
+    return NO_ERROR;
+}
+
+bool cache_enabled(void)
+{
+    return db_cache.nblocks > 0;
+}
+
+/*
+ *  cache_clear
+ *
+ *  Drops every cached block, for example when the database is closed.
+ */
+void cache_clear(void)
+{
+    for (int i = 0; i < db_cache.nblocks; i++)
+        db_cache.entries[i].block = -1;
+}
+
+/*
+ *  cache_find
+ *      block:  block number, the records of slots block * CACHE_BLOCK_SLOTS
+ *              on
+ *      gen:    the current generation of the database header
+ *
+ *  returns:  the CACHE_BLOCK_SLOTS records of the block, or NULL if the
+ *            block is not cached at this generation
+ */
+const student_t *cache_find(int block, unsigned int gen)
+{
+    if (db_cache.nblocks == 0)
+        return NULL;
+
+    cache_entry_t *e = &db_cache.entries[block % db_cache.nblocks];
+    if (e->block != block || e->gen != gen)
+    {
+        db_cache.misses++;
+        return NULL;
+    }
+
+    db_cache.hits++;
+    return e->rec;
+}
+
+/*
+ *  cache_fill
+ *      fd:     linux file descriptor of the database file
+ *      block:  block to read
+ *      gen:    the generation of the database header
+ *
+ *  Reads the block into the cache, replacing the block in its entry.  The
+ *  caller makes sure no change is under way, so the records match gen.
+ *  Slots past the end of the file read as empty.
+ *
+ *  returns:  the records of the block, or NULL if the cache is off or the
+ *            block could not be read
+ */
+const student_t *cache_fill(int fd, int block, unsigned int gen)
+{
+    if (db_cache.nblocks == 0)
+        return NULL;
+
+    cache_entry_t *e = &db_cache.entries[block % db_cache.nblocks];
+    size_t len = sizeof(e->rec);
+
+    ssize_t bytes = pread(fd, e->rec, len, (off_t)block * len);
+    if (bytes < 0)
+    {
+        e->block = -1;
+        return NULL;
+    }
+    memset((char *)e->rec + bytes, 0, len - bytes);
+
+    e->block = block;
+    e->gen = gen;
+    return e->rec;
+}
+
+/*
+ *  cache_stats
+ *      hits:    set to the lookups answered from the cache
+ *      misses:  set to the lookups that read the file
+ *
+ *  Counted since cache_init().
+ */
+void cache_stats(long *hits, long *misses)
+{
+    *hits = db_cache.hits;
+    *misses = db_cache.misses;
+}
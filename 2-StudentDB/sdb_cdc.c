@@ -0,0 +1,518 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// Change data capture log.  Every change to the database is appended to
+// the log with a sequence number: the student an add stored, the student a
+// delete removed, and a record without a student when -z empties the
+// file.  Unlike the write-ahead log (see sdb_wal.c) it is never emptied, so
+// a copy of the database kept elsewhere catches up by applying the records
+// after the last one it has seen instead of dumping the whole database.
+// follow_log() does that for a replica database file.
+//
+// The log is the header, then cdc_record_t records.  Record i carries
+// sequence number first + i, so the offset of any sequence number is known
+// without searching.  Writers append under a lock on the first byte of the
+// log, while they hold the lock of the change, so two changes to the same
+// student are logged in the order they were made.  A change is logged
+// right after its write-ahead log record and before the database is
+// written, so a writer that crashes in between leaves a change the
+// database may lack in the log, never the other way round.  A write that
+// fails is taken back by logging the opposite change.  A record torn by a
+// crash is overwritten by the next append.  The log reaches the disk with
+// the checkpoints of the write-ahead log, and a write-ahead log replayed
+// after the system went down is appended again (see open_wal).  Replaying
+// a change twice leaves a follower as it was, see follow_log().
+//
+// A database has no log until its first follower starts one with
+// start_cdc(), so databases nobody follows do not grow a log that is never
+// trimmed.  A log created for a database that already has students starts
+// with an add for each of them, so a follower of a new log builds a whole
+// copy.  Writers that opened the database before the log existed pick it
+// up with their next change.  A replica gets the layout of the database,
+// direct-slot or hash.
+#define CDC_MAGIC   0x53444243      //"SDBC"
+#define CDC_APPEND  0               //write locked by writers
+
+typedef struct cdc_header {
+    int magic;
+    int hash;               //the database has the hash layout, so do replicas
+    long long log_id;       //set when the log is created, a follower of
+                            //another log starts over
+    long long first;        //sequence number of the first record
+    char pad[40];
+} cdc_header_t;
+
+typedef struct cdc_record {
+    long long seq;
+    int op;                 //SDB_OP_ADD, SDB_OP_DEL or SDB_OP_ZERO
+    unsigned int check;     //checksum of seq, op and student
+    student_t student;      //added or deleted, empty for SDB_OP_ZERO
+} cdc_record_t;
+
+// where a follower is, kept next to the replica (DB_FOLLOW_SUFFIX)
+typedef struct cdc_position {
+    long long log_id;
+    long long seq;          //last change applied to the replica
+} cdc_position_t;
+
+static int cdc_fd = -1;
+static char cdc_path[PATH_MAX];     //the log of the open database, which
+                                    //may not exist yet
+
+// FNV-1a over the sequence number, op and student
+static unsigned int cdc_checksum(const cdc_record_t *r)
+{
+    const unsigned char *p = (const unsigned char *)&r->student;
+    unsigned int h = 2166136261u;
+
+    for (int i = 0; i < 8; i++)
+    {
+        h ^= (unsigned int)(r->seq >> (8 * i)) & 0xff;
+        h *= 16777619u;
+    }
+    h ^= (unsigned int)r->op;
+    h *= 16777619u;
+    for (size_t i = 0; i < sizeof(r->student); i++)
+    {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// writes n records from sequence number seq on at offset off of log fd
+static int cdc_write(int fd, off_t off, long long seq, int op, const student_t *s, int n)
+{
+    cdc_record_t batch[64];
+
+    for (int i = 0; i < n;)
+    {
+        int count = (n - i < 64) ? n - i : 64;
+
+        for (int k = 0; k < count; k++, i++)
+        {
+            cdc_record_t *r = &batch[k];
+
+            memset(r, 0, sizeof(*r));
+            r->seq = seq + i;
+            r->op = op;
+            if (s != NULL)
+                r->student = s[i];
+            r->check = cdc_checksum(r);
+        }
+
+        size_t len = count * sizeof(cdc_record_t);
+        if (pwrite(fd, batch, len, off) != (ssize_t)len)
+            return ERR_DB_WRITE;
+        off += len;
+    }
+    return NO_ERROR;
+}
+
+// the adds of a new log, see create_cdc()
+typedef struct cdc_seed {
+    int fd;
+    long long n;            //records written
+    int nbuf;
+    student_t buf[256];
+} cdc_seed_t;
+
+static int seed_flush(cdc_seed_t *seed)
+{
+    int rc = cdc_write(seed->fd, sizeof(cdc_header_t) + seed->n * sizeof(cdc_record_t),
+                       1 + seed->n, SDB_OP_ADD, seed->buf, seed->nbuf);
+
+    seed->n += seed->nbuf;
+    seed->nbuf = 0;
+    return rc;
+}
+
+// scan_students() visitor of create_cdc()
+static int seed_student(const student_t *s, void *arg)
+{
+    cdc_seed_t *seed = arg;
+
+    if (seed->nbuf == 256 && seed_flush(seed) != NO_ERROR)
+        return ERR_DB_WRITE;
+    seed->buf[seed->nbuf++] = *s;
+    return NO_ERROR;
+}
+
+/*
+ *  create_cdc
+ *      path:  name of the log
+ *      fd:    the open database file
+ *
+ *  Writes a new log with an add for every student of the database to a
+ *  temporary file and links it in as path.  The database is write locked
+ *  meanwhile so no change goes unlogged.  When another process created the
+ *  log first its log is used.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int create_cdc(const char *path, int fd)
+{
+    char tmp[PATH_MAX];
+    cdc_header_t hdr;
+    db_header_t db_hdr;
+    struct timespec now;
+
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int)sizeof(tmp) ||
+        lock_db(fd, F_WRLCK) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    int tfd = mkstemp(tmp);
+    if (tfd == -1)
+    {
+        lock_db(fd, F_UNLCK);
+        return ERR_DB_FILE;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = CDC_MAGIC;
+    hdr.log_id = (long long)now.tv_sec * 1000000000 + now.tv_nsec + getpid();
+    hdr.first = 1;
+    hdr.hash = pread(fd, &db_hdr, sizeof(db_hdr), 0) == sizeof(db_hdr) &&
+               db_hdr.magic == DB_MAGIC && (db_hdr.flags & DB_FLAG_HASH);
+
+    cdc_seed_t *seed = malloc(sizeof(cdc_seed_t));
+    int rc = (seed != NULL) ? NO_ERROR : ERR_DB_FILE;
+    if (rc == NO_ERROR)
+    {
+        seed->fd = tfd;
+        seed->n = 0;
+        seed->nbuf = 0;
+        rc = scan_students(fd, seed_student, seed);
+    }
+    if (rc == NO_ERROR)
+        rc = seed_flush(seed);
+    if (rc == NO_ERROR &&
+        (pwrite(tfd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+         fchmod(tfd, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP) == -1 ||
+         fdatasync(tfd) == -1 ||
+         (link(tmp, path) == -1 && errno != EEXIST)))
+        rc = ERR_DB_FILE;
+
+    unlink(tmp);
+    close(tfd);
+    free(seed);
+    lock_db(fd, F_UNLCK);
+    return rc;
+}
+
+/*
+ *  open_cdc
+ *      dbFile:    name of the database file, the log is dbFile with
+ *                 DB_CDC_SUFFIX appended
+ *      truncate:  the database was just truncated, which is logged
+ *
+ *  Opens the log of the database if it has one, see start_cdc().
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int open_cdc(const char *dbFile, bool truncate)
+{
+    close_cdc();
+
+    if (snprintf(cdc_path, sizeof(cdc_path), "%s%s", dbFile, DB_CDC_SUFFIX) >= (int)sizeof(cdc_path))
+    {
+        cdc_path[0] = '\0';
+        return ERR_DB_FILE;
+    }
+
+    cdc_fd = open(cdc_path, O_RDWR);
+    if (cdc_fd == -1 && errno != ENOENT)
+        return ERR_DB_FILE;
+
+    if (truncate && cdc_log(SDB_OP_ZERO, NULL, 1) != NO_ERROR)
+    {
+        close_cdc();
+        return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+void close_cdc(void)
+{
+    if (cdc_fd != -1)
+        close(cdc_fd);
+    cdc_fd = -1;
+    cdc_path[0] = '\0';
+}
+
+/*
+ *  start_cdc
+ *      dbFile:  name of the database file
+ *      fd:      the open database file
+ *
+ *  Creates the log of the database unless it has one, called for the first
+ *  follower, see create_cdc().
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int start_cdc(const char *dbFile, int fd)
+{
+    char path[PATH_MAX];
+
+    if (snprintf(path, sizeof(path), "%s%s", dbFile, DB_CDC_SUFFIX) >= (int)sizeof(path))
+        return ERR_DB_FILE;
+    if (access(path, F_OK) == 0)
+        return NO_ERROR;
+    return create_cdc(path, fd);
+}
+
+/*
+ *  cdc_log
+ *      op:  SDB_OP_ADD, SDB_OP_DEL or SDB_OP_ZERO
+ *      s:   the students added or deleted, NULL for SDB_OP_ZERO
+ *      n:   number of students, 1 for SDB_OP_ZERO
+ *
+ *  Appends a record per student with the next sequence numbers.  Called
+ *  before the database is changed, while the change is locked, which keeps
+ *  start_cdc() from seeding a new log meanwhile.  A log started since the
+ *  database was opened is opened here.  Without a log this does nothing.
+ *
+ *  returns:  NO_ERROR or ERR_DB_WRITE
+ */
+int cdc_log(int op, const student_t *s, int n)
+{
+    cdc_header_t hdr;
+    struct stat st;
+    int rc = ERR_DB_WRITE;
+
+    if (cdc_fd == -1 && cdc_path[0] != '\0')
+    {
+        cdc_fd = open(cdc_path, O_RDWR);
+        if (cdc_fd == -1 && errno != ENOENT)
+            return ERR_DB_WRITE;
+    }
+    if (cdc_fd == -1)
+        return NO_ERROR;
+
+    if (lock_byte(cdc_fd, F_WRLCK, CDC_APPEND, true) != NO_ERROR)
+        return ERR_DB_WRITE;
+
+    if (pread(cdc_fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) && hdr.magic == CDC_MAGIC &&
+        fstat(cdc_fd, &st) == 0)
+    {
+        // a torn record at the end is written over
+        long long next = (st.st_size - (off_t)sizeof(hdr)) / (off_t)sizeof(cdc_record_t);
+
+        rc = cdc_write(cdc_fd, sizeof(hdr) + next * sizeof(cdc_record_t),
+                       hdr.first + next, op, s, n);
+    }
+
+    lock_byte(cdc_fd, F_UNLCK, CDC_APPEND, false);
+    return rc;
+}
+
+/*
+ *  cdc_sync
+ *
+ *  Syncs the log, called by checkpoints of the write-ahead log before they
+ *  throw away the changes the log records.
+ *
+ *  returns:  NO_ERROR or ERR_DB_WRITE
+ */
+int cdc_sync(void)
+{
+    if (cdc_fd != -1 && fdatasync(cdc_fd) == -1)
+        return ERR_DB_WRITE;
+    return NO_ERROR;
+}
+
+// applies one record of the log to the replica, *fd may be reopened
+static int apply_change(const char *replica, int *fd, const cdc_record_t *r)
+{
+    int rc;
+
+    switch (r->op)
+    {
+    case SDB_OP_ADD:
+        rc = insert_student(*fd, &r->student);
+        return (rc == ERR_DB_OP) ? NO_ERROR : rc;
+    case SDB_OP_DEL:
+        rc = remove_student(*fd, r->student.id);
+        return (rc == SRCH_NOT_FOUND) ? NO_ERROR : rc;
+    case SDB_OP_ZERO:
+        // emptied under the write lock (see truncate_db), the replica
+        // stays open until the new descriptor has it mapped
+        rc = open_store(replica, true);
+        if (rc < 0)
+            return ERR_DB_FILE;
+        close_db(*fd);
+        *fd = rc;
+        return NO_ERROR;
+    default:
+        return ERR_DB_FILE;
+    }
+}
+
+// the replica is synced before its position moves on
+static int save_position(int fd, int pos_fd, const cdc_position_t *pos)
+{
+    if (wal_checkpoint(fd, true) != NO_ERROR ||
+        pwrite(pos_fd, pos, sizeof(*pos), 0) != sizeof(*pos) ||
+        fdatasync(pos_fd) == -1)
+        return ERR_DB_WRITE;
+    return NO_ERROR;
+}
+
+/*
+ *  follow_log
+ *      logFile:  the change log to follow
+ *      replica:  the database file the changes are applied to, created if
+ *                needed
+ *      once:     return once the end of the log is reached, otherwise keep
+ *                polling it every CDC_POLL_MS
+ *
+ *  Applies the records of the log after the last one the replica has seen
+ *  to the replica, CDC_BATCH_RECORDS at a time.  The sequence number of the
+ *  last record applied is kept in the replica's DB_FOLLOW_SUFFIX file,
+ *  written after the replica was synced.  Should the follower stop between
+ *  the two, the records are applied again, which leaves the replica as it
+ *  was: an add of a student the replica has is skipped, as is a delete of
+ *  one it does not have.  A replica that followed another log, or none,
+ *  is emptied and built up from the start of this one.  The replica is an
+ *  ordinary database in the layout of the logged one, with a change log
+ *  of its own.
+ *
+ *  returns:  NO_ERROR, or ERR_DB_FILE or ERR_DB_WRITE if the log or the
+ *            replica could not be read or written
+ *
+ *  console:  M_CDC_FOLLOWED   whenever the end of the log is reached after
+ *                             changes were applied, and at the end of once
+ *            M_ERR_CDC_OPEN   the log can not be opened or is not a log
+ *            M_ERR_DB_OPEN    the replica can not be opened
+ *            M_ERR_DB_WRITE   error applying the changes to the replica
+ */
+int follow_log(const char *logFile, const char *replica, bool once)
+{
+    char path[PATH_MAX];
+    cdc_header_t hdr;
+    cdc_position_t pos = {0, 0};
+    struct stat log_st, rep_st;
+    int applied = 0;
+    int rc = NO_ERROR;
+
+    int log_fd = open(logFile, O_RDONLY);
+    if (log_fd == -1 || pread(log_fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        hdr.magic != CDC_MAGIC)
+    {
+        printf(M_ERR_CDC_OPEN, logFile);
+        if (log_fd != -1)
+            close(log_fd);
+        return ERR_DB_FILE;
+    }
+
+    // a database can not follow its own log
+    snprintf(path, sizeof(path), "%s%s", replica, DB_CDC_SUFFIX);
+    if (stat(path, &rep_st) == 0 && fstat(log_fd, &log_st) == 0 &&
+        rep_st.st_dev == log_st.st_dev && rep_st.st_ino == log_st.st_ino)
+    {
+        printf(M_ERR_CDC_OPEN, logFile);
+        close(log_fd);
+        return ERR_DB_FILE;
+    }
+
+    // a new replica, or one emptied below, gets the layout of the database
+    setenv(SDB_LAYOUT_ENV, hdr.hash ? "hash" : "direct", 1);
+
+    int fd = open_store(replica, false);
+    snprintf(path, sizeof(path), "%s%s", replica, DB_FOLLOW_SUFFIX);
+    int pos_fd = (fd < 0) ? -1 : open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (pos_fd == -1)
+    {
+        printf(M_ERR_DB_OPEN);
+        if (fd >= 0)
+            close_db(fd);
+        close(log_fd);
+        return ERR_DB_FILE;
+    }
+    pread(pos_fd, &pos, sizeof(pos), 0);
+
+    // the replica is synced once per batch, not per change
+    set_durability(WAL_LAZY);
+
+    if (pos.log_id != hdr.log_id)
+    {
+        cdc_record_t zero = {0};
+
+        zero.op = SDB_OP_ZERO;
+        pos.log_id = hdr.log_id;
+        pos.seq = hdr.first - 1;
+        rc = apply_change(replica, &fd, &zero);
+        if (rc == NO_ERROR)
+            rc = save_position(fd, pos_fd, &pos);
+    }
+
+    cdc_record_t *batch = malloc(CDC_BATCH_RECORDS * sizeof(cdc_record_t));
+    if (batch == NULL)
+        rc = ERR_DB_FILE;
+
+    while (rc == NO_ERROR)
+    {
+        off_t off = sizeof(hdr) + (pos.seq + 1 - hdr.first) * sizeof(cdc_record_t);
+        ssize_t bytes = pread(log_fd, batch, CDC_BATCH_RECORDS * sizeof(cdc_record_t), off);
+        if (bytes < 0)
+        {
+            rc = ERR_DB_FILE;
+            break;
+        }
+
+        // a record being appended right now is picked up next time
+        int n = 0;
+        for (int count = bytes / sizeof(cdc_record_t); n < count && rc == NO_ERROR; n++)
+        {
+            const cdc_record_t *r = &batch[n];
+
+            if (r->seq != pos.seq + 1 || r->check != cdc_checksum(r))
+                break;
+            rc = apply_change(replica, &fd, r);
+            if (rc == NO_ERROR)
+                pos.seq++;
+        }
+        if (n > 0 && rc == NO_ERROR)
+            rc = save_position(fd, pos_fd, &pos);
+        if (rc != NO_ERROR)
+            break;
+        applied += n;
+
+        if (n == CDC_BATCH_RECORDS)
+            continue;
+        if (applied > 0 || once)
+        {
+            printf(M_CDC_FOLLOWED, replica, pos.seq, applied);
+            fflush(stdout);
+            applied = 0;
+        }
+        if (once)
+            break;
+
+        struct timespec poll = {CDC_POLL_MS / 1000, (CDC_POLL_MS % 1000) * 1000000L};
+        nanosleep(&poll, NULL);
+    }
+
+    if (rc != NO_ERROR)
+        printf(rc == ERR_DB_WRITE ? M_ERR_DB_WRITE : M_ERR_DB_READ);
+
+    free(batch);
+    close(pos_fd);
+    if (fd >= 0)
+        close_db(fd);
+    close(log_fd);
+    return rc;
+}
@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  connect_server
+ *      path:  file system path of the server's unix domain socket
+ *
+ *  Connects to a database server started with -S.
+ *
+ *  returns:  the connected socket, or ERR_SDB_COMM
+ *
+ *  console:  M_ERR_CONNECT    the server could not be reached
+ */
+int connect_server(const char *path)
+{
+    struct sockaddr_un addr;
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1 || strlen(path) >= sizeof(addr.sun_path))
+    {
+        printf(M_ERR_CONNECT, path);
+        if (sock != -1)
+            close(sock);
+        return ERR_SDB_COMM;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        printf(M_ERR_CONNECT, path);
+        close(sock);
+        return ERR_SDB_COMM;
+    }
+
+    return sock;
+}
+
+/*
+ *  remote_request
+ *      sock:   socket connected to the server
+ *      op:     SDB_OP_* operation
+ *      s:      the student to add, or a student carrying just the id for
+ *              the operation (may be NULL)
+ *      visit:  called for every student returned by the server (may be NULL)
+ *      arg:    passed through to visit
+ *
+ *  Sends one request and reads the reply frames until the final frame.
+ *
+ *  returns:  the result code carried by the final frame, or ERR_SDB_COMM
+ *
+ *  console:  M_ERR_COMM       the conversation with the server failed
+ */
+static int remote_request(int sock, int op, const student_t *s,
+                          int (*visit)(const student_t *, void *), void *arg)
+{
+    sdb_request_t req = {0};
+    sdb_response_t rsp;
+    student_t student;
+
+    req.op = op;
+    req.durability = get_durability();
+    if (s != NULL)
+        req.student = *s;
+
+    if (send_all(sock, &req, sizeof(req)) != NO_ERROR)
+    {
+        printf(M_ERR_COMM);
+        return ERR_SDB_COMM;
+    }
+
+    for (;;)
+    {
+        if (recv_all(sock, &rsp, sizeof(rsp)) != NO_ERROR)
+        {
+            printf(M_ERR_COMM);
+            return ERR_SDB_COMM;
+        }
+        set_remote_layout(rsp.flags);
+        if (rsp.nrecords == 0)
+            return rsp.rc;
+
+        for (int i = 0; i < rsp.nrecords; i++)
+        {
+            if (recv_all(sock, &student, sizeof(student)) != NO_ERROR)
+            {
+                printf(M_ERR_COMM);
+                return ERR_SDB_COMM;
+            }
+            if (visit != NULL)
+                visit(&student, arg);
+        }
+    }
+}
+
+static int copy_student(const student_t *s, void *arg)
+{
+    *(student_t *)arg = *s;
+    return NO_ERROR;
+}
+
+/*
+ *  remote_add_student
+ *
+ *  Same as add_student(), but executed by the server connected to sock.
+ *  Produces the same console output as add_student().  The id limit
+ *  depends on the layout of the server's file, an id the server rejects
+ *  gets M_ERR_STD_RNG and EXIT_FAIL_ARGS.
+ */
+int remote_add_student(int sock, int id, char *fname, char *lname, int gpa)
+{
+    student_t mystudent = {0};
+
+    mystudent.id = id;
+    mystudent.gpa = gpa;
+    strncpy(mystudent.fname, fname, sizeof(mystudent.fname) - 1);
+    strncpy(mystudent.lname, lname, sizeof(mystudent.lname) - 1);
+
+    switch (remote_request(sock, SDB_OP_ADD, &mystudent, NULL, NULL))
+    {
+    case NO_ERROR:
+        printf(M_STD_ADDED, id);
+        return NO_ERROR;
+    case ERR_DB_OP:
+        printf(M_ERR_DB_ADD_DUP, id);
+        return ERR_DB_OP;
+    case EXIT_FAIL_ARGS:
+        printf(M_ERR_STD_RNG);
+        return EXIT_FAIL_ARGS;
+    case ERR_DB_READONLY:
+        printf(M_DB_PACKED_RO);
+        return ERR_DB_OP;
+    case ERR_DB_WRITE:
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    case ERR_SDB_COMM:
+        return ERR_SDB_COMM;
+    default:
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+}
+
+/*
+ *  remote_get_student
+ *
+ *  Same as get_student(), but executed by the server connected to sock.
+ *  Like get_student() it does not produce console output of its own unless
+ *  the conversation with the server fails.
+ */
+int remote_get_student(int sock, int id, student_t *s)
+{
+    student_t key = {0};
+
+    key.id = id;
+    return remote_request(sock, SDB_OP_GET, &key, copy_student, s);
+}
+
+/*
+ *  remote_del_student
+ *
+ *  Same as del_student(), but executed by the server connected to sock.
+ *  Produces the same console output as del_student().
+ */
+int remote_del_student(int sock, int id)
+{
+    student_t key = {0};
+
+    key.id = id;
+    switch (remote_request(sock, SDB_OP_DEL, &key, NULL, NULL))
+    {
+    case NO_ERROR:
+        printf(M_STD_DEL_MSG, id);
+        return NO_ERROR;
+    case SRCH_NOT_FOUND:
+        printf(M_STD_NOT_FND_MSG, id);
+        return SRCH_NOT_FOUND;
+    case ERR_DB_READONLY:
+        printf(M_DB_PACKED_RO);
+        return ERR_DB_OP;
+    case ERR_DB_WRITE:
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    case ERR_SDB_COMM:
+        return ERR_SDB_COMM;
+    default:
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+}
+
+/*
+ *  remote_count_db_records
+ *
+ *  Same as count_db_records(), but executed by the server connected to
+ *  sock.  Produces the same console output as count_db_records().
+ */
+int remote_count_db_records(int sock)
+{
+    int count = remote_request(sock, SDB_OP_COUNT, NULL, NULL, NULL);
+
+    if (count == ERR_SDB_COMM)
+        return count;
+    if (count < 0) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    if (count == 0) {
+        printf(M_DB_EMPTY);
+    } else {
+        printf(M_DB_RECORD_CNT, count);
+    }
+    return count;
+}
+
+/*
+ *  remote_print_db
+ *
+ *  Same as print_db(), but executed by the server connected to sock.  The
+ *  server streams the students back and they are printed here with the
+ *  same format as print_db().
+ */
+int remote_print_db(int sock)
+{
+    bool header_printed = false;
+
+    int rc = remote_request(sock, SDB_OP_PRINT, NULL, print_db_row, &header_printed);
+    if (rc == ERR_SDB_COMM)
+        return rc;
+    if (rc != NO_ERROR) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    if (!header_printed) {
+        printf(M_DB_EMPTY);
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  remote_zero_db
+ *
+ *  Asks the server connected to sock to remove all database records.
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE or ERR_SDB_COMM
+ *
+ *  console:  M_DB_ZERO_OK     on success
+ *            M_ERR_DB_OPEN    the server could not reopen the database
+ */
+int remote_zero_db(int sock)
+{
+    int rc = remote_request(sock, SDB_OP_ZERO, NULL, NULL, NULL);
+
+    if (rc == NO_ERROR)
+        printf(M_DB_ZERO_OK);
+    else if (rc != ERR_SDB_COMM)
+        printf(M_ERR_DB_OPEN);
+    return rc;
+}
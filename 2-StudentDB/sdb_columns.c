@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// Columnar shadow sidecar.  The id and gpa fields of every student are kept
+// in two contiguous arrays, sorted by id, so analytics over the gpa column
+// stream 4 bytes per student instead of a 64 byte student_t.  Both arrays
+// are sized for every possible student up front, the file is sparse so
+// only the pages in use take up space, and the gpa array never moves.  The
+// sidecar header count is the number of students in the arrays.
+//
+// The shadow is optional: open_db() only uses it once it exists, it is
+// created by the first analytics request (see analyze_db in sdbsc.c).
+#define COLS_MAGIC      0x53444243      //"SDBC"
+#define COLS_CAP        (MAX_STD_ID - MIN_STD_ID + 1)
+#define COLS_SIZE       (sizeof(sidecar_header_t) + 2 * COLS_CAP * sizeof(int))
+
+// vector of 4 ints, one SSE2 register on x86-64 (NEON on arm64), gcc lowers
+// the operations to the SIMD instructions of the target
+typedef int vint_t __attribute__((vector_size(4 * sizeof(int))));
+#define VINT_LANES      ((int)(sizeof(vint_t) / sizeof(int)))
+
+// lanes of a where mask is set (all ones), of b elsewhere
+static inline vint_t vselect(vint_t mask, vint_t a, vint_t b)
+{
+    return (a & mask) | (b & ~mask);
+}
+
+sidecar_t db_cols = {-1, NULL, 0};
+
+static int *col_id(void)
+{
+    return (int *)(db_cols.base + sizeof(sidecar_header_t));
+}
+
+static int *col_gpa(void)
+{
+    return col_id() + COLS_CAP;
+}
+
+// first position in id[0, count) whose id is not below id
+static int col_lower_bound(const int *ids, int count, int id)
+{
+    int lo = 0;
+    int hi = count;
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (ids[mid] < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/*
+ *  open_columns
+ *      dbFile:  name of the database file, the shadow is dbFile with
+ *               DB_COLS_SUFFIX appended
+ *      create:  create the shadow if it does not exist yet
+ *
+ *  Opens and maps the columnar shadow.  The caller checks its generation
+ *  against the database header and reloads it with columns_load() if they
+ *  differ.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE (also when it does not exist and
+ *            create is false)
+ */
+int open_columns(const char *dbFile, bool create)
+{
+    return open_sidecar(&db_cols, dbFile, DB_COLS_SUFFIX, COLS_MAGIC,
+                        COLS_SIZE, create);
+}
+
+/*
+ *  columns_load
+ *      students:  every student in the database, in ascending id order
+ *      n:         number of students
+ *
+ *  Replaces the contents of the shadow, used to build or rebuild it.  The
+ *  shadow holds at most COLS_CAP students, a hash file may have more.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE (too many students)
+ */
+int columns_load(const student_t *students, int n)
+{
+    if (n > COLS_CAP)
+        return ERR_DB_FILE;
+
+    int *ids = col_id();
+    int *gpas = col_gpa();
+
+    for (int i = 0; i < n; i++)
+    {
+        ids[i] = students[i].id;
+        gpas[i] = students[i].gpa;
+    }
+    sidecar_header(&db_cols)->count = n;
+    return NO_ERROR;
+}
+
+/*
+ *  columns_insert / columns_remove
+ *      s:  the student that was added to or deleted from the database
+ *
+ *  Keep the shadow in step with the database, the entries after the
+ *  student move up or down one place in both columns.
+ */
+void columns_insert(const student_t *s)
+{
+    if (db_cols.base == NULL)
+        return;
+
+    int *ids = col_id();
+    int *gpas = col_gpa();
+    int count = sidecar_header(&db_cols)->count;
+
+    // full, analytics scan the database from now on
+    if (count == COLS_CAP)
+    {
+        set_sidecar_gen(&db_cols, SIDECAR_STALE);
+        return;
+    }
+
+    int pos = col_lower_bound(ids, count, s->id);
+
+    memmove(&ids[pos + 1], &ids[pos], (size_t)(count - pos) * sizeof(int));
+    memmove(&gpas[pos + 1], &gpas[pos], (size_t)(count - pos) * sizeof(int));
+    ids[pos] = s->id;
+    gpas[pos] = s->gpa;
+    sidecar_header(&db_cols)->count = count + 1;
+}
+
+void columns_remove(const student_t *s)
+{
+    if (db_cols.base == NULL)
+        return;
+
+    int *ids = col_id();
+    int *gpas = col_gpa();
+    int count = sidecar_header(&db_cols)->count;
+    int pos = col_lower_bound(ids, count, s->id);
+
+    if (pos == count || ids[pos] != s->id)
+        return;
+
+    memmove(&ids[pos], &ids[pos + 1], (size_t)(count - pos - 1) * sizeof(int));
+    memmove(&gpas[pos], &gpas[pos + 1], (size_t)(count - pos - 1) * sizeof(int));
+    sidecar_header(&db_cols)->count = count - 1;
+}
+
+/*
+ *  columns_gpa
+ *      n:  set to the number of students
+ *
+ *  returns:  the gpa column of the shadow, NULL if it is not open
+ */
+const int *columns_gpa(int *n)
+{
+    if (db_cols.base == NULL)
+        return NULL;
+
+    *n = sidecar_header(&db_cols)->count;
+    return col_gpa();
+}
+
+/*
+ *  gpa_stats
+ *      gpas:  a gpa column
+ *      n:     number of entries in the column
+ *      st:    receives the aggregates
+ *
+ *  Computes the sum, minimum, maximum and histogram of a gpa column.  The
+ *  column is processed VINT_LANES entries at a time with vector compares
+ *  and selects, the tail that does not fill a vector is done one at a time.
+ *  Histogram buckets are GPA_HIST_WIDTH wide, MAX_STD_GPA counts in the last
+ *  bucket.
+ */
+void gpa_stats(const int *gpas, int n, gpa_stats_t *st)
+{
+    vint_t vsum = {0};
+    vint_t vmin = (vint_t){0} + MAX_STD_GPA;
+    vint_t vmax = (vint_t){0} + MIN_STD_GPA;
+    vint_t last = (vint_t){0} + (GPA_HIST_BUCKETS - 1);
+    int lanes[VINT_LANES];
+    int i = 0;
+
+    memset(st, 0, sizeof(*st));
+    st->count = n;
+    st->min = MAX_STD_GPA;
+    st->max = MIN_STD_GPA;
+
+    // a lane sums at most MAX_STD_ID / VINT_LANES gpas, which fits an int
+    for (; i + VINT_LANES <= n; i += VINT_LANES)
+    {
+        vint_t v;
+        memcpy(&v, &gpas[i], sizeof(v));
+
+        vsum += v;
+        vmin = vselect(v < vmin, v, vmin);
+        vmax = vselect(v > vmax, v, vmax);
+
+        vint_t bucket = v / GPA_HIST_WIDTH;
+        bucket = vselect(bucket < last, bucket, last);
+        memcpy(lanes, &bucket, sizeof(lanes));
+        for (int l = 0; l < VINT_LANES; l++)
+            st->hist[lanes[l]]++;
+    }
+
+    for (int l = 0; l < VINT_LANES; l++)
+    {
+        st->sum += vsum[l];
+        if (vmin[l] < st->min)
+            st->min = vmin[l];
+        if (vmax[l] > st->max)
+            st->max = vmax[l];
+    }
+
+    for (; i < n; i++)
+    {
+        int b = gpas[i] / GPA_HIST_WIDTH;
+
+        st->sum += gpas[i];
+        if (gpas[i] < st->min)
+            st->min = gpas[i];
+        if (gpas[i] > st->max)
+            st->max = gpas[i];
+        st->hist[b < GPA_HIST_BUCKETS ? b : GPA_HIST_BUCKETS - 1]++;
+    }
+}
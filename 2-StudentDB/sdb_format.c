@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// Table formatter.  print_db() renders the student table into a large
+// buffer instead of calling printf() per row, and the buffer goes out with
+// one write() per TABLE_BUF_SIZE bytes.  A row is rendered by hand, exactly
+// as STUDENT_PRINT_FMT_STRING would:
+//
+//      "%-6d %-24.24s %-32.32s %-3.2f\n"
+//
+// or STUDENT_PRINT_WIDE_FMT_STRING in a table with the 9 digit ID column
+// of a hash file.
+//
+// The gpa is an int holding hundredths, so "%.2f" of gpa / 100.0 is the
+// integer part, a dot and the remainder as two digits, no float needed.
+// That holds for every gpa from 0 to TABLE_FAST_GPA (a float carries
+// hundredths exactly that far); a record with a gpa outside that range is
+// damaged and left to snprintf(), so the output never changes.
+#define TABLE_ROW_MAX   128             //longest row the formatter renders
+#define TABLE_FAST_GPA  99999
+
+// appends the decimal digits of v
+static char *put_uint(char *p, unsigned int v)
+{
+    char digits[10];
+    int n = 0;
+
+    do
+    {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v != 0);
+
+    while (n > 0)
+        *p++ = digits[--n];
+    return p;
+}
+
+// appends at most max bytes of a string field, space padded to max
+static char *put_field(char *p, const char *s, size_t max)
+{
+    size_t n = strnlen(s, max);
+
+    memcpy(p, s, n);
+    memset(p + n, ' ', max - n);
+    return p + max;
+}
+
+// writes all of data to fd
+static int write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, data, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return ERR_DB_FILE;
+        }
+        data += n;
+        len -= n;
+    }
+    return NO_ERROR;
+}
+
+// room for len more bytes, flushing (fd set) or growing (in memory) the
+// buffer
+static int table_reserve(table_buf_t *tb, size_t len)
+{
+    if (tb->cap - tb->len >= len)
+        return NO_ERROR;
+
+    if (tb->fd >= 0)
+    {
+        if (table_flush(tb) != NO_ERROR)
+            return ERR_DB_FILE;
+        if (tb->cap >= len)
+            return NO_ERROR;
+    }
+
+    size_t cap = tb->cap ? tb->cap : TABLE_BUF_SIZE;
+    while (cap - tb->len < len)
+        cap *= 2;
+
+    char *grown = realloc(tb->buf, cap);
+    if (grown == NULL)
+        return ERR_DB_FILE;
+    tb->buf = grown;
+    tb->cap = cap;
+    return NO_ERROR;
+}
+
+/*
+ *  table_init
+ *      tb:  the buffer
+ *      fd:  where the table goes, the buffer is written to fd whenever it
+ *           fills up; -1 keeps the whole table in memory
+ *
+ *  The ID column is as wide as the ids of the open database, see
+ *  wide_ids().
+ */
+void table_init(table_buf_t *tb, int fd)
+{
+    tb->buf = NULL;
+    tb->len = 0;
+    tb->cap = 0;
+    tb->rows = 0;
+    tb->fd = fd;
+    tb->wide = wide_ids();
+}
+
+/*
+ *  table_header
+ *      tb:  the buffer
+ *
+ *  Appends the STUDENT_PRINT_HDR_STRING table header.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int table_header(table_buf_t *tb)
+{
+    char hdr[TABLE_ROW_MAX];
+    int n = snprintf(hdr, sizeof(hdr),
+                     tb->wide ? STUDENT_PRINT_WIDE_HDR_STRING : STUDENT_PRINT_HDR_STRING,
+                     "ID", "FIRST NAME", "LAST_NAME", "GPA");
+
+    return table_append(tb, hdr, n);
+}
+
+/*
+ *  table_row
+ *      s:    the student
+ *      arg:  the table_buf_t
+ *
+ *  scan_students() visitor, appends the student's row to the table.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int table_row(const student_t *s, void *arg)
+{
+    table_buf_t *tb = arg;
+
+    if (table_reserve(tb, TABLE_ROW_MAX) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    char *row = tb->buf + tb->len;
+    char *p = row;
+
+    if (s->gpa < 0 || s->gpa > TABLE_FAST_GPA)
+    {
+        float real_gpa = s->gpa / 100.0;
+        p += snprintf(p, TABLE_ROW_MAX,
+                      tb->wide ? STUDENT_PRINT_WIDE_FMT_STRING : STUDENT_PRINT_FMT_STRING,
+                      s->id, s->fname, s->lname, real_gpa);
+    }
+    else
+    {
+        if (s->id < 0)
+            *p++ = '-';
+        p = put_uint(p, s->id < 0 ? -(unsigned int)s->id : (unsigned int)s->id);
+        while (p - row < (tb->wide ? 9 : 6))
+            *p++ = ' ';
+        *p++ = ' ';
+        p = put_field(p, s->fname, sizeof(s->fname));
+        *p++ = ' ';
+        p = put_field(p, s->lname, sizeof(s->lname));
+        *p++ = ' ';
+        p = put_uint(p, s->gpa / 100);
+        *p++ = '.';
+        *p++ = '0' + s->gpa % 100 / 10;
+        *p++ = '0' + s->gpa % 10;
+        *p++ = '\n';
+    }
+
+    tb->len = p - tb->buf;
+    tb->rows++;
+    return NO_ERROR;
+}
+
+/*
+ *  table_append
+ *      tb:    the buffer
+ *      data:  already formatted output, for example another table's rows
+ *      len:   bytes of data
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int table_append(table_buf_t *tb, const char *data, size_t len)
+{
+    // a large block bypasses the buffer of a table that is written out
+    if (tb->fd >= 0 && len >= TABLE_BUF_SIZE)
+    {
+        if (table_flush(tb) != NO_ERROR)
+            return ERR_DB_FILE;
+        return write_all(tb->fd, data, len);
+    }
+
+    if (table_reserve(tb, len) != NO_ERROR)
+        return ERR_DB_FILE;
+    memcpy(tb->buf + tb->len, data, len);
+    tb->len += len;
+    return NO_ERROR;
+}
+
+/*
+ *  table_flush
+ *      tb:  the buffer
+ *
+ *  Writes what is buffered to the table's fd.  Whatever stdio has buffered
+ *  for stdout goes first, so messages printed before the table stay in
+ *  order.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int table_flush(table_buf_t *tb)
+{
+    if (tb->fd < 0)
+        return NO_ERROR;
+
+    if (tb->fd == STDOUT_FILENO)
+        fflush(stdout);
+    if (tb->len == 0)
+        return NO_ERROR;
+
+    int rc = write_all(tb->fd, tb->buf, tb->len);
+    tb->len = 0;
+    return rc;
+}
+
+void table_free(table_buf_t *tb)
+{
+    free(tb->buf);
+    table_init(tb, -1);
+}
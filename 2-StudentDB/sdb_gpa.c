@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// GPA index sidecar.  GPAs are small integers, so the index is a counting
+// structure: one bucket per possible GPA, holding the ids of the students
+// with that GPA in ascending order.  The buckets are stored back to back,
+// after a table with the position of the first id of every bucket, so a
+// range query is two table lookups followed by a walk over the ids that
+// match.  The sidecar header count is the number of ids in the index.
+#define GPA_MAGIC       0x53444247      //"SDBG"
+#define GPA_BUCKETS     (MAX_STD_GPA - MIN_STD_GPA + 1)
+#define GPA_TABLE_SIZE  ((GPA_BUCKETS + 1) * sizeof(int))
+#define GPA_MIN_CAP     4096            //ids in a new index file
+
+sidecar_t db_gpa = {-1, NULL, 0};
+
+// bucket table, start[b] is the position of the first id of bucket b and
+// start[GPA_BUCKETS] is the number of ids
+static int *gpa_start(void)
+{
+    return (int *)(db_gpa.base + sizeof(sidecar_header_t));
+}
+
+// ids in use; remaps first if another process grew the index
+static int *gpa_ids(int *count)
+{
+    sidecar_header_t *hdr = sidecar_header(&db_gpa);
+    size_t need = sizeof(sidecar_header_t) + GPA_TABLE_SIZE + (size_t)hdr->count * sizeof(int);
+
+    if (need > db_gpa.len && grow_sidecar(&db_gpa, 0) != NO_ERROR)
+        return NULL;
+
+    *count = sidecar_header(&db_gpa)->count;
+    return (int *)(db_gpa.base + sizeof(sidecar_header_t) + GPA_TABLE_SIZE);
+}
+
+// first position in ids[lo, hi) whose id is not below id
+static int id_lower_bound(const int *ids, int lo, int hi, int id)
+{
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (ids[mid] < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/*
+ *  open_gpa
+ *      dbFile:  name of the database file, the index is dbFile with
+ *               DB_GPA_SUFFIX appended
+ *
+ *  Opens (creating if needed) and maps the GPA index.  The caller checks
+ *  its generation against the database header and reloads it with
+ *  gpa_load() if they differ.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int open_gpa(const char *dbFile)
+{
+    return open_sidecar(&db_gpa, dbFile, DB_GPA_SUFFIX, GPA_MAGIC,
+                        sizeof(sidecar_header_t) + GPA_TABLE_SIZE + GPA_MIN_CAP * sizeof(int), true);
+}
+
+/*
+ *  gpa_load
+ *      students:  every student in the database, in ascending id order
+ *      n:         number of students
+ *
+ *  Replaces the contents of the index with a counting sort of the students
+ *  by GPA, used to rebuild a stale index.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int gpa_load(const student_t *students, int n)
+{
+    if (grow_sidecar(&db_gpa, sizeof(sidecar_header_t) + GPA_TABLE_SIZE + (size_t)n * sizeof(int)) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    int *start = gpa_start();
+    int *ids = (int *)(db_gpa.base + sizeof(sidecar_header_t) + GPA_TABLE_SIZE);
+
+    memset(start, 0, GPA_TABLE_SIZE);
+    for (int i = 0; i < n; i++)
+        start[students[i].gpa - MIN_STD_GPA + 1]++;
+    for (int b = 1; b <= GPA_BUCKETS; b++)
+        start[b] += start[b - 1];
+
+    // start[b] is the next free position of bucket b while placing, which
+    // leaves it at the start of bucket b + 1 when done
+    for (int i = 0; i < n; i++)
+        ids[start[students[i].gpa - MIN_STD_GPA]++] = students[i].id;
+    memmove(start + 1, start, GPA_BUCKETS * sizeof(int));
+    start[0] = 0;
+
+    sidecar_header(&db_gpa)->count = n;
+    return NO_ERROR;
+}
+
+/*
+ *  gpa_insert
+ *      s:  the student that was added to the database
+ *
+ *  Inserts the student's id into its bucket, the ids of the buckets after
+ *  it move up one place.  The index grows by doubling.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE, a failure leaves the index stale
+ */
+int gpa_insert(const student_t *s)
+{
+    int count;
+    int *ids;
+
+    if (db_gpa.base == NULL || (ids = gpa_ids(&count)) == NULL)
+        return ERR_DB_FILE;
+
+    size_t need = sizeof(sidecar_header_t) + GPA_TABLE_SIZE + ((size_t)count + 1) * sizeof(int);
+    if (need > db_gpa.len)
+    {
+        if (grow_sidecar(&db_gpa, 2 * db_gpa.len) != NO_ERROR)
+        {
+            set_sidecar_gen(&db_gpa, SIDECAR_STALE);
+            return ERR_DB_FILE;
+        }
+        ids = (int *)(db_gpa.base + sizeof(sidecar_header_t) + GPA_TABLE_SIZE);
+    }
+
+    int *start = gpa_start();
+    int b = s->gpa - MIN_STD_GPA;
+    int pos = id_lower_bound(ids, start[b], start[b + 1], s->id);
+
+    memmove(&ids[pos + 1], &ids[pos], (size_t)(count - pos) * sizeof(int));
+    ids[pos] = s->id;
+    for (b++; b <= GPA_BUCKETS; b++)
+        start[b]++;
+    sidecar_header(&db_gpa)->count = count + 1;
+    return NO_ERROR;
+}
+
+/*
+ *  gpa_remove
+ *      s:  the student that was deleted from the database
+ *
+ *  Removes the student's id from its bucket, the ids of the buckets after
+ *  it move down one place.
+ */
+void gpa_remove(const student_t *s)
+{
+    int count;
+    int *ids;
+
+    if (db_gpa.base == NULL || (ids = gpa_ids(&count)) == NULL)
+        return;
+
+    int *start = gpa_start();
+    int b = s->gpa - MIN_STD_GPA;
+    int pos = id_lower_bound(ids, start[b], start[b + 1], s->id);
+    if (pos == start[b + 1] || ids[pos] != s->id)
+        return;
+
+    memmove(&ids[pos], &ids[pos + 1], (size_t)(count - pos - 1) * sizeof(int));
+    for (b++; b <= GPA_BUCKETS; b++)
+        start[b]--;
+    sidecar_header(&db_gpa)->count = count - 1;
+}
+
+/*
+ *  gpa_range
+ *      lo, hi:  inclusive GPA range, both within MIN_STD_GPA..MAX_STD_GPA
+ *      visit:   called with the id of every student in the range, in GPA
+ *               then id order
+ *      arg:     passed through to visit
+ *
+ *  A visit() result other than NO_ERROR stops the walk and is returned.
+ *
+ *  returns:  the number of ids visited, ERR_DB_FILE, or what visit returned
+ */
+int gpa_range(int lo, int hi, int (*visit)(int, void *), void *arg)
+{
+    int count;
+    const int *ids;
+
+    if (db_gpa.base == NULL || (ids = gpa_ids(&count)) == NULL)
+        return ERR_DB_FILE;
+
+    const int *start = gpa_start();
+    int found = 0;
+
+    for (int i = start[lo - MIN_STD_GPA]; i < start[hi - MIN_STD_GPA + 1]; i++)
+    {
+        int rc = visit(ids[i], arg);
+        if (rc != NO_ERROR)
+            return rc;
+        found++;
+    }
+
+    return found;
+}
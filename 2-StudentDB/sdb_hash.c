@@ -0,0 +1,396 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// Extendible hash layout (DB_FLAG_HASH).  Direct-slot files put student id
+// n at n * STUDENT_RECORD_SIZE, which is fine for ids up to MAX_STD_ID but
+// would make a file with 9 digit ids tens of GB of holes.  A hash file
+// instead keeps students in bucket pages of HASH_PAGE_SLOTS records
+// (4KB), so the file grows with the number of students, not their ids:
+//
+//  page 0     slot 0 is the db_header_t, the rest of the page is unused
+//  page 1...  slot 0 is a hash_bucket_t, slots 1..63 hold students, an
+//             empty slot has id DELETED_STUDENT_ID
+//
+// Ids are spread by a 64 bit hash.  A bucket of local depth d holds the
+// students whose hash ends in the d bits of its pattern.  The directory,
+// the sidecar file DB_HDIR_SUFFIX, maps the last G (global depth) bits of a
+// hash to the page of its bucket, so a lookup is a directory lookup in
+// memory and a single pread() of the bucket page.  A full bucket is split
+// in two on its next bit (doubling the directory first when d == G), the
+// half that moves goes to a new page at the end of the file.  Buckets are
+// not merged again when students are deleted.
+//
+// The directory only holds data derived from the bucket headers and is
+// rebuilt from them when it does not match the database generation.  A
+// split writes the new page before the old one, so a crash in between
+// leaves the moving students in both buckets; a student only counts in
+// the bucket the directory points its hash at (see hash_owns()), and the
+// old bucket drops the copies the next time it fills up (see split_bucket).
+#define HASH_PAGE_SIZE  (HASH_PAGE_SLOTS * STUDENT_RECORD_SIZE)
+#define HASH_MAGIC      0x53444248      //"SDBH", above every student id
+#define HDIR_MAGIC      0x53444244      //"SDBD"
+#define HASH_MAX_DEPTH  24              //directory of 64MB
+
+typedef struct hash_bucket {
+    int magic;
+    int depth;              //local depth d
+    unsigned int bits;      //the last d bits of every hash in the bucket
+    char reserved[52];
+} hash_bucket_t;
+
+_Static_assert(sizeof(hash_bucket_t) == sizeof(student_t),
+               "bucket header must fill exactly one record slot");
+
+sidecar_t db_hdir = {-1, NULL, 0};
+
+// 64 bit mix of the id (splitmix64 finalizer), consecutive ids land in
+// unrelated buckets
+static uint64_t hash_id(int id)
+{
+    uint64_t h = (uint64_t)(unsigned int)id;
+
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+static int dir_depth(void)
+{
+    return sidecar_header(&db_hdir)->count;
+}
+
+static int *dir_pages(void)
+{
+    return (int *)(db_hdir.base + sizeof(sidecar_header_t));
+}
+
+static size_t dir_size(int depth)
+{
+    return sizeof(sidecar_header_t) + ((size_t)1 << depth) * sizeof(int);
+}
+
+// reads bucket page into rec
+static int read_page(int fd, int page, student_t *rec)
+{
+    if (pread(fd, rec, HASH_PAGE_SIZE, (off_t)page * HASH_PAGE_SIZE) != HASH_PAGE_SIZE)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+static int write_page(int fd, int page, const student_t *rec)
+{
+    if (pwrite(fd, rec, HASH_PAGE_SIZE, (off_t)page * HASH_PAGE_SIZE) != HASH_PAGE_SIZE)
+        return ERR_DB_WRITE;
+    return NO_ERROR;
+}
+
+// an empty bucket page
+static void init_page(student_t *rec, int depth, unsigned int bits)
+{
+    hash_bucket_t *b = (hash_bucket_t *)rec;
+
+    memset(rec, 0, HASH_PAGE_SIZE);
+    b->magic = HASH_MAGIC;
+    b->depth = depth;
+    b->bits = bits;
+}
+
+/*
+ *  hash_rebuild
+ *      fd:   the open database file
+ *      gen:  the database generation the directory will match
+ *
+ *  Rebuilds the directory from the bucket headers.  Buckets are placed by
+ *  increasing depth, so when a crashed split left a bucket and one of its
+ *  halves both claiming a hash the deeper (newer) one wins.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int hash_rebuild(int fd, unsigned int gen)
+{
+    struct stat st;
+    hash_bucket_t b;
+    int depth = 0;
+
+    if (fstat(fd, &st) == -1)
+        return ERR_DB_FILE;
+
+    int npages = st.st_size / HASH_PAGE_SIZE;
+    for (int page = 1; page < npages; page++)
+    {
+        if (pread(fd, &b, sizeof(b), (off_t)page * HASH_PAGE_SIZE) != sizeof(b))
+            return ERR_DB_FILE;
+        if (b.magic == HASH_MAGIC && b.depth > depth && b.depth <= HASH_MAX_DEPTH)
+            depth = b.depth;
+    }
+
+    if (grow_sidecar(&db_hdir, dir_size(depth)) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    int *dir = dir_pages();
+    memset(dir, 0, ((size_t)1 << depth) * sizeof(int));
+
+    for (int d = 0; d <= depth; d++)
+    {
+        for (int page = 1; page < npages; page++)
+        {
+            if (pread(fd, &b, sizeof(b), (off_t)page * HASH_PAGE_SIZE) != sizeof(b))
+                return ERR_DB_FILE;
+            if (b.magic != HASH_MAGIC || b.depth != d)
+                continue;
+            for (size_t i = b.bits; i < ((size_t)1 << depth); i += (size_t)1 << d)
+                dir[i] = page;
+        }
+    }
+
+    sidecar_header(&db_hdir)->count = depth;
+    set_sidecar_gen(&db_hdir, gen);
+    return NO_ERROR;
+}
+
+/*
+ *  open_hash
+ *      dbFile:  name of the database file, the directory is dbFile with
+ *               DB_HDIR_SUFFIX appended
+ *      fd:      the open database file, a DB_FLAG_HASH file
+ *      gen:     the generation in the database header
+ *
+ *  Opens (creating if needed) and maps the directory.  A new database gets
+ *  its first bucket, depth 0, and a directory of one entry; a directory
+ *  that does not match the database is rebuilt.  Unlike the other sidecars
+ *  the directory is required, a hash file cannot be used without it.
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE or ERR_DB_WRITE
+ */
+int open_hash(const char *dbFile, int fd, unsigned int gen)
+{
+    struct stat st;
+
+    if (open_sidecar(&db_hdir, dbFile, DB_HDIR_SUFFIX, HDIR_MAGIC, dir_size(0), true) != NO_ERROR ||
+        fstat(fd, &st) == -1)
+    {
+        close_sidecar(&db_hdir);
+        return ERR_DB_FILE;
+    }
+
+    if (st.st_size <= HASH_PAGE_SIZE)
+    {
+        student_t rec[HASH_PAGE_SLOTS];
+
+        init_page(rec, 0, 0);
+        if (write_page(fd, 1, rec) != NO_ERROR)
+        {
+            close_sidecar(&db_hdir);
+            return ERR_DB_WRITE;
+        }
+        sidecar_header(&db_hdir)->count = 0;
+        dir_pages()[0] = 1;
+        set_sidecar_gen(&db_hdir, gen);
+        return NO_ERROR;
+    }
+
+    if (sidecar_gen(&db_hdir) != gen && hash_rebuild(fd, gen) != NO_ERROR)
+    {
+        close_sidecar(&db_hdir);
+        return ERR_DB_FILE;
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  hash_sync
+ *
+ *  Remaps the directory if another process doubled it.  Scans call this
+ *  once before they start, hash_owns() can then be used from several
+ *  threads.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int hash_sync(void)
+{
+    if (db_hdir.base == NULL)
+        return ERR_DB_FILE;
+    if (dir_size(dir_depth()) > db_hdir.len && grow_sidecar(&db_hdir, 0) != NO_ERROR)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+// page of the bucket for id, the directory must be in sync
+static int bucket_page(int id)
+{
+    uint64_t mask = ((uint64_t)1 << dir_depth()) - 1;
+
+    return dir_pages()[hash_id(id) & mask];
+}
+
+/*
+ *  hash_owns
+ *      slot:  a slot of the mapped hash file
+ *      id:    the id in that slot
+ *
+ *  returns:  true if the slot holds a student, false for page 0, bucket
+ *            headers, empty slots and students a crashed split left behind
+ */
+bool hash_owns(int slot, int id)
+{
+    return slot % HASH_PAGE_SLOTS != 0 && id != DELETED_STUDENT_ID &&
+           bucket_page(id) == slot / HASH_PAGE_SLOTS;
+}
+
+/*
+ *  hash_locate
+ *      fd:       the open database file
+ *      id:       the student id we are looking for
+ *      *s:       where the located student is copied (may be NULL)
+ *      *offset:  where the file offset of the record is stored (may be NULL)
+ *
+ *  locate_student() for hash files: one pread() of the student's bucket.
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE or SRCH_NOT_FOUND
+ */
+int hash_locate(int fd, int id, student_t *s, off_t *offset)
+{
+    student_t rec[HASH_PAGE_SLOTS];
+
+    if (hash_sync() != NO_ERROR)
+        return ERR_DB_FILE;
+
+    int page = bucket_page(id);
+    if (read_page(fd, page, rec) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    int i = 1 + scan_find_id(&rec[1], HASH_PAGE_SLOTS - 1, id);
+    if (i == HASH_PAGE_SLOTS)
+        return SRCH_NOT_FOUND;
+
+    if (s != NULL)
+        *s = rec[i];
+    if (offset != NULL)
+        *offset = (off_t)page * HASH_PAGE_SIZE + (off_t)i * STUDENT_RECORD_SIZE;
+    return NO_ERROR;
+}
+
+/*
+ *  split_bucket
+ *      fd:    the open database file
+ *      page:  the full bucket
+ *      rec:   its contents
+ *
+ *  Splits the bucket on its next hash bit, the students with the bit set
+ *  move to a new page at the end of the file.  Students the bucket does
+ *  not own any more (see hash_owns()) are dropped on the way.  A bucket
+ *  whose other half is in its own page already, after a split cut short
+ *  by a crash, is only rewritten with its new depth.
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE or ERR_DB_WRITE
+ */
+static int split_bucket(int fd, int page, const student_t *rec)
+{
+    const hash_bucket_t *b = (const hash_bucket_t *)rec;
+    int d = b->depth;
+    struct stat st;
+
+    if (d >= HASH_MAX_DEPTH || fstat(fd, &st) == -1)
+        return ERR_DB_WRITE;
+
+    // double the directory, both halves point at the same buckets
+    int depth = dir_depth();
+    if (d == depth)
+    {
+        if (grow_sidecar(&db_hdir, dir_size(depth + 1)) != NO_ERROR)
+            return ERR_DB_FILE;
+        memcpy(dir_pages() + ((size_t)1 << depth), dir_pages(), ((size_t)1 << depth) * sizeof(int));
+        sidecar_header(&db_hdir)->count = ++depth;
+    }
+
+    student_t lo[HASH_PAGE_SLOTS];
+    student_t hi[HASH_PAGE_SLOTS];
+    int nlo = 1, nhi = 1;
+    int new_page = st.st_size / HASH_PAGE_SIZE;
+
+    init_page(lo, d + 1, b->bits);
+    init_page(hi, d + 1, b->bits | (1u << d));
+    for (int i = 1; i < HASH_PAGE_SLOTS; i++)
+    {
+        uint64_t h = hash_id(rec[i].id);
+
+        // a crashed split left copies of students that moved to a deeper
+        // bucket, they match the old pattern but belong to the other page
+        if (rec[i].id == DELETED_STUDENT_ID || bucket_page(rec[i].id) != page)
+            continue;
+        if (h & ((uint64_t)1 << d))
+            hi[nhi++] = rec[i];
+        else
+            lo[nlo++] = rec[i];
+    }
+
+    // a crashed split got the other half to its page already, the bucket
+    // only has to catch up with its depth
+    int *dir = dir_pages();
+    if (dir[b->bits | ((size_t)1 << d)] != page)
+        return write_page(fd, page, lo);
+
+    // the new page first, see above
+    if (write_page(fd, new_page, hi) != NO_ERROR || write_page(fd, page, lo) != NO_ERROR)
+        return ERR_DB_WRITE;
+
+    for (size_t i = b->bits | ((size_t)1 << d); i < ((size_t)1 << depth); i += (size_t)2 << d)
+        dir[i] = new_page;
+
+    return NO_ERROR;
+}
+
+/*
+ *  hash_store
+ *      fd:  the open database file
+ *      s:   the student to store
+ *
+ *  Writes the student into its bucket: over its own record if it is there
+ *  already (a replayed log record), otherwise into the first empty slot.
+ *  A full bucket is split first.  The caller holds the whole file lock.
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE or ERR_DB_WRITE
+ */
+int hash_store(int fd, const student_t *s)
+{
+    student_t rec[HASH_PAGE_SLOTS];
+
+    if (hash_sync() != NO_ERROR)
+        return ERR_DB_FILE;
+
+    for (;;)
+    {
+        int page = bucket_page(s->id);
+        if (read_page(fd, page, rec) != NO_ERROR)
+            return ERR_DB_FILE;
+
+        int i = 1 + scan_find_id(&rec[1], HASH_PAGE_SLOTS - 1, s->id);
+        if (i == HASH_PAGE_SLOTS)
+            i = 1 + scan_find_id(&rec[1], HASH_PAGE_SLOTS - 1, DELETED_STUDENT_ID);
+
+        if (i < HASH_PAGE_SLOTS)
+        {
+            off_t offset = (off_t)page * HASH_PAGE_SIZE + (off_t)i * STUDENT_RECORD_SIZE;
+            if (pwrite(fd, s, STUDENT_RECORD_SIZE, offset) != STUDENT_RECORD_SIZE)
+                return ERR_DB_WRITE;
+            return NO_ERROR;
+        }
+
+        int rc = split_bucket(fd, page, rec);
+        if (rc != NO_ERROR)
+            return rc;
+    }
+}
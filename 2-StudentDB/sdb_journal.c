@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// Compaction step journal.  An online compaction (see compact_online() in
+// sdbsc.c) packs the students of a direct-slot file towards the front of
+// the file a step at a time.  The records a step writes may land on slots
+// the step reads from, so a crash half way through the step could lose
+// students.  The step is therefore written to the journal and synced first:
+// a journal header describing the step, followed by the records in the
+// order they are written from slot compact_end on.  A step found in the
+// journal whose starting point matches the progress in the database header
+// was interrupted and is done again by compact_recover(); any other step
+// already finished.  The journal is removed when the compaction finishes.
+#define JOURNAL_MAGIC   0x53444a4c      //"SDBJ"
+
+typedef struct journal_header {
+    int magic;
+    unsigned int check;     //checksum of the step and its records
+    compact_step_t step;
+    char pad[36];
+} journal_header_t;
+
+_Static_assert(sizeof(journal_header_t) == sizeof(student_t),
+               "journal header must fill exactly one record slot");
+
+// FNV-1a over the step and its records
+static unsigned int journal_checksum(const compact_step_t *step, const student_t *rec)
+{
+    const unsigned char *p = (const unsigned char *)step;
+    unsigned int h = 2166136261u;
+
+    for (size_t i = 0; i < sizeof(*step); i++)
+    {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+
+    p = (const unsigned char *)rec;
+    for (size_t i = 0; i < (size_t)step->count * sizeof(student_t); i++)
+    {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int journal_path(const char *dbFile, char *path, size_t len)
+{
+    if (snprintf(path, len, "%s%s", dbFile, DB_JOURNAL_SUFFIX) >= (int)len)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+/*
+ *  journal_step
+ *      dbFile:  name of the database file, the journal is dbFile with
+ *               DB_JOURNAL_SUFFIX appended
+ *      step:    the step about to be done
+ *      rec:     the step->count records it writes
+ *
+ *  Replaces the journal with the step and syncs it.
+ *
+ *  returns:  NO_ERROR or ERR_DB_WRITE
+ */
+int journal_step(const char *dbFile, const compact_step_t *step, const student_t *rec)
+{
+    char path[PATH_MAX];
+    journal_header_t hdr = {0};
+    size_t len = (size_t)step->count * STUDENT_RECORD_SIZE;
+
+    if (journal_path(dbFile, path, sizeof(path)) != NO_ERROR)
+        return ERR_DB_WRITE;
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (fd == -1)
+        return ERR_DB_WRITE;
+
+    hdr.magic = JOURNAL_MAGIC;
+    hdr.step = *step;
+    hdr.check = journal_checksum(step, rec);
+
+    int rc = NO_ERROR;
+    if (pwrite(fd, rec, len, sizeof(hdr)) != (ssize_t)len ||
+        pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        fdatasync(fd) == -1)
+        rc = ERR_DB_WRITE;
+
+    close(fd);
+    return rc;
+}
+
+/*
+ *  journal_load
+ *      dbFile:  name of the database file
+ *      step:    where the journaled step is stored
+ *      rec:     set to the records of the step, free() them
+ *
+ *  returns:  NO_ERROR        *step and *rec hold the journaled step
+ *            SRCH_NOT_FOUND  there is no journal, or it was torn by a crash
+ *                            before the step started
+ *            ERR_DB_FILE     the journal could not be read
+ */
+int journal_load(const char *dbFile, compact_step_t *step, student_t **rec)
+{
+    char path[PATH_MAX];
+    journal_header_t hdr;
+
+    if (journal_path(dbFile, path, sizeof(path)) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return SRCH_NOT_FOUND;
+
+    int rc = SRCH_NOT_FOUND;
+    *rec = NULL;
+    if (pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) && hdr.magic == JOURNAL_MAGIC &&
+        hdr.step.count >= 0 && hdr.step.count <= COMPACT_STEP_SLOTS)
+    {
+        size_t len = (size_t)hdr.step.count * STUDENT_RECORD_SIZE;
+
+        *rec = malloc(len ? len : 1);
+        if (*rec == NULL)
+            rc = ERR_DB_FILE;
+        else if (pread(fd, *rec, len, sizeof(hdr)) == (ssize_t)len &&
+                 hdr.check == journal_checksum(&hdr.step, *rec))
+            rc = NO_ERROR;
+    }
+
+    close(fd);
+    if (rc != NO_ERROR)
+    {
+        free(*rec);
+        *rec = NULL;
+    }
+    else
+    {
+        *step = hdr.step;
+    }
+    return rc;
+}
+
+/*
+ *  journal_remove
+ *      dbFile:  name of the database file
+ *
+ *  Deletes the journal, a compaction starts and ends without one.
+ */
+void journal_remove(const char *dbFile)
+{
+    char path[PATH_MAX];
+
+    if (journal_path(dbFile, path, sizeof(path)) == NO_ERROR)
+        unlink(path);
+}
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "libsdb.h"
+
+// Handle based API of libsdb.a, see libsdb.h.  The calls are thin wrappers
+// around the engine functions that do the work of the command line options
+// without any console output.
+struct sdb {
+    int fd;                 //database file, -1 while no handle is open
+};
+
+static sdb_t db_handle = {-1};
+
+/*
+ *  sdb_open
+ *      path:  name of the database file, created if it does not exist
+ *      opts:  NULL for the defaults (all zero)
+ *      db:    set to the handle
+ *
+ *  Opens the database like open_db() and sizes the block cache.
+ *
+ *  returns:  NO_ERROR     *db is the open handle
+ *            ERR_DB_OP    a handle is open already
+ *            ERR_DB_FILE  the database could not be opened, or the cache
+ *                         not allocated
+ */
+int sdb_open(const char *path, const sdb_options_t *opts, sdb_t **db)
+{
+    sdb_options_t defaults = {0};
+
+    if (db_handle.fd >= 0)
+        return ERR_DB_OP;
+    if (opts == NULL)
+        opts = &defaults;
+
+    set_durability(opts->durability);
+    if (cache_init(opts->cache_blocks) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    int fd = open_store(path, opts->truncate);
+    if (fd < 0)
+    {
+        cache_init(0);
+        return ERR_DB_FILE;
+    }
+
+    db_handle.fd = fd;
+    *db = &db_handle;
+    return NO_ERROR;
+}
+
+/*
+ *  sdb_close
+ *      db:  the handle, invalid afterwards
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE if closing the file failed
+ */
+int sdb_close(sdb_t *db)
+{
+    int rc = close_db(db->fd);
+
+    db->fd = -1;
+    cache_init(0);
+    return (rc == 0) ? NO_ERROR : ERR_DB_FILE;
+}
+
+/*
+ *  sdb_get
+ *      db:  the handle
+ *      id:  the student to look up
+ *      s:   where the student is copied
+ *
+ *  returns:  NO_ERROR, SRCH_NOT_FOUND or ERR_DB_FILE, see get_student()
+ */
+int sdb_get(sdb_t *db, int id, student_t *s)
+{
+    return get_student(db->fd, id, s);
+}
+
+/*
+ *  sdb_get_many
+ *      db:   the handle
+ *      ids:  the students to look up
+ *      n:    number of ids
+ *      s:    n students, s[i] is where the student ids[i] is copied
+ *      rcs:  n return codes, NO_ERROR, SRCH_NOT_FOUND or ERR_DB_FILE for
+ *            each id
+ *
+ *  Looks up all the students as one batch of reads, see get_students().
+ *
+ *  returns:  the number of students found, or ERR_DB_FILE
+ */
+int sdb_get_many(sdb_t *db, const int *ids, int n, student_t *s, int *rcs)
+{
+    return get_students(db->fd, ids, n, s, rcs);
+}
+
+/*
+ *  sdb_add
+ *      db:  the handle
+ *      s:   the student to add
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE, ERR_DB_WRITE or ERR_DB_READONLY, see
+ *            insert_student(), ERR_DB_OP if the student exists already or
+ *            the id or gpa is out of range (see validate_range())
+ */
+int sdb_add(sdb_t *db, const student_t *s)
+{
+    if (validate_range(s->id, s->gpa) != NO_ERROR)
+        return ERR_DB_OP;
+
+    return insert_student(db->fd, s);
+}
+
+/*
+ *  sdb_del
+ *      db:  the handle
+ *      id:  the student to delete
+ *
+ *  returns:  NO_ERROR, SRCH_NOT_FOUND, ERR_DB_FILE, ERR_DB_WRITE or
+ *            ERR_DB_READONLY, see remove_student()
+ */
+int sdb_del(sdb_t *db, int id)
+{
+    return remove_student(db->fd, id);
+}
+
+/*
+ *  sdb_count
+ *      db:  the handle
+ *
+ *  returns:  the number of students, or ERR_DB_FILE
+ */
+int sdb_count(sdb_t *db)
+{
+    return count_students(db->fd);
+}
+
+/*
+ *  sdb_scan
+ *      db:     the handle
+ *      visit:  called for every student, see scan_students()
+ *      arg:    passed through to visit
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE or what visit() returned to stop the scan
+ */
+int sdb_scan(sdb_t *db, int (*visit)(const student_t *, void *), void *arg)
+{
+    return scan_students(db->fd, visit, arg);
+}
+
+/*
+ *  sdb_cache_stats
+ *      db:  the handle
+ *      st:  where the block cache counters since sdb_open() are stored
+ */
+void sdb_cache_stats(sdb_t *db, sdb_cache_stats_t *st)
+{
+    (void)db;
+    cache_stats(&st->hits, &st->misses);
+}
@@ -0,0 +1,144 @@
+#define _GNU_SOURCE //F_OFD_SETLKW is linux specific
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// Record locks.  Several sdbsc processes (and the server) may use the same
+// database, so changes and scans lock the byte ranges they work on with
+// open file description locks (fcntl F_OFD_SETLKW), which belong to the
+// open file rather than the process and so also keep threads apart:
+//
+//  1. a change to a student write locks the student's slot, id *
+//     STUDENT_RECORD_SIZE, for the whole check-log-write sequence.  The slot
+//     is the lock for the id even where the record lives elsewhere (files
+//     without a header), so changes to different students run in parallel
+//  2. the generation bump before the record write and the sidecar update
+//     after it are serialized by short write locks on slot 0, the record
+//     write itself holds only the slot lock (see begin_slot_update)
+//  3. scans and lookups that walk the record array read lock the whole
+//     file, as do the index searches, so they see no change half done
+//  4. compacted files move records on every change, there changes write
+//     lock the whole file, as do bulk loads
+//
+// Locks are always taken in that order (slot, then header), and slot locks
+// are never requested under a whole file lock (see lock_range()), so
+// waiting cannot deadlock.
+
+// whole file lock held by this process, whole file locks nest
+static int whole_depth = 0;
+
+// sets or clears a lock, waiting out conflicting locks
+static int set_lock(int fd, int type, off_t start, off_t len)
+{
+    struct flock lk = {0};
+
+    lk.l_type = type;
+    lk.l_whence = SEEK_SET;
+    lk.l_start = start;
+    lk.l_len = len;
+
+    while (fcntl(fd, F_OFD_SETLKW, &lk) == -1)
+    {
+        if (errno != EINTR)
+            return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  lock_byte
+ *      fd:     any open file, for example a sidecar
+ *      type:   F_RDLCK, F_WRLCK or F_UNLCK
+ *      start:  the byte to lock
+ *      wait:   wait for conflicting locks, otherwise give up right away
+ *
+ *  Locks one byte of a file other than the database, the snapshot readers
+ *  use this to find out whether others are still reading (see
+ *  sdb_snapshot.c).  A lock held on the byte already is converted to type.
+ *
+ *  returns:  NO_ERROR, ERR_DB_OP if another lock is in the way and wait
+ *            is false, or ERR_DB_FILE
+ */
+int lock_byte(int fd, int type, off_t start, bool wait)
+{
+    struct flock lk = {0};
+
+    if (wait)
+        return set_lock(fd, type, start, 1);
+
+    lk.l_type = type;
+    lk.l_whence = SEEK_SET;
+    lk.l_start = start;
+    lk.l_len = 1;
+
+    if (fcntl(fd, F_OFD_SETLK, &lk) == -1)
+        return (errno == EAGAIN || errno == EACCES) ? ERR_DB_OP : ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+/*
+ *  lock_range
+ *      fd:     the open database file
+ *      type:   F_RDLCK, F_WRLCK or F_UNLCK
+ *      start:  first byte of the range
+ *      len:    bytes in the range, 0 runs to the end of the file and beyond
+ *
+ *  Locks or unlocks a byte range of the database file, waiting for
+ *  conflicting locks of other processes to go away.  Under a whole file
+ *  lock this does nothing: the range is already covered, and unlocking it
+ *  would punch a hole in the whole file lock.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int lock_range(int fd, int type, off_t start, off_t len)
+{
+    if (whole_depth > 0)
+        return NO_ERROR;
+    return set_lock(fd, type, start, len);
+}
+
+/*
+ *  lock_db
+ *      fd:    the open database file
+ *      type:  F_RDLCK, F_WRLCK or F_UNLCK
+ *
+ *  Locks or unlocks the whole database file.  Whole file locks nest: a
+ *  lock_db() while one is held only counts, the matching F_UNLCK releases
+ *  the file when the outermost lock is undone.  The outermost lock decides
+ *  the type.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int lock_db(int fd, int type)
+{
+    if (type == F_UNLCK)
+    {
+        if (whole_depth == 0 || --whole_depth > 0)
+            return NO_ERROR;
+        return set_lock(fd, F_UNLCK, 0, 0);
+    }
+
+    if (whole_depth > 0)
+    {
+        whole_depth++;
+        return NO_ERROR;
+    }
+
+    int rc = set_lock(fd, type, 0, 0);
+    if (rc == NO_ERROR)
+        whole_depth = 1;
+    return rc;
+}
+
+// number of nested whole file locks this process holds, see lock_db()
+int lock_depth(void)
+{
+    return whole_depth;
+}
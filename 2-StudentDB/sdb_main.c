@@ -0,0 +1,572 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// Command line front end.  The engine (sdbsc.c and the sdb_*.c modules it
+// uses) is built into libsdb.a, see libsdb.h, this file, the server and
+// the client make up the sdbsc program on top of it.
+
+/*
+ *  usage
+ *      exename:  the name of the executable from argv[0]
+ *
+ *  Prints this programs expected usage
+ *
+ *  returns:    nothing, this is a void function
+ *
+ *  console:  This function prints the usage information
+ *
+ */
+void usage(char *exename)
+{
+    printf("usage: %s -[h|a|b|c|d|f|s|q|p|A|x|X|P|z|F|S] options.  Where:\n", exename);
+    printf("\t-h:  prints help\n");
+    printf("\t-a id first_name last_name gpa(as 3 digit int):  adds a student\n");
+    printf("\t-b [file]:  bulk loads students from a csv file (or stdin)\n");
+    printf("\t-c:  counts the records in the database\n");
+    printf("\t-d id:  deletes a student\n");
+    printf("\t-f id [id ...]:  finds and prints students in the database (ids from stdin if none or -)\n");
+    printf("\t-s prefix:  finds students by last name prefix\n");
+    printf("\t-q lo hi:  finds students with a gpa between lo and hi (as 3 digit ints)\n");
+    printf("\t-p [--order-by lname|gpa]:  prints all records in the student database, in id or the given order\n");
+    printf("\t-A:  prints gpa analytics (average, min, max, histogram)\n");
+    printf("\t-x [packed]:  compress the database file into a dense id-sorted file, or a read only packed one\n");
+    printf("\t-X [steps]:  compacts the database a step at a time while it stays in use\n");
+    printf("\t-P:  releases the disk space of blocks without students\n");
+    printf("\t-z:  zero db file (remove all records)\n");
+    printf("\t-F replica [once]:  applies the change log of the database to a replica file and follows it (or stops at its end)\n");
+    printf("\t-S [socket]:  serves requests on a unix socket (default %s)\n", SDB_SOCKET_PATH);
+    printf("\n%s=socket forwards -a, -c, -d, -f, -p and -z to a running server\n", SDB_SOCKET_ENV);
+    printf("%s=lazy lets -a and -d return before their log record is on disk\n", SDB_DURABILITY_ENV);
+    printf("%s=hash creates new database files with the hash layout (9 digit ids)\n", SDB_LAYOUT_ENV);
+    printf("%s=blocks has the server (-S) cache that many 4KB blocks for lookups\n", SDB_CACHE_ENV);
+    printf("%s=KB caps the memory of -p --order-by, larger databases sort through a temporary file\n", SDB_SORT_MEM_ENV);
+}
+
+// reads whitespace separated ids, like the ids of argv
+static int *read_ids(FILE *fp, int *n)
+{
+    char token[32];
+    int *ids = NULL;
+    int cap = 0;
+
+    *n = 0;
+    while (fscanf(fp, "%31s", token) == 1)
+    {
+        if (*n == cap)
+        {
+            cap = cap ? 2 * cap : 256;
+            int *grown = realloc(ids, cap * sizeof(int));
+            if (grown == NULL)
+            {
+                free(ids);
+                return NULL;
+            }
+            ids = grown;
+        }
+        ids[(*n)++] = atoi(token);
+    }
+    return (ids != NULL) ? ids : malloc(sizeof(int));
+}
+
+/*
+ *  find_students
+ *      fd:    linux file descriptor, or -1 when forwarding to a server
+ *      srv:   server connection, or -1
+ *      ids:   the students to find
+ *      n:     number of ids
+ *
+ *  The -f option with several ids.  The students are looked up as one
+ *  batch with get_students(), or one request after the other on the server
+ *  connection, and printed in the order of ids in the same table format as
+ *  print_db().  An id that is not in the database prints M_STD_NOT_FND_MSG
+ *  in its place.
+ *
+ *  returns:  EXIT_OK        every student was found
+ *            EXIT_FAIL_DB   a student was not found, or the lookups failed
+ *
+ *  console:  <see above>     the students and the ids not found
+ *            M_ERR_DB_READ   error reading the database file
+ */
+static int find_students(int fd, int srv, const int *ids, int n)
+{
+    student_t *s = malloc((n ? n : 1) * sizeof(student_t));
+    int *rcs = malloc((n ? n : 1) * sizeof(int));
+    int exit_code = EXIT_OK;
+    int rc = NO_ERROR;
+
+    if (s == NULL || rcs == NULL)
+    {
+        rc = ERR_DB_FILE;
+    }
+    else if (srv >= 0)
+    {
+        for (int i = 0; i < n && rc == NO_ERROR; i++)
+        {
+            rcs[i] = remote_get_student(srv, ids[i], &s[i]);
+            if (rcs[i] == ERR_SDB_COMM)
+                rc = ERR_SDB_COMM;
+        }
+    }
+    else
+    {
+        rc = get_students(fd, ids, n, s, rcs);
+    }
+
+    if (rc == ERR_SDB_COMM)
+    {
+        exit_code = EXIT_FAIL_DB;
+    }
+    else if (rc == ERR_DB_FILE)
+    {
+        printf(M_ERR_DB_READ);
+        exit_code = EXIT_FAIL_DB;
+    }
+    else
+    {
+        bool header_printed = false;
+
+        for (int i = 0; i < n; i++)
+        {
+            if (rcs[i] == NO_ERROR)
+            {
+                print_db_row(&s[i], &header_printed);
+                continue;
+            }
+            if (rcs[i] == SRCH_NOT_FOUND)
+                printf(M_STD_NOT_FND_MSG, ids[i]);
+            else
+                printf(M_ERR_DB_READ);
+            exit_code = EXIT_FAIL_DB;
+        }
+    }
+
+    free(s);
+    free(rcs);
+    return exit_code;
+}
+
+// Welcome to main()
+int main(int argc, char *argv[])
+{
+    char opt;      // user selected option
+    int fd;        // file descriptor of database files
+    int rc;        // return code from various operations
+    int exit_code; // exit code to shell
+    int id;        // userid from argv[2]
+    int gpa;       // gpa from argv[5]
+    int srv = -1;  // server connection when running as a client
+
+    // space for a student structure which we will get back from
+    // some of the functions we will be writing such as get_student(),
+    // and print_student().
+    student_t student = {0};
+
+    // This function must have at least one arg, and the arg must start
+    // with a dash
+    if ((argc < 2) || (*argv[1] != '-'))
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    // The option is the first character after the dash for example
+    //-h -a -c -d -f -p -x -z
+    opt = (char)*(argv[1] + 1); // get the option flag
+
+    // handle the help flag and then exit normally
+    if (opt == 'h')
+    {
+        usage(argv[0]);
+        exit(EXIT_OK);
+    }
+
+    // SDBSC_DURABILITY picks how adds and deletes are logged, see sdb_wal.c
+    set_durability(parse_durability(getenv(SDB_DURABILITY_ENV)));
+
+    // when SDBSC_SOCKET names a running server (see -S) the operations
+    // it supports are forwarded to it instead of opening the file here,
+    // a sorted -p is done here
+    char *server_path = getenv(SDB_SOCKET_ENV);
+    if (server_path != NULL && strchr("acdfpz", opt) != NULL && !(opt == 'p' && argc > 2))
+    {
+        srv = connect_server(server_path);
+        if (srv < 0)
+        {
+            exit(EXIT_FAIL_DB);
+        }
+        fd = -1;
+    }
+    else
+    {
+        // now lets open the file and continue if there is no error
+        // note we are not truncating the file using the second
+        // parameter
+        fd = open_db(DB_FILE, false);
+        if (fd < 0)
+        {
+            exit(EXIT_FAIL_DB);
+        }
+    }
+
+    // set rc to the return code of the operation to ensure the program
+    // use that to determine the proper exit_code.  Look at the header
+    // sdbsc.h for expected values.
+
+    exit_code = EXIT_OK;
+    switch (opt)
+    {
+    case 'a':
+        //   arv[0] arv[1]  arv[2]      arv[3]    arv[4]  arv[5]
+        // prog_name     -a      id  first_name last_name     gpa
+        //-------------------------------------------------------
+        // example:  prog_name -a 1 John Doe 341
+        if (argc != 6)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+
+        // convert id and gpa to ints from argv.  For this assignment assume
+        // they are valid numbers
+        id = atoi(argv[2]);
+        gpa = atoi(argv[5]);
+
+        exit_code = validate_range(id, gpa);
+        if (exit_code == EXIT_FAIL_ARGS)
+        {
+            printf(M_ERR_STD_RNG);
+            break;
+        }
+
+        if (srv >= 0)
+            rc = remote_add_student(srv, id, argv[3], argv[4], gpa);
+        else
+            rc = add_student(fd, id, argv[3], argv[4], gpa);
+        if (rc == EXIT_FAIL_ARGS)
+            exit_code = EXIT_FAIL_ARGS;
+        else if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+
+        break;
+
+    case 'b':
+        //    arv[0] arv[1]  arv[2]
+        // prog_name     -b  [file]
+        //-------------------------
+        // example:  prog_name -b roster.csv
+        //           cat roster.csv | prog_name -b
+        if (argc > 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        if (argc == 3 && strcmp(argv[2], "-") != 0)
+        {
+            FILE *roster = fopen(argv[2], "r");
+            if (roster == NULL)
+            {
+                printf(M_ERR_BULK_OPEN, argv[2]);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = bulk_load(fd, roster);
+            fclose(roster);
+        }
+        else
+        {
+            rc = bulk_load(fd, stdin);
+        }
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'c':
+        //    arv[0] arv[1]
+        // prog_name     -c
+        //-----------------
+        // example:  prog_name -c
+        if (srv >= 0)
+            rc = remote_count_db_records(srv);
+        else
+            rc = count_db_records(fd);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'd':
+        //   arv[0]  arv[1]  arv[2]
+        // prog_name     -d      id
+        //-------------------------
+        // example:  prog_name -d 100
+        if (argc != 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        id = atoi(argv[2]);
+        if (srv >= 0)
+            rc = remote_del_student(srv, id);
+        else
+            rc = del_student(fd, id);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+
+        break;
+
+    case 'f':
+        //    arv[0] arv[1]  arv[2]    [arv[3] ...]
+        // prog_name     -f      id    [id ...]
+        //-------------------------
+        // example:  prog_name -f 100
+        //           prog_name -f 100 101 102
+        //           cat ids.txt | prog_name -f
+        if (argc != 3 || strcmp(argv[2], "-") == 0)
+        {
+            if (argc > 3)
+            {
+                int n = argc - 2;
+                int ids[n];
+
+                for (int i = 0; i < n; i++)
+                    ids[i] = atoi(argv[i + 2]);
+                exit_code = find_students(fd, srv, ids, n);
+                break;
+            }
+
+            int n;
+            int *ids = read_ids(stdin, &n);
+            if (ids == NULL)
+            {
+                printf(M_ERR_DB_READ);
+                exit_code = EXIT_FAIL_DB;
+                break;
+            }
+            exit_code = find_students(fd, srv, ids, n);
+            free(ids);
+            break;
+        }
+        id = atoi(argv[2]);
+        if (srv >= 0)
+            rc = remote_get_student(srv, id, &student);
+        else
+            rc = get_student(fd, id, &student);
+
+        switch (rc)
+        {
+        case NO_ERROR:
+            print_student(&student);
+            break;
+        case SRCH_NOT_FOUND:
+            printf(M_STD_NOT_FND_MSG, id);
+            exit_code = EXIT_FAIL_DB;
+            break;
+        case ERR_SDB_COMM:
+            exit_code = EXIT_FAIL_DB;
+            break;
+        default:
+            printf(M_ERR_DB_READ);
+            exit_code = EXIT_FAIL_DB;
+            break;
+        }
+        break;
+
+    case 's':
+        //    arv[0] arv[1]  arv[2]
+        // prog_name     -s  prefix
+        //-------------------------
+        // example:  prog_name -s Sm
+        if (argc != 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = search_names(fd, argv[2]);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'q':
+        //    arv[0] arv[1] arv[2] arv[3]
+        // prog_name     -q     lo     hi
+        //-------------------------------
+        // example:  prog_name -q 350 400
+        if (argc != 4)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        {
+            int lo = atoi(argv[2]);
+            int hi = atoi(argv[3]);
+
+            if (lo < MIN_STD_GPA || hi > MAX_STD_GPA || lo > hi)
+            {
+                printf(M_ERR_GPA_RNG);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = query_gpa_range(fd, lo, hi);
+            if (rc < 0)
+                exit_code = EXIT_FAIL_DB;
+        }
+        break;
+
+    case 'A':
+        //    arv[0] arv[1]
+        // prog_name     -A
+        //-----------------
+        // example:  prog_name -A
+        if (analyze_db(fd) != NO_ERROR)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'p':
+        //    arv[0] arv[1]     [arv[2]   arv[3]]
+        // prog_name     -p  [--order-by  lname|gpa]
+        //-----------------
+        // example:  prog_name -p
+        //           prog_name -p --order-by gpa
+        if (argc != 2 && (argc != 4 || strcmp(argv[2], "--order-by") != 0 ||
+                          (strcmp(argv[3], "lname") != 0 && strcmp(argv[3], "gpa") != 0)))
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        if (argc == 4)
+            rc = print_sorted(fd, strcmp(argv[3], "gpa") == 0 ? SORT_BY_GPA : SORT_BY_LNAME);
+        else if (srv >= 0)
+            rc = remote_print_db(srv);
+        else
+            rc = print_db(fd);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'x':
+        //    arv[0] arv[1]  [arv[2]]
+        // prog_name     -x  [packed]
+        //-----------------
+        // example:  prog_name -x
+        //           prog_name -x packed
+
+        // remember compress_db returns a fd of the compressed database.
+        // we close it after this switch statement
+        if (argc > 3 || (argc == 3 && strcmp(argv[2], "packed") != 0))
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        fd = (argc == 3) ? pack_db(fd) : compress_db(fd);
+        if (fd < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'X':
+        //    arv[0] arv[1] [arv[2]]
+        // prog_name     -X  [steps]
+        //-----------------
+        // example:  prog_name -X 10
+        rc = compact_online(fd, (argc > 2) ? atoi(argv[2]) : 0);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'P':
+        //    arv[0] arv[1]
+        // prog_name     -P
+        //-----------------
+        // example:  prog_name -P
+        rc = punch_db(fd);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'z':
+        //    arv[0] arv[1]
+        // prog_name     -x
+        //-----------------
+        // example:  prog_name -x
+        // HINT:  close the db file, we already have fd
+        //       and reopen db indicating truncate=true
+        if (srv >= 0)
+        {
+            if (remote_zero_db(srv) != NO_ERROR)
+                exit_code = EXIT_FAIL_DB;
+            break;
+        }
+        close_db(fd);
+        fd = open_db(DB_FILE, true);
+        if (fd < 0)
+        {
+            exit_code = EXIT_FAIL_DB;
+            break;
+        }
+        printf(M_DB_ZERO_OK);
+        exit_code = EXIT_OK;
+        break;
+
+    case 'F':
+        //    arv[0] arv[1]   arv[2]  [arv[3]]
+        // prog_name     -F  replica    [once]
+        //-----------------
+        // example:  prog_name -F /backup/student.db
+        //           prog_name -F replica.db once
+        if (argc < 3 || argc > 4 || (argc == 4 && strcmp(argv[3], "once") != 0))
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+
+        // the first follower starts the change log of the database, the
+        // replica is then opened in its place
+        start_cdc(DB_FILE, fd);
+        close_db(fd);
+        fd = -1;
+        if (follow_log(DB_FILE DB_CDC_SUFFIX, argv[2], argc == 4) != NO_ERROR)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'S':
+        //    arv[0] arv[1]  arv[2]
+        // prog_name     -S  [socket]
+        //-------------------------
+        // example:  prog_name -S student.sock
+        if (argc > 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = start_server(&fd, (argc == 3) ? argv[2] : SDB_SOCKET_PATH);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    default:
+        usage(argv[0]);
+        exit_code = EXIT_FAIL_ARGS;
+    }
+
+    // dont forget to close the file before exiting, and setting the
+    // proper exit code - see the header file for expected values
+    if (srv >= 0)
+        close(srv);
+    if (fd >= 0)
+        close_db(fd);
+    exit(exit_code);
+}
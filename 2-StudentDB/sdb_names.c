@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// Name index sidecar.  A copy of every student_t, sorted by last name, first
+// name and id (names compare without regard to case), so a search by last
+// name prefix is a binary search followed by a walk over the matches.  The
+// index covers everything the search prints, so no database reads are needed.
+// The sidecar header count is the number of entries that follow it.
+#define NAMES_MAGIC     0x5344424e      //"SDBN"
+#define NAMES_MIN_CAP   1024            //entries in a new index file
+
+sidecar_t db_names = {-1, NULL, 0};
+
+// entries in use; remaps first if another process grew the index
+static student_t *name_entries(int *count)
+{
+    sidecar_header_t *hdr = sidecar_header(&db_names);
+    size_t need = sizeof(sidecar_header_t) + (size_t)hdr->count * sizeof(student_t);
+
+    if (need > db_names.len && grow_sidecar(&db_names, 0) != NO_ERROR)
+        return NULL;
+
+    hdr = sidecar_header(&db_names);
+    *count = hdr->count;
+    return (student_t *)(db_names.base + sizeof(sidecar_header_t));
+}
+
+static int cmp_name(const student_t *a, const student_t *b)
+{
+    int rc = strncasecmp(a->lname, b->lname, sizeof(a->lname));
+    if (rc == 0)
+        rc = strncasecmp(a->fname, b->fname, sizeof(a->fname));
+    if (rc == 0)
+        rc = (a->id > b->id) - (a->id < b->id);
+    return rc;
+}
+
+/*
+ *  cmp_student_name
+ *
+ *  qsort() comparator for student_t, in name index order.
+ */
+int cmp_student_name(const void *a, const void *b)
+{
+    return cmp_name(a, b);
+}
+
+// first entry that does not sort before key
+static int name_lower_bound(const student_t *entries, int count, const student_t *key)
+{
+    int lo = 0;
+    int hi = count;
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (cmp_name(&entries[mid], key) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/*
+ *  open_names
+ *      dbFile:  name of the database file, the index is dbFile with
+ *               DB_NAMES_SUFFIX appended
+ *
+ *  Opens (creating if needed) and maps the name index.  The caller checks
+ *  its generation against the database header and reloads it with
+ *  names_load() if they differ.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int open_names(const char *dbFile)
+{
+    return open_sidecar(&db_names, dbFile, DB_NAMES_SUFFIX, NAMES_MAGIC,
+                        sizeof(sidecar_header_t) + NAMES_MIN_CAP * sizeof(student_t), true);
+}
+
+/*
+ *  names_load
+ *      students:  every student in the database, the array gets sorted
+ *      n:         number of students
+ *
+ *  Replaces the contents of the index, used to rebuild a stale index.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int names_load(student_t *students, int n)
+{
+    qsort(students, n, sizeof(student_t), cmp_student_name);
+
+    if (grow_sidecar(&db_names, sizeof(sidecar_header_t) + (size_t)n * sizeof(student_t)) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    memcpy(db_names.base + sizeof(sidecar_header_t), students, (size_t)n * sizeof(student_t));
+    sidecar_header(&db_names)->count = n;
+    return NO_ERROR;
+}
+
+/*
+ *  names_insert
+ *      s:  the student that was added to the database
+ *
+ *  Inserts the student at its sorted position, the entries after it move
+ *  up one place.  The index grows by doubling.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE, a failure leaves the index stale
+ */
+int names_insert(const student_t *s)
+{
+    int count;
+    student_t *entries;
+
+    if (db_names.base == NULL || (entries = name_entries(&count)) == NULL)
+        return ERR_DB_FILE;
+
+    size_t need = sizeof(sidecar_header_t) + ((size_t)count + 1) * sizeof(student_t);
+    if (need > db_names.len)
+    {
+        if (grow_sidecar(&db_names, 2 * db_names.len) != NO_ERROR)
+        {
+            set_sidecar_gen(&db_names, SIDECAR_STALE);
+            return ERR_DB_FILE;
+        }
+        entries = (student_t *)(db_names.base + sizeof(sidecar_header_t));
+    }
+
+    int pos = name_lower_bound(entries, count, s);
+    memmove(&entries[pos + 1], &entries[pos], (size_t)(count - pos) * sizeof(student_t));
+    entries[pos] = *s;
+    sidecar_header(&db_names)->count = count + 1;
+    return NO_ERROR;
+}
+
+/*
+ *  names_remove
+ *      s:  the student that was deleted from the database
+ *
+ *  Removes the student's entry, the entries after it move down one place.
+ */
+void names_remove(const student_t *s)
+{
+    int count;
+    student_t *entries;
+
+    if (db_names.base == NULL || (entries = name_entries(&count)) == NULL)
+        return;
+
+    int pos = name_lower_bound(entries, count, s);
+    if (pos == count || entries[pos].id != s->id)
+        return;
+
+    memmove(&entries[pos], &entries[pos + 1], (size_t)(count - pos - 1) * sizeof(student_t));
+    sidecar_header(&db_names)->count = count - 1;
+}
+
+/*
+ *  names_search
+ *      prefix:  last name prefix, compared without regard to case
+ *      visit:   called for every matching student, in name order
+ *      arg:     passed through to visit
+ *
+ *  returns:  the number of students visited, or ERR_DB_FILE
+ */
+int names_search(const char *prefix, int (*visit)(const student_t *, void *), void *arg)
+{
+    student_t key = {0};
+    size_t plen = strlen(prefix);
+    int count;
+    int found = 0;
+
+    const student_t *entries;
+    if (db_names.base == NULL || (entries = name_entries(&count)) == NULL)
+        return ERR_DB_FILE;
+
+    strncpy(key.lname, prefix, sizeof(key.lname) - 1);
+    key.id = MIN_STD_ID - 1;
+
+    for (int i = name_lower_bound(entries, count, &key); i < count; i++)
+    {
+        if (strncasecmp(entries[i].lname, prefix, plen) != 0)
+            break;
+        if (visit(&entries[i], arg) != NO_ERROR)
+            break;
+        found++;
+    }
+
+    return found;
+}
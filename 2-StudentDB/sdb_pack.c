@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// Packed archive layout (DB_FLAG_PACKED).  A student_t pads the first name
+// to 24 and the last name to 32 bytes, most names are far shorter, so most
+// of a record is zeros.  A packed file stores every student in a few bytes
+// more than its names instead, for databases that are kept for reading
+// only, such as the archive of past years.  pack_db() in sdbsc.c writes
+// one from any other layout, -x turns it back into a compacted file that
+// takes changes again.
+//
+//  db_header_t     flags DB_FLAG_PACKED, the usual magic, version and gen
+//  pack_header_t   where the parts below start
+//  index           count pack_entry_t sorted by id, the id of a student
+//                  and the offset of its record in the records
+//  dictionary      nnames offsets, then the distinct last names, each a
+//                  length byte and the name, in strcmp() order.  Only when
+//                  coding the last names saves space, nnames is 0 otherwise
+//  records         per student in id order: the gpa (2 bytes), the length
+//                  of the first name (1 byte) and the name, then the last
+//                  name as its dictionary number (a varint, 7 bits per
+//                  byte) or, without a dictionary, its length and the name
+//
+// Names are not NUL terminated in the file, offsets are 32 bits so a
+// packed file is at most 4GB.  Everything is read from the mapping of the
+// file (see map_db in sdbsc.c), lookups binary search the index and scans
+// walk the records from start to end.
+typedef struct pack_header {
+    int count;              //students in the index
+    int nnames;             //last names in the dictionary, 0 if not coded
+    uint32_t dict;          //file offset of the dictionary
+    uint32_t data;          //file offset of the records
+    uint32_t data_len;      //bytes of records
+    uint32_t reserved;
+} pack_header_t;
+
+typedef struct pack_entry {
+    int id;
+    uint32_t offset;        //of the record, from the start of the records
+} pack_entry_t;
+
+#define PACK_INDEX      (sizeof(db_header_t) + sizeof(pack_header_t))
+#define PACK_LNAME_MAX  (sizeof(((student_t *)0)->lname) - 1)
+
+// the parts of a mapped packed file, checked to lie inside it
+typedef struct pack_view {
+    const pack_header_t *hdr;
+    const pack_entry_t *index;
+    const uint32_t *names;  //offsets of the names from the end of names
+    const uint8_t *dict;    //the names of the dictionary
+    size_t dict_len;
+    const uint8_t *data;
+} pack_view_t;
+
+static int pack_open(const char *base, size_t len, pack_view_t *v)
+{
+    if (base == NULL || len < PACK_INDEX)
+        return ERR_DB_FILE;
+
+    const pack_header_t *hdr = (const pack_header_t *)(base + sizeof(db_header_t));
+    if (hdr->count < 0 || hdr->nnames < 0 ||
+        PACK_INDEX + (size_t)hdr->count * sizeof(pack_entry_t) > hdr->dict ||
+        hdr->dict + (size_t)hdr->nnames * sizeof(uint32_t) > hdr->data ||
+        (size_t)hdr->data + hdr->data_len > len)
+        return ERR_DB_FILE;
+
+    v->hdr = hdr;
+    v->index = (const pack_entry_t *)(base + PACK_INDEX);
+    v->names = (const uint32_t *)(base + hdr->dict);
+    v->dict = (const uint8_t *)(v->names + hdr->nnames);
+    v->dict_len = (const uint8_t *)base + hdr->data - v->dict;
+    v->data = (const uint8_t *)base + hdr->data;
+    return NO_ERROR;
+}
+
+// copies a length prefixed name at p into name (size bytes with the NUL),
+// returns the byte after it or NULL past end
+static const uint8_t *get_name(const uint8_t *p, const uint8_t *end, char *name, size_t size)
+{
+    if (p >= end || p + 1 + *p > end || *p >= size)
+        return NULL;
+
+    memcpy(name, p + 1, *p);
+    name[*p] = '\0';
+    return p + 1 + *p;
+}
+
+static int pack_decode(const pack_view_t *v, const pack_entry_t *e, student_t *s)
+{
+    const uint8_t *end = v->data + v->hdr->data_len;
+    const uint8_t *p = v->data + e->offset;
+    uint16_t gpa;
+
+    if (e->offset > v->hdr->data_len || end - p < (ptrdiff_t)sizeof(gpa))
+        return ERR_DB_FILE;
+
+    memset(s, 0, sizeof(*s));
+    s->id = e->id;
+    memcpy(&gpa, p, sizeof(gpa));
+    s->gpa = gpa;
+
+    p = get_name(p + sizeof(gpa), end, s->fname, sizeof(s->fname));
+    if (p == NULL)
+        return ERR_DB_FILE;
+    if (v->hdr->nnames == 0)
+        return get_name(p, end, s->lname, sizeof(s->lname)) ? NO_ERROR : ERR_DB_FILE;
+
+    uint32_t code = 0;
+    for (int shift = 0; ; shift += 7)
+    {
+        if (p >= end || shift > 28)
+            return ERR_DB_FILE;
+        code |= (uint32_t)(*p & 0x7f) << shift;
+        if (!(*p++ & 0x80))
+            break;
+    }
+    if (code >= (uint32_t)v->hdr->nnames || v->names[code] >= v->dict_len)
+        return ERR_DB_FILE;
+
+    const uint8_t *name = v->dict + v->names[code];
+    return get_name(name, v->dict + v->dict_len, s->lname, sizeof(s->lname)) ? NO_ERROR : ERR_DB_FILE;
+}
+
+/*
+ *  pack_count
+ *      base, len:  the mapped packed file
+ *
+ *  returns:  the number of students, or ERR_DB_FILE if the file is damaged
+ */
+int pack_count(const char *base, size_t len)
+{
+    pack_view_t v;
+
+    if (pack_open(base, len, &v) != NO_ERROR)
+        return ERR_DB_FILE;
+    return v.hdr->count;
+}
+
+/*
+ *  pack_find
+ *      base, len:  the mapped packed file
+ *      id:         the student id we are looking for
+ *      *s:         where the located student is copied (may be NULL)
+ *
+ *  Binary search of the index, then the one record is decoded.
+ *
+ *  returns:  NO_ERROR, SRCH_NOT_FOUND or ERR_DB_FILE if the file is damaged
+ */
+int pack_find(const char *base, size_t len, int id, student_t *s)
+{
+    pack_view_t v;
+    student_t student;
+
+    if (pack_open(base, len, &v) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    int lo = 0;
+    int hi = v.hdr->count;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (v.index[mid].id < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == v.hdr->count || v.index[lo].id != id)
+        return SRCH_NOT_FOUND;
+
+    if (pack_decode(&v, &v.index[lo], &student) != NO_ERROR)
+        return ERR_DB_FILE;
+    if (s != NULL)
+        *s = student;
+    return NO_ERROR;
+}
+
+/*
+ *  pack_scan
+ *      base, len:  the mapped packed file
+ *      visit:      called for every student, in id order
+ *      arg:        passed through to visit
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE if the file is damaged, or what visit()
+ *            returned to stop the scan
+ */
+int pack_scan(const char *base, size_t len, int (*visit)(const student_t *, void *), void *arg)
+{
+    pack_view_t v;
+    student_t student;
+    int rc = NO_ERROR;
+
+    if (pack_open(base, len, &v) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    for (int i = 0; i < v.hdr->count && rc == NO_ERROR; i++)
+    {
+        rc = pack_decode(&v, &v.index[i], &student);
+        if (rc == NO_ERROR)
+            rc = visit(&student, arg);
+    }
+    return rc;
+}
+
+static int cmp_name_ptr(const void *a, const void *b)
+{
+    return strncmp(*(const char *const *)a, *(const char *const *)b, PACK_LNAME_MAX);
+}
+
+static int varint_len(uint32_t code)
+{
+    int n = 1;
+
+    while (code >= 0x80)
+    {
+        code >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static uint8_t *put_name(uint8_t *p, const char *name, size_t len)
+{
+    *p = (uint8_t)len;
+    memcpy(p + 1, name, len);
+    return p + 1 + len;
+}
+
+/*
+ *  pack_encode
+ *      students:  the students, sorted by id
+ *      n:         number of students
+ *      gen:       the generation for the database header
+ *      *image:    set to the packed file, free() it when done
+ *      *len:      set to its length
+ *
+ *  Builds a whole packed file in memory.  The last names are coded with a
+ *  dictionary if that makes the file smaller.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE if out of memory or the file would be
+ *            larger than 4GB
+ */
+int pack_encode(const student_t *students, int n, unsigned int gen, char **image, size_t *len)
+{
+    const char **names = malloc((n ? n : 1) * sizeof(char *));
+    if (names == NULL)
+        return ERR_DB_FILE;
+
+    // the distinct last names, and what coding them would save
+    size_t inline_len = 0;
+    for (int i = 0; i < n; i++)
+    {
+        names[i] = students[i].lname;
+        inline_len += 1 + strnlen(students[i].lname, PACK_LNAME_MAX);
+    }
+    qsort(names, n, sizeof(char *), cmp_name_ptr);
+
+    int nnames = 0;
+    size_t dict_len = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (nnames > 0 && cmp_name_ptr(&names[nnames - 1], &names[i]) == 0)
+            continue;
+        names[nnames++] = names[i];
+        dict_len += sizeof(uint32_t) + 1 + strnlen(names[i], PACK_LNAME_MAX);
+    }
+
+    size_t coded_len = dict_len;
+    for (int i = 0; i < n; i++)
+    {
+        const char *lname = students[i].lname;
+        const char **found = bsearch(&lname, names, nnames, sizeof(char *), cmp_name_ptr);
+        coded_len += varint_len(found - names);
+    }
+    if (coded_len >= inline_len)
+    {
+        nnames = 0;
+        dict_len = 0;
+    }
+
+    size_t data_len = nnames ? coded_len - dict_len : inline_len;
+    for (int i = 0; i < n; i++)
+        data_len += sizeof(uint16_t) + 1 + strnlen(students[i].fname, sizeof(students[i].fname) - 1);
+
+    size_t dict = PACK_INDEX + (size_t)n * sizeof(pack_entry_t);
+    size_t data = dict + dict_len;
+    if (data + data_len > UINT32_MAX)
+    {
+        free(names);
+        return ERR_DB_FILE;
+    }
+
+    char *buf = calloc(1, data + data_len);
+    if (buf == NULL)
+    {
+        free(names);
+        return ERR_DB_FILE;
+    }
+
+    db_header_t *db_hdr = (db_header_t *)buf;
+    db_hdr->magic = DB_MAGIC;
+    db_hdr->version = DB_VERSION;
+    db_hdr->flags = DB_FLAG_PACKED;
+    db_hdr->gen = gen;
+
+    pack_header_t *hdr = (pack_header_t *)(buf + sizeof(db_header_t));
+    hdr->count = n;
+    hdr->nnames = nnames;
+    hdr->dict = dict;
+    hdr->data = data;
+    hdr->data_len = data_len;
+
+    uint32_t *offsets = (uint32_t *)(buf + dict);
+    uint8_t *p = (uint8_t *)(offsets + nnames);
+    for (int i = 0; i < nnames; i++)
+    {
+        offsets[i] = p - (uint8_t *)(offsets + nnames);
+        p = put_name(p, names[i], strnlen(names[i], PACK_LNAME_MAX));
+    }
+
+    pack_entry_t *index = (pack_entry_t *)(buf + PACK_INDEX);
+    uint8_t *records = (uint8_t *)buf + data;
+    p = records;
+    for (int i = 0; i < n; i++)
+    {
+        const student_t *s = &students[i];
+        uint16_t gpa = s->gpa;
+
+        index[i].id = s->id;
+        index[i].offset = p - records;
+
+        memcpy(p, &gpa, sizeof(gpa));
+        p = put_name(p + sizeof(gpa), s->fname, strnlen(s->fname, sizeof(s->fname) - 1));
+        if (nnames == 0)
+        {
+            p = put_name(p, s->lname, strnlen(s->lname, PACK_LNAME_MAX));
+            continue;
+        }
+
+        const char *lname = s->lname;
+        uint32_t code = (const char **)bsearch(&lname, names, nnames, sizeof(char *), cmp_name_ptr) - names;
+        do
+        {
+            *p++ = (code & 0x7f) | ((code >= 0x80) ? 0x80 : 0);
+            code >>= 7;
+        } while (code > 0);
+    }
+
+    free(names);
+    *image = buf;
+    *len = data + data_len;
+    return NO_ERROR;
+}
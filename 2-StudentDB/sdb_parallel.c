@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// Parallel scans.  Full table operations split the slots of the file into
+// one contiguous range per thread, every thread walks its range of the
+// mapped record array on its own and the caller combines the results in
+// range order, which is id order.  The ranges start on a multiple of 64
+// slots so no two threads share a word of the occupancy bitmap or a page
+// of the file.  Files too small to keep a thread busy for long are not
+// split, see SCAN_MIN_SLOTS.
+//
+// The number of threads defaults to the number of online CPUs, setting
+// SDB_THREADS_ENV overrides it and 1 turns parallel scans off.
+#define SCAN_MIN_SLOTS      16384       //slots per thread, 1MB of records
+#define SCAN_MAX_THREADS    64
+#define SCAN_ALIGN          64          //slots, one bitmap word
+
+typedef struct scan_part {
+    pthread_t thread;
+    bool started;           //thread runs, pthread_join() it
+    int part;
+    int lo, hi;
+    int rc;
+    int (*work)(int part, int lo, int hi, void *arg);
+    void *arg;
+} scan_part_t;
+
+/*
+ *  scan_threads
+ *
+ *  returns:  the configured number of scan threads, at least 1
+ */
+int scan_threads(void)
+{
+    const char *env = getenv(SDB_THREADS_ENV);
+    long n;
+
+    if (env != NULL && *env != '\0')
+        n = atol(env);
+    else
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (n < 1)
+        n = 1;
+    if (n > SCAN_MAX_THREADS)
+        n = SCAN_MAX_THREADS;
+    return (int)n;
+}
+
+/*
+ *  scan_parts
+ *      nslots:  number of slots to scan
+ *
+ *  returns:  how many ranges a scan of nslots slots is split into, 1 means
+ *            the scan is best done by the calling thread alone
+ */
+int scan_parts(int nslots)
+{
+    int parts = nslots / SCAN_MIN_SLOTS;
+    int threads = scan_threads();
+
+    if (parts > threads)
+        parts = threads;
+    return parts < 1 ? 1 : parts;
+}
+
+static void *run_part(void *arg)
+{
+    scan_part_t *p = arg;
+
+    p->rc = p->work(p->part, p->lo, p->hi, p->arg);
+    return NULL;
+}
+
+/*
+ *  run_parts
+ *      parts:   number of ranges, from scan_parts()
+ *      first:   first slot to scan
+ *      nslots:  one past the last slot to scan
+ *      work:    called once per range, each in a thread of its own, with
+ *               the range number (0 .. parts - 1) and the slots [lo, hi)
+ *      arg:     passed through to work
+ *
+ *  Splits [first, nslots) into parts ranges and runs work() on all of them
+ *  at once.  The calling thread takes the first range itself; a range whose
+ *  thread cannot be started is run by the calling thread as well.  Returns
+ *  when every range is done.
+ *
+ *  returns:  NO_ERROR, or the first result other than NO_ERROR in range
+ *            order, ERR_DB_FILE if out of memory
+ */
+int run_parts(int parts, int first, int nslots,
+              int (*work)(int part, int lo, int hi, void *arg), void *arg)
+{
+    scan_part_t *p = calloc(parts, sizeof(scan_part_t));
+    int rc = NO_ERROR;
+
+    if (p == NULL)
+        return ERR_DB_FILE;
+
+    for (int i = 0; i < parts; i++)
+    {
+        long long lo = first + (long long)(nslots - first) * i / parts;
+
+        p[i].part = i;
+        p[i].lo = (i == 0) ? first : (int)(lo - lo % SCAN_ALIGN);
+        p[i].work = work;
+        p[i].arg = arg;
+        if (i > 0)
+            p[i - 1].hi = p[i].lo;
+    }
+    p[parts - 1].hi = nslots;
+
+    for (int i = 1; i < parts; i++)
+        p[i].started = pthread_create(&p[i].thread, NULL, run_part, &p[i]) == 0;
+
+    run_part(&p[0]);
+    for (int i = 1; i < parts; i++)
+    {
+        if (p[i].started)
+            pthread_join(p[i].thread, NULL);
+        else
+            run_part(&p[i]);
+    }
+
+    for (int i = 0; i < parts && rc == NO_ERROR; i++)
+        rc = p[i].rc;
+
+    free(p);
+    return rc;
+}
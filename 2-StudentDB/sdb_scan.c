@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// Record scan kernels.  A student_t is 64 bytes, one cache line, and the
+// scans over the record array only look at the id word at the start of
+// each record.  The SIMD kernels test the ids of several records per
+// instruction: AVX2 gathers 8 ids with one instruction, SSE2 (baseline on
+// x86-64) packs 4.  The best kernel set the CPU supports is picked the
+// first time a scan runs, other targets use the scalar kernels.  Setting
+// SDB_SCAN_ENV to "scalar" or "sse2" forces a lesser kernel set.
+
+typedef struct scan_kernels {
+    int (*count)(const student_t *rec, int n);
+    int (*find)(const student_t *rec, int n, int id);
+    int (*next)(const student_t *rec, int n);
+} scan_kernels_t;
+
+static int count_ids_scalar(const student_t *rec, int n)
+{
+    int count = 0;
+
+    for (int i = 0; i < n; i++)
+        count += rec[i].id != DELETED_STUDENT_ID;
+    return count;
+}
+
+static int find_id_scalar(const student_t *rec, int n, int id)
+{
+    for (int i = 0; i < n; i++)
+    {
+        if (rec[i].id == id)
+            return i;
+    }
+    return n;
+}
+
+static int next_used_scalar(const student_t *rec, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        if (rec[i].id != DELETED_STUDENT_ID)
+            return i;
+    }
+    return n;
+}
+
+static const scan_kernels_t scalar_kernels = {
+    count_ids_scalar, find_id_scalar, next_used_scalar
+};
+
+#ifdef SCAN_X86
+
+// ids of records i .. i + 3, one lane per record
+static inline __m128i ids_sse2(const student_t *rec, int i)
+{
+    return _mm_setr_epi32(rec[i].id, rec[i + 1].id, rec[i + 2].id, rec[i + 3].id);
+}
+
+// bit l set when lane l of ids equals key
+static inline int match_sse2(__m128i ids, __m128i key)
+{
+    return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(ids, key)));
+}
+
+static int count_ids_sse2(const student_t *rec, int n)
+{
+    __m128i zero = _mm_setzero_si128();
+    int count = 0;
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4)
+        count += 4 - __builtin_popcount(match_sse2(ids_sse2(rec, i), zero));
+    return count + count_ids_scalar(rec + i, n - i);
+}
+
+static int find_id_sse2(const student_t *rec, int n, int id)
+{
+    __m128i key = _mm_set1_epi32(id);
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        int mask = match_sse2(ids_sse2(rec, i), key);
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+    return i + find_id_scalar(rec + i, n - i, id);
+}
+
+static int next_used_sse2(const student_t *rec, int n)
+{
+    __m128i zero = _mm_setzero_si128();
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        int mask = ~match_sse2(ids_sse2(rec, i), zero) & 0xf;
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+    return i + next_used_scalar(rec + i, n - i);
+}
+
+static const scan_kernels_t sse2_kernels = {
+    count_ids_sse2, find_id_sse2, next_used_sse2
+};
+
+// ids of records i .. i + 7, gathered at a stride of one record
+__attribute__((target("avx2")))
+static inline __m256i ids_avx2(const student_t *rec, int i)
+{
+    const int stride = sizeof(student_t) / sizeof(int);
+    const __m256i index = _mm256_setr_epi32(0, stride, 2 * stride, 3 * stride,
+                                            4 * stride, 5 * stride, 6 * stride, 7 * stride);
+
+    return _mm256_i32gather_epi32(&rec[i].id, index, sizeof(int));
+}
+
+__attribute__((target("avx2")))
+static inline int match_avx2(__m256i ids, __m256i key)
+{
+    return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(ids, key)));
+}
+
+__attribute__((target("avx2")))
+static int count_ids_avx2(const student_t *rec, int n)
+{
+    __m256i zero = _mm256_setzero_si256();
+    int count = 0;
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+        count += 8 - __builtin_popcount(match_avx2(ids_avx2(rec, i), zero));
+    return count + count_ids_scalar(rec + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static int find_id_avx2(const student_t *rec, int n, int id)
+{
+    __m256i key = _mm256_set1_epi32(id);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        int mask = match_avx2(ids_avx2(rec, i), key);
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+    return i + find_id_scalar(rec + i, n - i, id);
+}
+
+__attribute__((target("avx2")))
+static int next_used_avx2(const student_t *rec, int n)
+{
+    __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        int mask = ~match_avx2(ids_avx2(rec, i), zero) & 0xff;
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+    return i + next_used_scalar(rec + i, n - i);
+}
+
+static const scan_kernels_t avx2_kernels = {
+    count_ids_avx2, find_id_avx2, next_used_avx2
+};
+
+#endif
+
+static const scan_kernels_t *kernels;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+// picks the kernel set, once, scans may run in several threads
+static void pick_kernels(void)
+{
+    const char *force = getenv(SDB_SCAN_ENV);
+
+    kernels = &scalar_kernels;
+    if (force != NULL && strcmp(force, "scalar") == 0)
+        return;
+
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    kernels = &sse2_kernels;
+    if ((force == NULL || strcmp(force, "sse2") != 0) && __builtin_cpu_supports("avx2"))
+        kernels = &avx2_kernels;
+#endif
+}
+
+static const scan_kernels_t *scan_kernels(void)
+{
+    pthread_once(&kernels_once, pick_kernels);
+    return kernels;
+}
+
+/*
+ *  scan_count_ids
+ *      rec:  start of a run of records
+ *      n:    number of records in the run
+ *
+ *  returns:  the number of records that hold a student
+ */
+int scan_count_ids(const student_t *rec, int n)
+{
+    return scan_kernels()->count(rec, n);
+}
+
+/*
+ *  scan_find_id
+ *      rec:  start of a run of records
+ *      n:    number of records in the run
+ *      id:   the student id to look for
+ *
+ *  returns:  the index of the first record with the id, n if there is none
+ */
+int scan_find_id(const student_t *rec, int n, int id)
+{
+    return scan_kernels()->find(rec, n, id);
+}
+
+/*
+ *  scan_next_used
+ *      rec:  start of a run of records
+ *      n:    number of records in the run
+ *
+ *  returns:  the index of the first record that holds a student, n if the
+ *            run is all empty slots
+ */
+int scan_next_used(const student_t *rec, int n)
+{
+    return scan_kernels()->next(rec, n);
+}
@@ -0,0 +1,396 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// set by the signal handler to ask the server loop to shut down
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+/*
+ *  send_all
+ *      sock:  connected socket
+ *      buf:   bytes to send
+ *      len:   number of bytes to send
+ *
+ *  Sends the whole buffer, looping over partial sends.  A signal that asks
+ *  the server to stop ends the send.
+ *
+ *  returns:  NO_ERROR          everything was sent
+ *            ERR_SDB_COMM      the connection failed
+ */
+int send_all(int sock, const void *buf, size_t len)
+{
+    const char *p = buf;
+
+    while (len > 0 && !stop_requested)
+    {
+        ssize_t sent = send(sock, p, len, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR && !stop_requested)
+            continue;
+        if (sent <= 0)
+            return ERR_SDB_COMM;
+        p += sent;
+        len -= sent;
+    }
+
+    return (len == 0) ? NO_ERROR : ERR_SDB_COMM;
+}
+
+/*
+ *  recv_all
+ *      sock:  connected socket
+ *      buf:   where the received bytes are stored
+ *      len:   number of bytes to receive
+ *
+ *  Receives exactly len bytes, looping over partial receives.  A signal
+ *  that asks the server to stop ends the receive.
+ *
+ *  returns:  NO_ERROR          everything was received
+ *            SRCH_NOT_FOUND    the peer closed the connection before the
+ *                              first byte, a normal end of conversation
+ *            ERR_SDB_COMM      the connection failed or closed mid message
+ */
+int recv_all(int sock, void *buf, size_t len)
+{
+    char *p = buf;
+    size_t got = 0;
+
+    while (got < len)
+    {
+        ssize_t n = recv(sock, p + got, len - got, 0);
+        if (n < 0 && errno == EINTR && !stop_requested)
+            continue;
+        if (n == 0 && got == 0)
+            return SRCH_NOT_FOUND;
+        if (n <= 0)
+            return ERR_SDB_COMM;
+        got += n;
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  send_reply
+ *      sock:      connected client socket
+ *      rc:        result code for the frame
+ *      students:  records to send with the frame (may be NULL if n is 0)
+ *      n:         number of records
+ *
+ *  Sends one reply frame: a sdb_response_t header followed by n student_t
+ *  records.  A frame with no records ends the reply.
+ *
+ *  returns:  NO_ERROR or ERR_SDB_COMM
+ */
+static int send_reply(int sock, int rc, const student_t *students, int n)
+{
+    sdb_response_t rsp = {rc, n, db_layout()};
+
+    if (send_all(sock, &rsp, sizeof(rsp)) != NO_ERROR)
+        return ERR_SDB_COMM;
+    if (n > 0 && send_all(sock, students, (size_t)n * sizeof(student_t)) != NO_ERROR)
+        return ERR_SDB_COMM;
+
+    return NO_ERROR;
+}
+
+// batches the students of a print request into frames of SDB_FRAME_RECORDS
+typedef struct reply_batch {
+    int sock;
+    int n;
+    student_t students[SDB_FRAME_RECORDS];
+} reply_batch_t;
+
+static int batch_student(const student_t *s, void *arg)
+{
+    reply_batch_t *batch = arg;
+
+    batch->students[batch->n++] = *s;
+    if (batch->n == SDB_FRAME_RECORDS)
+    {
+        if (send_reply(batch->sock, NO_ERROR, batch->students, batch->n) != NO_ERROR)
+            return ERR_SDB_COMM;
+        batch->n = 0;
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  exec_client_request
+ *      fd:    pointer to the database file descriptor, replaced when the
+ *             request truncates the database
+ *      sock:  connected client socket
+ *      req:   the request to execute
+ *
+ *  Executes one request against the open database and sends the reply.  The
+ *  last frame of every reply carries the result code: the error codes from
+ *  sdbsc.h, or the number of students for SDB_OP_COUNT.  SDB_OP_GET and
+ *  SDB_OP_PRINT send the students they found in frames before that.
+ *
+ *  returns:  NO_ERROR          the reply was sent
+ *            ERR_SDB_COMM      the reply could not be sent
+ *            ERR_DB_FILE       the database could not be reopened after a
+ *                              truncate, the server has to stop
+ */
+int exec_client_request(int *fd, int sock, const sdb_request_t *req)
+{
+    student_t student;
+    reply_batch_t *batch;
+    int rc;
+
+    // the client picks the durability of its own changes
+    set_durability(req->durability);
+
+    switch (req->op)
+    {
+    case SDB_OP_ADD:
+        if (validate_range(req->student.id, req->student.gpa) != NO_ERROR)
+            return send_reply(sock, EXIT_FAIL_ARGS, NULL, 0);
+        student = req->student;
+        student.fname[sizeof(student.fname) - 1] = '\0';
+        student.lname[sizeof(student.lname) - 1] = '\0';
+        return send_reply(sock, insert_student(*fd, &student), NULL, 0);
+
+    case SDB_OP_DEL:
+        return send_reply(sock, remove_student(*fd, req->student.id), NULL, 0);
+
+    case SDB_OP_GET:
+        rc = get_student(*fd, req->student.id, &student);
+        if (rc == NO_ERROR && send_reply(sock, NO_ERROR, &student, 1) != NO_ERROR)
+            return ERR_SDB_COMM;
+        return send_reply(sock, rc, NULL, 0);
+
+    case SDB_OP_COUNT:
+        return send_reply(sock, count_students(*fd), NULL, 0);
+
+    case SDB_OP_PRINT:
+        batch = malloc(sizeof(reply_batch_t));
+        if (batch == NULL)
+            return send_reply(sock, ERR_DB_FILE, NULL, 0);
+        batch->sock = sock;
+        batch->n = 0;
+        rc = scan_students(*fd, batch_student, batch);
+        if (rc == NO_ERROR && batch->n > 0)
+            rc = send_reply(sock, NO_ERROR, batch->students, batch->n);
+        free(batch);
+        if (rc == ERR_SDB_COMM)
+            return rc;
+        return send_reply(sock, rc, NULL, 0);
+
+    case SDB_OP_ZERO:
+        close_db(*fd);
+        *fd = open_db(db_name(), true);
+        send_reply(sock, (*fd < 0) ? ERR_DB_FILE : NO_ERROR, NULL, 0);
+        return (*fd < 0) ? ERR_DB_FILE : NO_ERROR;
+
+    default:
+        return send_reply(sock, ERR_DB_OP, NULL, 0);
+    }
+}
+
+/*
+ *  refresh_db
+ *      fd:  pointer to the database file descriptor
+ *
+ *  Reopens the database when the file was replaced underneath the server,
+ *  for example by a local "sdbsc -x" which renames a compressed copy over
+ *  the database file (see db_name).  Costs one stat() per request.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE if the database could not be reopened
+ */
+static int refresh_db(int *fd)
+{
+    struct stat cur, open_st;
+
+    if (stat(db_name(), &cur) == -1 || fstat(*fd, &open_st) == -1 ||
+        (cur.st_ino == open_st.st_ino && cur.st_dev == open_st.st_dev))
+        return NO_ERROR;
+
+    close_db(*fd);
+    *fd = open_db(db_name(), false);
+    return (*fd < 0) ? ERR_DB_FILE : NO_ERROR;
+}
+
+// a client that stalls mid request or stops reading its reply is dropped
+// after SDB_IO_TIMEOUT_MS instead of holding up the other clients
+static void set_timeouts(int sock)
+{
+    struct timeval tv = {SDB_IO_TIMEOUT_MS / 1000, SDB_IO_TIMEOUT_MS % 1000 * 1000};
+
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+/*
+ *  serve_client
+ *      fd:    pointer to the database file descriptor
+ *      sock:  a client socket poll() found readable
+ *      rc:    set to ERR_DB_FILE if the server has to stop
+ *
+ *  Receives one request of the client and executes it.
+ *
+ *  returns:  NO_ERROR to keep the connection, anything else to close it
+ */
+static int serve_client(int *fd, int sock, int *rc)
+{
+    sdb_request_t req;
+
+    if (recv_all(sock, &req, sizeof(req)) != NO_ERROR)
+        return ERR_SDB_COMM;
+
+    int exec_rc = refresh_db(fd);
+    if (exec_rc == NO_ERROR)
+        exec_rc = exec_client_request(fd, sock, &req);
+    if (exec_rc == ERR_DB_FILE)
+        *rc = ERR_DB_FILE;
+    return exec_rc;
+}
+
+/*
+ *  boot_server
+ *      path:  file system path of the unix domain socket
+ *
+ *  Creates, binds and listens on the server socket.  A stale socket file
+ *  left behind by a server that did not shut down cleanly is replaced.
+ *
+ *  returns:  the listening socket, or ERR_SDB_COMM
+ */
+int boot_server(const char *path)
+{
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return ERR_SDB_COMM;
+
+    int svr_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (svr_socket == -1)
+        return ERR_SDB_COMM;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    unlink(path);
+    if (bind(svr_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(svr_socket, SDB_LISTEN_BACKLOG) < 0)
+    {
+        close(svr_socket);
+        return ERR_SDB_COMM;
+    }
+
+    return svr_socket;
+}
+
+/*
+ *  start_server
+ *      fd:    pointer to the open database file descriptor, the server may
+ *             replace it (see exec_client_request)
+ *      path:  file system path of the unix domain socket
+ *
+ *  Runs the database server: keeps the database open and mapped and serves
+ *  requests from local clients until SIGINT or SIGTERM is received.  When
+ *  SDB_CACHE_ENV is set, that many blocks are kept in the block cache.
+ *  Up to SDB_MAX_CLIENTS connections are open at a time, each may send any
+ *  number of sdb_request_t requests.  poll() picks the next client with a
+ *  request, so an idle connection holds up no one.  The requests are still
+ *  executed one at a time: a client that stops half way through a request
+ *  or stops reading its reply for SDB_IO_TIMEOUT_MS is dropped.  Further
+ *  connections wait in the listen backlog until a client leaves.
+ *
+ *  returns:  NO_ERROR          the server was stopped by a signal
+ *            ERR_SDB_COMM      the server socket could not be created
+ *            ERR_DB_FILE       the database could not be reopened
+ *
+ *  console:  M_SERVER_STARTED  when the server is ready
+ *            M_SERVER_STOPPED  when the server shuts down
+ *            M_ERR_SERVER      the server socket could not be created
+ */
+int start_server(int *fd, const char *path)
+{
+    struct sigaction sa;
+    int rc = NO_ERROR;
+
+    int svr_socket = boot_server(path);
+    if (svr_socket < 0)
+    {
+        printf(M_ERR_SERVER, path);
+        return ERR_SDB_COMM;
+    }
+
+    // lookups of hot students are answered from memory, see sdb_cache.c
+    const char *cache = getenv(SDB_CACHE_ENV);
+    if (cache != NULL)
+        cache_init(atoi(cache));
+
+    // no SA_RESTART, so a signal interrupts poll() and ends the loop
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = request_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf(M_SERVER_STARTED, path);
+    fflush(stdout);
+
+    // slot 0 is the server socket, the clients follow
+    struct pollfd fds[1 + SDB_MAX_CLIENTS];
+    int nfds = 1;
+    fds[0].fd = svr_socket;
+
+    while (!stop_requested && rc == NO_ERROR)
+    {
+        // a full house leaves new connections in the backlog
+        fds[0].events = (nfds < 1 + SDB_MAX_CLIENTS) ? POLLIN : 0;
+        if (poll(fds, nfds, -1) < 0)
+            continue;
+
+        // a client is served one request per turn, the last slot moves
+        // into the place of one that hung up
+        for (int i = nfds - 1; i > 0 && rc == NO_ERROR; i--)
+        {
+            if (fds[i].revents != 0 && serve_client(fd, fds[i].fd, &rc) != NO_ERROR)
+            {
+                close(fds[i].fd);
+                fds[i] = fds[--nfds];
+            }
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            int cli_socket = accept(svr_socket, NULL, NULL);
+            if (cli_socket >= 0)
+            {
+                set_timeouts(cli_socket);
+                fds[nfds].fd = cli_socket;
+                fds[nfds].events = POLLIN;
+                fds[nfds].revents = 0;
+                nfds++;
+            }
+        }
+    }
+
+    for (int i = 1; i < nfds; i++)
+        close(fds[i].fd);
+    close(svr_socket);
+    unlink(path);
+    printf(M_SERVER_STOPPED);
+    return rc;
+}
@@ -0,0 +1,149 @@
+#define _GNU_SOURCE //mremap() is linux specific
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// Sidecar files hold derived data next to the database, such as the
+// occupancy bitmap or the name index.  Each one starts with a
+// sidecar_header_t and is memory mapped shared, so every process using the
+// database sees the same contents.
+//
+// A sidecar records the generation of the database header it matches:
+// changes bump the database generation before touching a record and move
+// the sidecar to the new generation once it has been updated as well (see
+// begin_update/end_update in sdbsc.c).  A sidecar left behind by a crash,
+// by an older program or by a file replaced underneath it therefore does
+// not match and is rebuilt from the database.
+
+/*
+ *  open_sidecar
+ *      sc:       the sidecar to open
+ *      dbFile:   name of the database file
+ *      suffix:   appended to dbFile to name the sidecar file
+ *      magic:    identifies the kind of sidecar
+ *      min_len:  the file is grown to at least this many bytes
+ *      create:   create the file if it does not exist, optional sidecars
+ *                are only used once they have been created
+ *
+ *  Opens and maps a sidecar file.  A new file, or one
+ *  with the wrong magic, is initialized with a generation that can never
+ *  match the database so the caller rebuilds it.
+ *
+ *  returns:  NO_ERROR       sidecar mapped
+ *            ERR_DB_FILE    the sidecar could not be opened or mapped
+ */
+int open_sidecar(sidecar_t *sc, const char *dbFile, const char *suffix,
+                 int magic, size_t min_len, bool create)
+{
+    char path[PATH_MAX];
+
+    close_sidecar(sc);
+
+    if (snprintf(path, sizeof(path), "%s%s", dbFile, suffix) >= (int)sizeof(path))
+        return ERR_DB_FILE;
+
+    sc->fd = open(path, O_RDWR | (create ? O_CREAT : 0), S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (sc->fd == -1 || grow_sidecar(sc, min_len) != NO_ERROR)
+    {
+        close_sidecar(sc);
+        return ERR_DB_FILE;
+    }
+
+    sidecar_header_t *hdr = sidecar_header(sc);
+    if (hdr->magic != magic)
+    {
+        memset(hdr, 0, sizeof(*hdr));
+        hdr->magic = magic;
+        hdr->gen = SIDECAR_STALE;
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  grow_sidecar
+ *      sc:   an open sidecar
+ *      len:  bytes the sidecar must hold
+ *
+ *  Extends the file if it is shorter than len, then remaps it to cover the
+ *  whole file.  Also used to pick up growth done by another process.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int grow_sidecar(sidecar_t *sc, size_t len)
+{
+    struct stat st;
+    void *base;
+
+    if (fstat(sc->fd, &st) == -1)
+        return ERR_DB_FILE;
+
+    if ((size_t)st.st_size < len)
+    {
+        if (ftruncate(sc->fd, len) == -1)
+            return ERR_DB_FILE;
+        st.st_size = len;
+    }
+
+    if (sc->base != NULL && sc->len == (size_t)st.st_size)
+        return NO_ERROR;
+
+    if (sc->base == NULL)
+        base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, sc->fd, 0);
+    else
+        base = mremap(sc->base, sc->len, st.st_size, MREMAP_MAYMOVE);
+
+    if (base == MAP_FAILED)
+        return ERR_DB_FILE;
+
+    sc->base = base;
+    sc->len = st.st_size;
+    return NO_ERROR;
+}
+
+/*
+ *  close_sidecar
+ *      sc:  the sidecar to close, closing a closed sidecar does nothing
+ */
+void close_sidecar(sidecar_t *sc)
+{
+    if (sc->base != NULL)
+        munmap(sc->base, sc->len);
+    if (sc->fd != -1)
+        close(sc->fd);
+
+    sc->fd = -1;
+    sc->base = NULL;
+    sc->len = 0;
+}
+
+unsigned int sidecar_gen(sidecar_t *sc)
+{
+    return __atomic_load_n(&sidecar_header(sc)->gen, __ATOMIC_ACQUIRE);
+}
+
+void set_sidecar_gen(sidecar_t *sc, unsigned int gen)
+{
+    __atomic_store_n(&sidecar_header(sc)->gen, gen, __ATOMIC_RELEASE);
+}
+
+// moves an open sidecar from generation gen - 1 to gen, a sidecar that was
+// already stale stays stale
+void advance_sidecar_gen(sidecar_t *sc, unsigned int gen)
+{
+    unsigned int expected = gen - 1;
+
+    if (sc->base != NULL)
+        __atomic_compare_exchange_n(&sidecar_header(sc)->gen, &expected, gen,
+                                    false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
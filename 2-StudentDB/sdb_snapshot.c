@@ -0,0 +1,310 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <unistd.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// Snapshot readers.  A scan of a direct-slot file (print_db, count, the
+// server's print) does not keep the file read locked while it runs.  It
+// takes a snapshot instead: with the file read locked for a moment, so no
+// change is half done, it remembers the generation of the database header
+// and the size of the file, and sets db_header_t.snapshots.  While that
+// flag is set every change copies the block of SNAP_BLOCK_SLOTS records it
+// is about to overwrite into the snapshot sidecar first, once per block and
+// snapshot generation (see snap_save).  A reader copies each block from the
+// mapped file and then looks for a saved copy made for its generation or a
+// later one: if there is one, the block changed after the snapshot was
+// taken and the saved copy is what the snapshot sees, otherwise the copy
+// read from the file is (see snap_block).  Changes therefore never wait for
+// a scan, they wait at most for a reader to take its snapshot.
+//
+// The sidecar is the sidecar header, whose gen is the generation of the
+// newest snapshot and whose count is the number of saved blocks, then a
+// directory of SNAP_MAX_SAVED snap_entry_t, then the saved blocks.  Header
+// and directory are mapped, the blocks are read and written with pread()
+// and pwrite().  Readers hold a read lock on byte SNAP_READERS of the
+// sidecar while they scan.  The first reader empties the sidecar, the last
+// one clears the flag in the database header again.
+#define SNAP_MAGIC      0x53444253      //"SDBS"
+#define SNAP_READERS    0               //read locked by every reader
+#define SNAP_MAX_SAVED  65536           //saved blocks (256MB) before changes
+                                        //wait for the readers to finish
+#define SNAP_BLOCK_SIZE (SNAP_BLOCK_SLOTS * sizeof(student_t))
+#define SNAP_DIR_OFFSET sizeof(sidecar_header_t)
+#define SNAP_DATA       (SNAP_DIR_OFFSET + SNAP_MAX_SAVED * sizeof(snap_entry_t))
+
+typedef struct snap_entry {
+    int block;              //block number, its first slot is
+                            //block * SNAP_BLOCK_SLOTS
+    unsigned int gen;       //the snapshot generation it was saved for
+} snap_entry_t;
+
+sidecar_t db_snap = {-1, NULL, 0};
+
+static snap_entry_t *snap_dir(void)
+{
+    return (snap_entry_t *)(db_snap.base + SNAP_DIR_OFFSET);
+}
+
+static int saved_count(void)
+{
+    return __atomic_load_n(&sidecar_header(&db_snap)->count, __ATOMIC_ACQUIRE);
+}
+
+static int open_snap(const char *dbFile)
+{
+    if (db_snap.base != NULL)
+        return NO_ERROR;
+    return open_sidecar(&db_snap, dbFile, DB_SNAP_SUFFIX, SNAP_MAGIC, SNAP_DATA, true);
+}
+
+// throws the saved blocks away, no reader may be using them
+static void snap_reset(void)
+{
+    __atomic_store_n(&sidecar_header(&db_snap)->count, 0, __ATOMIC_RELEASE);
+    ftruncate(db_snap.fd, SNAP_DATA);
+}
+
+// the last reader is gone: changes stop saving blocks
+static void snap_off(int fd)
+{
+    int off = 0;
+
+    pwrite(fd, &off, sizeof(off), offsetof(db_header_t, snapshots));
+    snap_reset();
+}
+
+/*
+ *  snap_begin
+ *      dbFile:  name of the database file, the sidecar is dbFile with
+ *               DB_SNAP_SUFFIX appended
+ *      fd:      linux file descriptor of the database file, read locked as a
+ *               whole by the caller
+ *      snap:    the snapshot, rec, first, nslots and gen filled in by the
+ *               caller
+ *
+ *  Registers the snapshot, from now on changes save what they overwrite
+ *  until snap_end().  The caller may then release its lock.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE, the caller then scans with the file
+ *            locked instead
+ */
+int snap_begin(const char *dbFile, int fd, snapshot_t *snap)
+{
+    const db_header_t *hdr = (const db_header_t *)snap->rec;
+
+    if (open_snap(dbFile) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    // the first reader throws away the blocks saved for earlier ones
+    int rc = lock_byte(db_snap.fd, F_WRLCK, SNAP_READERS, false);
+    if (rc == NO_ERROR)
+    {
+        snap_reset();
+        rc = lock_byte(db_snap.fd, F_RDLCK, SNAP_READERS, false);
+    }
+    else if (rc == ERR_DB_OP)
+    {
+        rc = lock_byte(db_snap.fd, F_RDLCK, SNAP_READERS, true);
+    }
+    if (rc != NO_ERROR)
+        return ERR_DB_FILE;
+
+    set_sidecar_gen(&db_snap, snap->gen);
+
+    int on = 1;
+    if (__atomic_load_n(&hdr->snapshots, __ATOMIC_ACQUIRE) == 0 &&
+        pwrite(fd, &on, sizeof(on), offsetof(db_header_t, snapshots)) != sizeof(on))
+    {
+        lock_byte(db_snap.fd, F_UNLCK, SNAP_READERS, false);
+        return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  snap_end
+ *      fd:  linux file descriptor of the database file
+ *
+ *  Ends the snapshot taken by snap_begin().  The last reader clears
+ *  db_header_t.snapshots, under the header lock so no change is saving a
+ *  block meanwhile (see store_student).
+ */
+void snap_end(int fd)
+{
+    lock_byte(db_snap.fd, F_UNLCK, SNAP_READERS, false);
+
+    if (lock_header(fd, F_WRLCK) != NO_ERROR)
+        return;
+    if (lock_byte(db_snap.fd, F_WRLCK, SNAP_READERS, false) == NO_ERROR)
+    {
+        snap_off(fd);
+        lock_byte(db_snap.fd, F_UNLCK, SNAP_READERS, false);
+    }
+    lock_header(fd, F_UNLCK);
+}
+
+/*
+ *  snap_quiesce
+ *      dbFile:  name of the database file
+ *      fd:      linux file descriptor of the database file, write locked as
+ *               a whole by the caller
+ *
+ *  Waits for the snapshot readers to finish and clears
+ *  db_header_t.snapshots, for changes that cannot save the blocks they
+ *  touch, such as an online compaction.  No new reader can start under
+ *  the caller's lock.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int snap_quiesce(const char *dbFile, int fd)
+{
+    if (open_snap(dbFile) != NO_ERROR ||
+        lock_byte(db_snap.fd, F_WRLCK, SNAP_READERS, true) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    snap_off(fd);
+    lock_byte(db_snap.fd, F_UNLCK, SNAP_READERS, false);
+    return NO_ERROR;
+}
+
+/*
+ *  snap_save
+ *      dbFile:  name of the database file
+ *      fd:      linux file descriptor of the database file
+ *      slot:    first slot about to be written
+ *      nslots:  number of slots about to be written
+ *
+ *  Saves the blocks holding the slots for the newest snapshot, unless they
+ *  have been saved for it already.  Called by changes while
+ *  db_header_t.snapshots is set, before they write, with the header or the
+ *  whole file write locked so saving is serialized.  When the sidecar is
+ *  full the change waits for the readers to finish instead.
+ *
+ *  returns:  NO_ERROR or ERR_DB_WRITE
+ */
+int snap_save(const char *dbFile, int fd, int slot, int nslots)
+{
+    student_t rec[SNAP_BLOCK_SLOTS];
+
+    if (open_snap(dbFile) != NO_ERROR)
+        return ERR_DB_WRITE;
+
+    unsigned int gen = sidecar_gen(&db_snap);
+    snap_entry_t *dir = snap_dir();
+
+    for (int block = slot / SNAP_BLOCK_SLOTS; block <= (slot + nslots - 1) / SNAP_BLOCK_SLOTS; block++)
+    {
+        int count = saved_count();
+        int i = count;
+
+        while (i > 0 && !(dir[i - 1].block == block && dir[i - 1].gen == gen))
+            i--;
+        if (i > 0)
+            continue;
+
+        if (count == SNAP_MAX_SAVED)
+            return (snap_quiesce(dbFile, fd) == NO_ERROR) ? NO_ERROR : ERR_DB_WRITE;
+
+        // holes and the end of the file read as empty slots
+        ssize_t bytes = pread(fd, rec, SNAP_BLOCK_SIZE, (off_t)block * SNAP_BLOCK_SIZE);
+        if (bytes < 0)
+            return ERR_DB_WRITE;
+        memset((char *)rec + bytes, 0, SNAP_BLOCK_SIZE - bytes);
+
+        if (pwrite(db_snap.fd, rec, SNAP_BLOCK_SIZE,
+                   SNAP_DATA + (off_t)count * SNAP_BLOCK_SIZE) != SNAP_BLOCK_SIZE)
+            return ERR_DB_WRITE;
+
+        // the block is in place before readers can find it
+        dir[count].block = block;
+        dir[count].gen = gen;
+        __atomic_store_n(&sidecar_header(&db_snap)->count, count + 1, __ATOMIC_RELEASE);
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  snap_cursor_init
+ *      cur:   the cursor
+ *      snap:  the snapshot it reads
+ *
+ *  A cursor reads the blocks of a snapshot, every thread of a scan uses a
+ *  cursor of its own.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE if out of memory
+ */
+int snap_cursor_init(snap_cursor_t *cur, const snapshot_t *snap)
+{
+    int nblocks = (snap->nslots + SNAP_BLOCK_SLOTS - 1) / SNAP_BLOCK_SLOTS;
+
+    cur->snap = snap;
+    cur->seen = 0;
+    cur->saved = malloc((nblocks ? nblocks : 1) * sizeof(int));
+    if (cur->saved == NULL)
+        return ERR_DB_FILE;
+
+    for (int b = 0; b < nblocks; b++)
+        cur->saved[b] = -1;
+    return NO_ERROR;
+}
+
+void snap_cursor_free(snap_cursor_t *cur)
+{
+    free(cur->saved);
+    cur->saved = NULL;
+}
+
+/*
+ *  snap_block
+ *      cur:    a cursor of the snapshot
+ *      block:  block to read, it must lie in the snapshot
+ *      buf:    SNAP_BLOCK_SLOTS records
+ *
+ *  Fills buf with the block as the snapshot sees it.  The block is copied
+ *  from the mapped file first, then the directory is checked: a change
+ *  saves the block before it writes, so a change the copy may have caught
+ *  has its saved block in the directory by then.  The first block saved for
+ *  the snapshot's generation or a later one is what the block held when the
+ *  snapshot was taken.  Slots past the end of the snapshot read as empty.
+ *
+ *  returns:  buf, or NULL if a saved block could not be read
+ */
+const student_t *snap_block(snap_cursor_t *cur, int block, student_t *buf)
+{
+    const snapshot_t *snap = cur->snap;
+    int nblocks = (snap->nslots + SNAP_BLOCK_SLOTS - 1) / SNAP_BLOCK_SLOTS;
+    int lo = block * SNAP_BLOCK_SLOTS;
+    int n = snap->nslots - lo;
+
+    if (n > SNAP_BLOCK_SLOTS)
+        n = SNAP_BLOCK_SLOTS;
+    memcpy(buf, &snap->rec[lo], n * sizeof(student_t));
+    memset(&buf[n], 0, (SNAP_BLOCK_SLOTS - n) * sizeof(student_t));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    const snap_entry_t *dir = snap_dir();
+    for (int count = saved_count(); cur->seen < count; cur->seen++)
+    {
+        const snap_entry_t *e = &dir[cur->seen];
+
+        if (e->block < nblocks && cur->saved[e->block] < 0 && (int)(e->gen - snap->gen) >= 0)
+            cur->saved[e->block] = cur->seen;
+    }
+
+    int saved = cur->saved[block];
+    if (saved < 0)
+        return buf;
+
+    if (pread(db_snap.fd, buf, SNAP_BLOCK_SIZE,
+              SNAP_DATA + (off_t)saved * SNAP_BLOCK_SIZE) != SNAP_BLOCK_SIZE)
+        return NULL;
+    memset(&buf[n], 0, (SNAP_BLOCK_SLOTS - n) * sizeof(student_t));
+    return buf;
+}
@@ -0,0 +1,324 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// External merge sort of students, for sorted prints (see print_sorted in
+// sdbsc.c).  The students of a scan are collected into a buffer that fits
+// the memory budget.  Each time it is full it is sorted with qsort() and
+// written to a temporary file as a run.  At the end the runs are merged:
+// every run is read through a block of its own and a heap picks the
+// smallest student of the run heads.  A budget that cannot hold a block
+// of every run merges groups of SORT_FAN_IN(budget) runs into longer runs
+// first, appended to the same file, until the rest can be merged at once.
+// The students go to the visitor as raw student_t records, there is no
+// text in between, and a database that fits the budget is sorted in
+// memory without a temporary file.
+//
+// The budget is SORT_MEM_DEFAULT, SDB_SORT_MEM_ENV sets it in KB.  The
+// temporary file is created next to the database and unlinked at once, so
+// it goes away with the process.
+#define SORT_MEM_DEFAULT    (64 << 20)          //bytes
+#define SORT_MEM_MIN        (64 << 10)
+#define SORT_READ_BYTES     (64 << 10)          //block per run while merging
+#define SORT_FAN_IN(budget) ((int)((budget) / SORT_READ_BYTES) - 1 < 2 ? \
+                             2 : (int)((budget) / SORT_READ_BYTES) - 1)
+
+// a run being merged, with its block in memory
+typedef struct sort_cursor {
+    student_t *block;
+    int pos;                //next student in the block
+    int n;                  //students in the block
+    off_t next;             //file offset of the rest of the run
+    long left;              //students of the run not read into the block
+} sort_cursor_t;
+
+// where a merge pass writes a longer run
+typedef struct sort_writer {
+    xsort_t *xs;
+    student_t *block;
+    int n;
+    int cap;
+} sort_writer_t;
+
+/*
+ *  sort_init
+ *      xs:    the sort
+ *      cmp:   qsort() comparator of two student_t, the order of the output
+ *      path:  template for mkstemp() of the temporary file, ending in
+ *             XXXXXX
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE if out of memory
+ */
+int sort_init(xsort_t *xs, int (*cmp)(const void *, const void *), const char *path)
+{
+    const char *env = getenv(SDB_SORT_MEM_ENV);
+    size_t budget = (env != NULL && *env != '\0') ? (size_t)atol(env) << 10 : SORT_MEM_DEFAULT;
+
+    if (budget < SORT_MEM_MIN)
+        budget = SORT_MEM_MIN;
+
+    memset(xs, 0, sizeof(*xs));
+    xs->cmp = cmp;
+    xs->budget = budget;
+    xs->cap = budget / sizeof(student_t);
+    xs->fd = -1;
+    xs->path = strdup(path);
+    xs->buf = malloc((size_t)xs->cap * sizeof(student_t));
+    return (xs->path != NULL && xs->buf != NULL) ? NO_ERROR : ERR_DB_FILE;
+}
+
+void sort_free(xsort_t *xs)
+{
+    free(xs->buf);
+    free(xs->runs);
+    free(xs->path);
+    if (xs->fd >= 0)
+        close(xs->fd);
+    xs->buf = NULL;
+    xs->runs = NULL;
+    xs->path = NULL;
+    xs->fd = -1;
+}
+
+// appends len bytes to the temporary file
+static int sort_write(xsort_t *xs, const void *data, size_t len)
+{
+    if (xs->fd < 0)
+    {
+        xs->fd = mkstemp(xs->path);
+        if (xs->fd < 0)
+            return ERR_DB_FILE;
+        unlink(xs->path);
+    }
+
+    if (pwrite(xs->fd, data, len, xs->end) != (ssize_t)len)
+        return ERR_DB_FILE;
+    xs->end += len;
+    return NO_ERROR;
+}
+
+static int add_run(xsort_t *xs, off_t start, long count)
+{
+    if (xs->nruns == xs->runs_cap)
+    {
+        int cap = xs->runs_cap ? 2 * xs->runs_cap : 64;
+        sort_run_t *grown = realloc(xs->runs, cap * sizeof(sort_run_t));
+        if (grown == NULL)
+            return ERR_DB_FILE;
+        xs->runs = grown;
+        xs->runs_cap = cap;
+    }
+    xs->runs[xs->nruns].start = start;
+    xs->runs[xs->nruns].count = count;
+    xs->nruns++;
+    return NO_ERROR;
+}
+
+// sorts the buffer and writes it out as a run
+static int spill(xsort_t *xs)
+{
+    off_t start = xs->end;
+
+    qsort(xs->buf, xs->nbuf, sizeof(student_t), xs->cmp);
+    if (sort_write(xs, xs->buf, (size_t)xs->nbuf * sizeof(student_t)) != NO_ERROR ||
+        add_run(xs, start, xs->nbuf) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    xs->nbuf = 0;
+    return NO_ERROR;
+}
+
+/*
+ *  sort_add
+ *      s:    a student to sort
+ *      arg:  the xsort_t
+ *
+ *  scan_students() visitor that adds every student to the sort.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE if a run could not be written
+ */
+int sort_add(const student_t *s, void *arg)
+{
+    xsort_t *xs = arg;
+
+    if (xs->nbuf == xs->cap && spill(xs) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    xs->buf[xs->nbuf++] = *s;
+    return NO_ERROR;
+}
+
+static int cursor_fill(xsort_t *xs, sort_cursor_t *c, int blk)
+{
+    c->n = (c->left < blk) ? (int)c->left : blk;
+    c->pos = 0;
+    if (c->n == 0)
+        return NO_ERROR;
+
+    size_t len = (size_t)c->n * sizeof(student_t);
+    if (pread(xs->fd, c->block, len, c->next) != (ssize_t)len)
+        return ERR_DB_FILE;
+    c->next += len;
+    c->left -= c->n;
+    return NO_ERROR;
+}
+
+// heap of cursor numbers, the cursor with the smallest head on top
+static bool cursor_less(xsort_t *xs, sort_cursor_t *c, int a, int b)
+{
+    return xs->cmp(&c[a].block[c[a].pos], &c[b].block[c[b].pos]) < 0;
+}
+
+static void heap_down(xsort_t *xs, sort_cursor_t *c, int *heap, int n, int i)
+{
+    for (;;)
+    {
+        int least = i;
+        int l = 2 * i + 1;
+        int r = l + 1;
+
+        if (l < n && cursor_less(xs, c, heap[l], heap[least]))
+            least = l;
+        if (r < n && cursor_less(xs, c, heap[r], heap[least]))
+            least = r;
+        if (least == i)
+            return;
+
+        int tmp = heap[i];
+        heap[i] = heap[least];
+        heap[least] = tmp;
+        i = least;
+    }
+}
+
+// merges runs[0, k) in order into visit(), within the budget
+static int merge_runs(xsort_t *xs, const sort_run_t *runs, int k,
+                      int (*visit)(const student_t *, void *), void *arg, int blk)
+{
+    sort_cursor_t *c = calloc(k, sizeof(sort_cursor_t));
+    int *heap = malloc(k * sizeof(int));
+    student_t *blocks = malloc((size_t)k * blk * sizeof(student_t));
+    int rc = (c && heap && blocks) ? NO_ERROR : ERR_DB_FILE;
+    int n = 0;
+
+    for (int i = 0; i < k && rc == NO_ERROR; i++)
+    {
+        c[i].block = &blocks[(size_t)i * blk];
+        c[i].next = runs[i].start;
+        c[i].left = runs[i].count;
+        rc = cursor_fill(xs, &c[i], blk);
+        if (c[i].n > 0)
+            heap[n++] = i;
+    }
+    for (int i = n / 2 - 1; i >= 0 && rc == NO_ERROR; i--)
+        heap_down(xs, c, heap, n, i);
+
+    while (n > 0 && rc == NO_ERROR)
+    {
+        sort_cursor_t *top = &c[heap[0]];
+
+        rc = visit(&top->block[top->pos++], arg);
+        if (rc == NO_ERROR && top->pos == top->n)
+            rc = cursor_fill(xs, top, blk);
+        if (top->n == 0)
+            heap[0] = heap[--n];
+        heap_down(xs, c, heap, n, 0);
+    }
+
+    free(blocks);
+    free(heap);
+    free(c);
+    return rc;
+}
+
+static int writer_flush(sort_writer_t *w)
+{
+    int rc = sort_write(w->xs, w->block, (size_t)w->n * sizeof(student_t));
+
+    w->n = 0;
+    return rc;
+}
+
+// merge_runs() visitor of a merge pass
+static int write_student(const student_t *s, void *arg)
+{
+    sort_writer_t *w = arg;
+
+    if (w->n == w->cap && writer_flush(w) != NO_ERROR)
+        return ERR_DB_FILE;
+    w->block[w->n++] = *s;
+    return NO_ERROR;
+}
+
+/*
+ *  sort_finish
+ *      xs:     the sort, with every student added
+ *      visit:  called for every student, in the order of the comparator
+ *      arg:    passed through to visit
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE if the runs could not be written or
+ *            read back, or what visit() returned to stop
+ */
+int sort_finish(xsort_t *xs, int (*visit)(const student_t *, void *), void *arg)
+{
+    int rc = NO_ERROR;
+
+    // everything fit in memory
+    if (xs->nruns == 0)
+    {
+        qsort(xs->buf, xs->nbuf, sizeof(student_t), xs->cmp);
+        for (int i = 0; i < xs->nbuf && rc == NO_ERROR; i++)
+            rc = visit(&xs->buf[i], arg);
+        return rc;
+    }
+
+    if (xs->nbuf > 0 && spill(xs) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    // the merge gets the memory of the buffer
+    free(xs->buf);
+    xs->buf = NULL;
+
+    int fan_in = SORT_FAN_IN(xs->budget);
+    int first = 0;
+    while (xs->nruns - first > fan_in && rc == NO_ERROR)
+    {
+        int k = (xs->nruns - first < fan_in) ? xs->nruns - first : fan_in;
+        int blk = xs->budget / (k + 1) / sizeof(student_t);
+        sort_writer_t w = {xs, malloc((size_t)blk * sizeof(student_t)), 0, blk};
+        off_t start = xs->end;
+        long count = 0;
+
+        for (int i = first; i < first + k; i++)
+            count += xs->runs[i].count;
+
+        // runs[] may move when the merged run is added, merge a copy
+        sort_run_t *group = malloc(k * sizeof(sort_run_t));
+        rc = (w.block && group) ? NO_ERROR : ERR_DB_FILE;
+        if (rc == NO_ERROR)
+        {
+            memcpy(group, &xs->runs[first], k * sizeof(sort_run_t));
+            rc = merge_runs(xs, group, k, write_student, &w, blk);
+        }
+        if (rc == NO_ERROR)
+            rc = writer_flush(&w);
+        if (rc == NO_ERROR)
+            rc = add_run(xs, start, count);
+        free(group);
+        free(w.block);
+        first += k;
+    }
+
+    if (rc == NO_ERROR)
+    {
+        int k = xs->nruns - first;
+        rc = merge_runs(xs, &xs->runs[first], k, visit, arg, xs->budget / k / sizeof(student_t));
+    }
+    return rc;
+}
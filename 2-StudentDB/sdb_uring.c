@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// Batched positioned reads.  A multi-get (see get_students() in sdbsc.c)
+// knows every slot it needs before it reads any of them, so instead of one
+// pread() after the other it hands all the reads to the kernel at once
+// through an io_uring and waits for the whole batch.  On cold storage the
+// device works on the reads in parallel and the batch costs about one read
+// instead of one per student.  There is no liburing here, the ring is set
+// up with the raw system calls.  Kernels without io_uring, or with it
+// turned off, get the same results from a loop of pread() calls, as does
+// setting SDB_IO_ENV to "pread".
+//
+// The ring is set up the first time a batch is read and kept for the life
+// of the process, the server reads every batch through the same ring.
+typedef struct uring {
+    int fd;                 //-1 until set up
+    unsigned int entries;
+    unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+} uring_t;
+
+static uring_t db_ring = {-1, 0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+static int ring_state = 0;  //0 not tried yet, 1 usable, -1 reads use pread()
+
+static int ring_setup(uring_t *ring, unsigned int entries)
+{
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0)
+        return ERR_DB_FILE;
+
+    size_t sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    size_t cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && cq_len > sq_len)
+        sq_len = cq_len;
+
+    char *sq = mmap(NULL, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd, IORING_OFF_SQ_RING);
+    char *cq = sq;
+    if (sq != MAP_FAILED && !single)
+        cq = mmap(NULL, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  fd, IORING_OFF_CQ_RING);
+    void *sqes = MAP_FAILED;
+    if (sq != MAP_FAILED && cq != MAP_FAILED)
+        sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        if (cq != MAP_FAILED && cq != sq)
+            munmap(cq, cq_len);
+        if (sq != MAP_FAILED)
+            munmap(sq, sq_len);
+        close(fd);
+        return ERR_DB_FILE;
+    }
+
+    ring->fd = fd;
+    ring->entries = p.sq_entries;
+    ring->sq_head = (unsigned int *)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned int *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned int *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    ring->sqes = sqes;
+    return NO_ERROR;
+}
+
+static bool ring_ready(void)
+{
+    if (ring_state == 0)
+    {
+        const char *io = getenv(SDB_IO_ENV);
+
+        if (io != NULL && strcmp(io, "pread") == 0)
+            ring_state = -1;
+        else
+            ring_state = (ring_setup(&db_ring, READ_BATCH_MAX) == NO_ERROR) ? 1 : -1;
+    }
+    return ring_state > 0;
+}
+
+// the reads of reqs[0..n), n no more than the ring holds
+static int ring_read(int fd, read_req_t *reqs, int n)
+{
+    uring_t *ring = &db_ring;
+    unsigned int tail = *ring->sq_tail;
+
+    for (int i = 0; i < n; i++, tail++)
+    {
+        unsigned int idx = tail & *ring->sq_mask;
+        struct io_uring_sqe *sqe = &ring->sqes[idx];
+
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = (unsigned long)reqs[i].buf;
+        sqe->len = reqs[i].len;
+        sqe->off = reqs[i].offset;
+        sqe->user_data = i;
+        ring->sq_array[idx] = idx;
+    }
+    // the entries are filled in before the kernel sees the new tail
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+    int submit = n;
+    for (int done = 0; done < n;)
+    {
+        int rc = syscall(__NR_io_uring_enter, ring->fd, submit, n - done,
+                         IORING_ENTER_GETEVENTS, NULL, 0);
+        if (rc < 0 && errno != EINTR)
+            return ERR_DB_FILE;
+        if (rc > 0)
+            submit -= rc;
+
+        unsigned int head = *ring->cq_head;
+        unsigned int ctail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != ctail; head++, done++)
+        {
+            const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            read_req_t *req = &reqs[cqe->user_data];
+
+            // a kernel without IORING_OP_READ, or a failed read, is
+            // answered by pread() so the caller sees its errno
+            req->bytes = (cqe->res >= 0) ? cqe->res
+                                         : pread(fd, req->buf, req->len, req->offset);
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  read_batch
+ *      fd:    linux file descriptor of the file to read
+ *      reqs:  the reads, bytes is set to what pread() would have returned
+ *      n:     number of reads
+ *
+ *  Reads every request, as one io_uring submission of up to READ_BATCH_MAX
+ *  reads at a time or with pread() where io_uring is not available.  The
+ *  reads may complete in any order, each one lands in its own buffer.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE if the ring failed, the bytes of the
+ *            requests are then undefined
+ */
+int read_batch(int fd, read_req_t *reqs, int n)
+{
+    if (ring_ready())
+    {
+        for (int i = 0; i < n; i += READ_BATCH_MAX)
+        {
+            int count = (n - i < READ_BATCH_MAX) ? n - i : READ_BATCH_MAX;
+
+            if (ring_read(fd, &reqs[i], count) != NO_ERROR)
+                return ERR_DB_FILE;
+        }
+        return NO_ERROR;
+    }
+
+    for (int i = 0; i < n; i++)
+        reqs[i].bytes = pread(fd, reqs[i].buf, reqs[i].len, reqs[i].offset);
+    return NO_ERROR;
+}
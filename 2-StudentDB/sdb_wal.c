@@ -0,0 +1,361 @@
+#define _GNU_SOURCE //F_OFD_SETLKW is linux specific
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+// Write-ahead log.  Every add and delete appends a wal_record_t to the log
+// before the database file is touched, so a crash that tears a record in
+// the database (or loses it from the page cache) is repaired by replaying
+// the log.  The database file itself is only synced by a checkpoint, which
+// then empties the log.  A change that fails after its record was
+// appended is taken back by appending the opposite change, replaying both
+// leaves the student as the failed change found it.  Other writers append
+// to the log meanwhile, so it cannot be cut back instead.
+//
+// Group commit: with WAL_SYNC an operation returns once its log record is
+// on disk.  Writers append without a lock (O_APPEND), then queue on the
+// commit lock.  The writer holding it syncs everything appended so far and
+// records that in the log header, so the writers queued behind it find
+// their records already synced and return without an fsync of their own.
+// Records go through a descriptor of their own because linux appends every
+// write to an O_APPEND descriptor, even a pwrite() of the header.
+// With WAL_LAZY the record is left for the next sync or checkpoint, which
+// lets bursts of registrations skip the fsync entirely.
+//
+// Locks: writers hold a shared flock() on the log from before they append
+// until their change is in the database, a checkpoint takes it exclusive so
+// it never empties the log under a change in flight.  The commit lock is an
+// open file description lock on the first byte of the log, independent of
+// the flock().
+//
+// The page cache survives a process crash, so the log only needs replaying
+// after the machine went down.  The header remembers the boot the log was
+// opened in, a log from another boot is replayed by open_wal().
+#define WAL_MAGIC       0x5344424c      //"SDBL"
+#define WAL_BOOT_ID     "/proc/sys/kernel/random/boot_id"
+
+typedef struct wal_header {
+    int magic;
+    int reserved;
+    long long synced;       //log bytes known to be on disk
+    char boot[40];          //boot id of the system that opened the log
+    char pad[8];
+} wal_header_t;
+
+typedef struct wal_record {
+    int op;                 //SDB_OP_ADD or SDB_OP_DEL
+    unsigned int check;     //checksum of op and student, catches torn records
+    student_t student;
+} wal_record_t;
+
+static int wal_fd = -1;         //header, reads and locks
+static int wal_append_fd = -1;  //O_APPEND, log records
+static int wal_durability = WAL_SYNC;
+
+// FNV-1a over the op and the student
+static unsigned int wal_checksum(const wal_record_t *r)
+{
+    const unsigned char *p = (const unsigned char *)&r->student;
+    unsigned int h = 2166136261u ^ (unsigned int)r->op;
+
+    h *= 16777619u;
+    for (size_t i = 0; i < sizeof(r->student); i++)
+    {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void read_boot_id(char *boot, size_t len)
+{
+    memset(boot, 0, len);
+
+    int fd = open(WAL_BOOT_ID, O_RDONLY);
+    if (fd == -1)
+        return;
+    if (read(fd, boot, len - 1) < 0)
+        boot[0] = '\0';
+    close(fd);
+}
+
+// rewrites the header of an empty log
+static int reset_wal(void)
+{
+    wal_header_t hdr = {0};
+
+    hdr.magic = WAL_MAGIC;
+    hdr.synced = sizeof(hdr);
+    read_boot_id(hdr.boot, sizeof(hdr.boot));
+
+    if (ftruncate(wal_fd, 0) == -1 ||
+        pwrite(wal_fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+// commit lock, see above
+static int commit_lock(int type)
+{
+    struct flock lk = {0};
+
+    lk.l_type = type;
+    lk.l_whence = SEEK_SET;
+    lk.l_start = 0;
+    lk.l_len = 1;
+
+    while (fcntl(wal_fd, F_OFD_SETLKW, &lk) == -1)
+    {
+        if (errno != EINTR)
+            return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  wal_sync
+ *      end:  log offset that has to be on disk
+ *
+ *  Group commit: syncs the log unless a sync that finished while this
+ *  writer queued for the commit lock already covered end.
+ *
+ *  returns:  NO_ERROR or ERR_DB_WRITE
+ */
+static int wal_sync(off_t end)
+{
+    long long synced;
+    int rc = NO_ERROR;
+
+    if (commit_lock(F_WRLCK) != NO_ERROR)
+        return ERR_DB_WRITE;
+
+    if (pread(wal_fd, &synced, sizeof(synced), offsetof(wal_header_t, synced)) != sizeof(synced) ||
+        synced < end)
+    {
+        // everything appended so far rides along with this sync
+        off_t size = lseek(wal_fd, 0, SEEK_END);
+        synced = size;
+        if (size == -1 || fdatasync(wal_fd) == -1)
+            rc = ERR_DB_WRITE;
+        else
+            pwrite(wal_fd, &synced, sizeof(synced), offsetof(wal_header_t, synced));
+    }
+
+    commit_lock(F_UNLCK);
+    return rc;
+}
+
+/*
+ *  open_wal
+ *      dbFile:    name of the database file, the log is dbFile with
+ *                 DB_WAL_SUFFIX appended
+ *      fd:        the open database file
+ *      truncate:  the database was just truncated, discard the log
+ *
+ *  Opens (creating if needed) the log.  A log left behind by an earlier
+ *  boot is replayed into the database with replay_student(), and appended
+ *  to the change log again, and both are synced before the log is emptied.
+ *
+ *  returns:  <number>       number of records replayed
+ *            ERR_DB_FILE    the log could not be opened or replayed
+ */
+int open_wal(const char *dbFile, int fd, bool truncate)
+{
+    char path[PATH_MAX];
+    wal_header_t hdr;
+    char boot[sizeof(hdr.boot)];
+    struct stat st;
+    int replayed = 0;
+
+    close_wal();
+
+    if (snprintf(path, sizeof(path), "%s%s", dbFile, DB_WAL_SUFFIX) >= (int)sizeof(path))
+        return ERR_DB_FILE;
+
+    mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+    wal_fd = open(path, O_RDWR | O_CREAT, mode);
+    if (wal_fd == -1)
+        return ERR_DB_FILE;
+    wal_append_fd = open(path, O_WRONLY | O_APPEND);
+
+    // keep writers and checkpoints out while the log is checked
+    if (wal_append_fd == -1 || flock(wal_fd, LOCK_EX) == -1 || fstat(wal_fd, &st) == -1)
+    {
+        close_wal();
+        return ERR_DB_FILE;
+    }
+
+    read_boot_id(boot, sizeof(boot));
+
+    if (truncate || st.st_size < (off_t)sizeof(hdr) ||
+        pread(wal_fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || hdr.magic != WAL_MAGIC)
+    {
+        if (reset_wal() != NO_ERROR)
+            replayed = ERR_DB_FILE;
+    }
+    else if (memcmp(hdr.boot, boot, sizeof(boot)) != 0 || boot[0] == '\0')
+    {
+        // replay up to the first torn record, the rest never committed
+        wal_record_t r;
+        for (off_t off = sizeof(hdr);
+             pread(wal_fd, &r, sizeof(r), off) == sizeof(r) && r.check == wal_checksum(&r);
+             off += sizeof(r))
+        {
+            if (replay_student(fd, r.op, &r.student) != NO_ERROR ||
+                cdc_log(r.op, &r.student, 1) != NO_ERROR)
+            {
+                replayed = ERR_DB_FILE;
+                break;
+            }
+            replayed++;
+        }
+
+        if (replayed >= 0 && (fsync(fd) == -1 || cdc_sync() != NO_ERROR || reset_wal() != NO_ERROR))
+            replayed = ERR_DB_FILE;
+    }
+
+    flock(wal_fd, LOCK_UN);
+    if (replayed < 0)
+        close_wal();
+    return replayed;
+}
+
+void close_wal(void)
+{
+    if (wal_fd != -1)
+        close(wal_fd);
+    if (wal_append_fd != -1)
+        close(wal_append_fd);
+    wal_fd = -1;
+    wal_append_fd = -1;
+}
+
+/*
+ *  wal_begin / wal_log / wal_end
+ *      op:  SDB_OP_ADD or SDB_OP_DEL
+ *      s:   the student added, or the student deleted
+ *      fd:  the open database file
+ *
+ *  Bracket a change to the database: wal_begin() before the change is
+ *  checked, wal_log() once it is known to go ahead and before the database
+ *  is written, wal_end() after the database was written or the change was
+ *  abandoned.  wal_log() syncs the record according to the durability of
+ *  the operation, see set_durability().  wal_end() checkpoints when the log
+ *  grew past WAL_CHECKPOINT_BYTES.  When the change fails after wal_log(),
+ *  the caller logs the opposite change (a delete of the student it tried
+ *  to add, an add of the one it tried to delete) before wal_end(), as
+ *  wal_log() does itself when the sync fails.  Without an open log these
+ *  do nothing.
+ *
+ *  returns:  wal_log() returns NO_ERROR or ERR_DB_WRITE
+ */
+void wal_begin(void)
+{
+    if (wal_fd != -1)
+        flock(wal_fd, LOCK_SH);
+}
+
+int wal_log(int op, const student_t *s)
+{
+    wal_record_t r;
+
+    if (wal_fd == -1)
+        return NO_ERROR;
+
+    r.op = op;
+    r.student = *s;
+    r.check = wal_checksum(&r);
+
+    if (write(wal_append_fd, &r, sizeof(r)) != sizeof(r))
+        return ERR_DB_WRITE;
+
+    if (wal_durability == WAL_SYNC && wal_sync(lseek(wal_append_fd, 0, SEEK_CUR)) != NO_ERROR)
+    {
+        // the caller gives the change up, a later sync must not keep it
+        r.op = (op == SDB_OP_ADD) ? SDB_OP_DEL : SDB_OP_ADD;
+        r.check = wal_checksum(&r);
+        write(wal_append_fd, &r, sizeof(r));
+        return ERR_DB_WRITE;
+    }
+    return NO_ERROR;
+}
+
+void wal_end(int fd)
+{
+    struct stat st;
+
+    if (wal_fd == -1)
+        return;
+
+    if (fstat(wal_fd, &st) == 0 && st.st_size > WAL_CHECKPOINT_BYTES)
+        wal_checkpoint(fd, false);
+
+    flock(wal_fd, LOCK_UN);
+}
+
+/*
+ *  wal_checkpoint
+ *      fd:    the open database file
+ *      wait:  wait for changes in flight to finish, otherwise give up when
+ *             another process holds the log
+ *
+ *  Syncs the database file and the change log (see sdb_cdc.c), everything
+ *  in the log is then on disk twice, and empties the log.
+ *
+ *  returns:  NO_ERROR, ERR_DB_OP (busy, not waiting) or ERR_DB_WRITE
+ */
+int wal_checkpoint(int fd, bool wait)
+{
+    int rc = NO_ERROR;
+
+    if (wal_fd == -1)
+        return NO_ERROR;
+
+    if (flock(wal_fd, LOCK_EX | (wait ? 0 : LOCK_NB)) == -1)
+        return ERR_DB_OP;
+
+    if (fsync(fd) == -1 || cdc_sync() != NO_ERROR || reset_wal() != NO_ERROR)
+        rc = ERR_DB_WRITE;
+
+    flock(wal_fd, LOCK_UN);
+    return rc;
+}
+
+/*
+ *  set_durability / get_durability
+ *      durability:  WAL_SYNC or WAL_LAZY, applies to the following changes
+ */
+void set_durability(int durability)
+{
+    wal_durability = (durability == WAL_LAZY) ? WAL_LAZY : WAL_SYNC;
+}
+
+int get_durability(void)
+{
+    return wal_durability;
+}
+
+/*
+ *  parse_durability
+ *      name:  "sync" or "lazy", NULL means the default
+ *
+ *  returns:  WAL_SYNC or WAL_LAZY, WAL_SYNC for anything unknown
+ */
+int parse_durability(const char *name)
+{
+    if (name != NULL && strcmp(name, "lazy") == 0)
+        return WAL_LAZY;
+    return WAL_SYNC;
+}
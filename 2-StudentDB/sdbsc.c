@@ -1,411 +1,3227 @@
+#define _GNU_SOURCE //mremap() is linux specific
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h> //c library for system call file routines
 #include <string.h>
+#include <strings.h>
 #include <sys/stat.h>
+#include <sys/mman.h> //mmap() and friends for the mapped storage engine
 #include <unistd.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <errno.h>
+#include <sched.h>
+#include <limits.h>
 
 // database include files
 #include "db.h"
 #include "sdbsc.h"
 
+// The database file is memory mapped once by open_db() so that scans can walk
+// the student_t array in place instead of paying one read() per record.  There
+// is only ever one database open per process so a single mapping is enough.
+static db_map_t db_map = {-1, NULL, 0, 0};
+
+// open_db() remembers the name of the file for the operations that replace
+// the file or remove its sidecars later on, see db_path()
+static char db_file[PATH_MAX] = DB_FILE;
+
+// layout of the file of the server a client talks to, see wide_ids()
+static int remote_flags;
+
+static void sync_indexes(int fd);
+static int attach_store(const char *dbFile, int fd, bool should_truncate);
+static void detach_store(int fd);
+static int lock_current(int fd);
+static unsigned int db_gen(void);
+static int cmp_student_id(const void *a, const void *b);
+static void punch_block(int fd, int block);
+static void load_flags(void);
+static int compact_begin(int fd);
+static int compact_step(int fd, int *moved, bool *done);
+static int apply_step(int fd, const compact_step_t *step, const student_t *rec);
+static int compact_finish(int fd);
+static int compact_recover(const char *dbFile, int fd);
+static const char *db_path(char *path, const char *prefix, const char *suffix);
+static int count_records(int fd, const snapshot_t *snap);
+static int walk_students(int fd, int (*visit)(const student_t *, void *), void *arg);
+static int walk_range(int fd, const student_t *rec, int lo, int hi,
+                      int (*visit)(const student_t *, void *), void *arg);
+
 /*
  *  open_db
  *      dbFile:  name of the database file
  *      should_truncate:  indicates if opening the file also empties it
  *
+ *  A new (or truncated) file gets a db_header_t in slot 0 marking it as a
+ *  direct-slot file, see db.h, or as a hash file when SDB_LAYOUT_ENV is
+ *  "hash" (see sdb_hash.c, hash files open their directory first).
+ *  Existing files are left as they are, except that a file being compacted
+ *  online gets an interrupted compaction step done again (see
+ *  compact_recover).  The change log is opened if the file has followers
+ *  (see sdb_cdc.c), and told about the truncation.  The write-ahead log is opened next, and replayed
+ *  if the system went down since it was last used (see sdb_wal.c).  Files
+ *  with a header also get their sidecar indexes (the occupancy bitmap for
+ *  direct-slot files, the name index, the GPA index and the columnar
+ *  shadow if it was created) opened, and rebuilt if they do not match the
+ *  database.
+ *
  *  returns:  File descriptor on success, or ERR_DB_FILE on failure
  *
  *  console:  Does not produce any console I/O on success
  *            M_ERR_DB_OPEN on error
  *
  */
-int open_db(char *dbFile, bool should_truncate)
+int open_db(const char *dbFile, bool should_truncate)
+{
+    int fd = open_store(dbFile, should_truncate);
+
+    if (fd < 0)
+        printf(M_ERR_DB_OPEN);
+    return fd;
+}
+
+/*
+ *  open_store
+ *      dbFile:  name of the database file
+ *      should_truncate:  indicates if opening the file also empties it
+ *
+ *  Does the work of open_db() without any console output, for the library
+ *  (see libsdb.h).  The name is remembered for the operations that replace
+ *  the file later on.
+ *
+ *  returns:  File descriptor on success, or ERR_DB_FILE on failure
+ */
+int open_store(const char *dbFile, bool should_truncate)
 {
     // Set permissions: rw-rw----
     // see sys/stat.h for constants
     mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
 
     // open the file if it exists for Read and Write,
-    // create it if it does not exist
+    // create it if it does not exist.  A truncation is done under the
+    // write lock, see truncate_db()
     int flags = O_RDWR | O_CREAT;
 
-    if (should_truncate)
-        flags += O_TRUNC;
-
     // Now open file
     int fd = open(dbFile, flags, mode);
 
     if (fd == -1)
-    {
-        // Handle the error
-        printf(M_ERR_DB_OPEN);
         return ERR_DB_FILE;
-    }
 
-    return fd;
+    return attach_store(dbFile, fd, should_truncate);
 }
 
 /*
- *  get_student
- *      fd:  linux file descriptor
- *      id:  the student id we are looking forname of the
- *      *s:  a pointer where the located (if found) student data will be
- *           copied
+ *  attach_store
+ *      dbFile:  name of the database file
+ *      fd:      the database file, opened for reading and writing
+ *      should_truncate:  indicates if the file is emptied
  *
- *  returns:  NO_ERROR       student located and copied into *s
- *            ERR_DB_FILE    database file I/O issue
- *            SRCH_NOT_FOUND student was not located in the database
+ *  Maps the open file and opens its logs and sidecars, the rest of
+ *  open_store().  reopen_store() uses it for a file replaced under the
+ *  descriptor.  The descriptor is closed on failure.
  *
- *  console:  Does not produce any console I/O used by other functions
+ *  returns:  fd on success, or ERR_DB_FILE on failure
  */
-int get_student(int fd, int id, student_t *s)
+static int attach_store(const char *dbFile, int fd, bool should_truncate)
 {
-    if (lseek(fd, 0, SEEK_SET) == -1) {
-        printf(M_ERR_DB_READ);
+    if (dbFile != db_file)
+        snprintf(db_file, sizeof(db_file), "%s", dbFile);
+
+    // stamp empty files with a header, then map the file so the record
+    // array can be scanned in place
+    const char *layout = getenv(SDB_LAYOUT_ENV);
+    int db_flags = (layout != NULL && strcmp(layout, "hash") == 0) ? DB_FLAG_HASH : DB_FLAG_DIRECT;
+    struct stat st;
+    if (fstat(fd, &st) == -1 ||
+        (should_truncate && truncate_db(fd, db_flags) != NO_ERROR) ||
+        (!should_truncate && st.st_size == 0 && write_db_header(fd, db_flags) != NO_ERROR) ||
+        map_db(fd) != NO_ERROR)
+    {
+        close(fd);
         return ERR_DB_FILE;
     }
 
-    student_t student;
-    int bytes;
+    close_sidecar(&db_bitmap);
+    close_sidecar(&db_names);
+    close_sidecar(&db_gpa);
+    close_sidecar(&db_cols);
+    close_sidecar(&db_hdir);
+    close_sidecar(&db_snap);
 
-    // Read each student record one by one
-    while ((bytes = read(fd, &student, STUDENT_RECORD_SIZE)) > 0) {
-        if (bytes != STUDENT_RECORD_SIZE) {
-            printf(M_ERR_DB_READ);
-            return ERR_DB_FILE;
-        }
+    // a hash file cannot even be searched without its directory
+    if ((db_map.flags & DB_FLAG_HASH) &&
+        (open_hash(dbFile, fd, db_gen()) != NO_ERROR || map_db(fd) != NO_ERROR))
+    {
+        close_db(fd);
+        return ERR_DB_FILE;
+    }
 
-        // Check if the student ID matches the one we're looking for
-        if (student.id == id) {
-            // Copy the found student record to the provided pointer
-            *s = student;
-            return NO_ERROR;
+    // finish a compaction step cut short by a crash, then repair the file
+    // from the write-ahead log before anything reads it.  The change log is
+    // opened first so the replayed changes are logged again
+    if (((db_map.flags & DB_FLAG_COMPACTING) && compact_recover(dbFile, fd) != NO_ERROR) ||
+        open_cdc(dbFile, should_truncate) != NO_ERROR)
+    {
+        close_db(fd);
+        return ERR_DB_FILE;
+    }
+
+    int replayed = open_wal(dbFile, fd, should_truncate);
+    if (replayed < 0)
+    {
+        close_db(fd);
+        return ERR_DB_FILE;
+    }
+
+    // the indexes are optimizations, without them the file is scanned
+    if (db_map.flags & DB_FLAG_DIRECT)
+        open_bitmap(dbFile);
+    if (db_map.flags != 0)
+    {
+        open_names(dbFile);
+        open_gpa(dbFile);
+        open_columns(dbFile, false);
+    }
+
+    // a replay changed the file without the indexes
+    if (replayed > 0)
+    {
+        sidecar_t *indexes[] = {&db_bitmap, &db_names, &db_gpa, &db_cols};
+        for (size_t i = 0; i < sizeof(indexes) / sizeof(indexes[0]); i++)
+        {
+            if (indexes[i]->base != NULL)
+                set_sidecar_gen(indexes[i], SIDECAR_STALE);
         }
     }
+    sync_indexes(fd);
 
-    return SRCH_NOT_FOUND;
+    return fd;
 }
 
 /*
- *  add_student
- *      fd:     linux file descriptor
- *      id:     student id (range is defined in db.h )
- *      fname:  student first name
- *      lname:  student last name
- *      gpa:    GPA as an integer (range defined in db.h)
- *
- *  Adds a new student to the database.  After calculating the index for the
- *  student, check if there is another student already at that location.  A good
- *  way is to use something like memcmp() to ensure that the location for this
- *  student contains all zero byes indicating the space is empty.
+ *  map_db
+ *      fd:  linux file descriptor of the database file
  *
- *  returns:  NO_ERROR       student added to database
- *            ERR_DB_FILE    database file I/O issue
- *            ERR_DB_OP      database operation logically failed (aka student
- *                           already exists)
+ *  Makes sure the memory mapping of the database covers the whole file.  The
+ *  first call creates the mapping, later calls grow (or shrink) it when the
+ *  file size changed, for example after add_student() wrote a record past the
+ *  old end of file or another process extended the file.  The mapping is
+ *  MAP_SHARED so it stays coherent with records written via write().
  *
+ *  If resizing the mapping fails the old mapping is left in place, so callers
+ *  never see a dangling pointer.  An empty file has no mapping (base NULL).
  *
- *  console:  M_STD_ADDED       on success
- *            M_ERR_DB_ADD_DUP  student already exists
- *            M_ERR_DB_READ     error reading or seeking the database file
- *            M_ERR_DB_WRITE    error writing to db file (adding student)
+ *  returns:  NO_ERROR       mapping covers the file
+ *            ERR_DB_FILE    the file could not be stat'ed or mapped
  *
+ *  console:  Does not produce any console I/O
  */
-int add_student(int fd, int id, char *fname, char *lname, int gpa)
+int map_db(int fd)
 {
-    student_t mystudent = {0};
-    off_t myoffset;
+    struct stat st;
+    void *base;
 
-    // Check if the student already exists
-    student_t existing_student;
-    int rc = get_student(fd, id, &existing_student);
-    if (rc == NO_ERROR) {
-        // Student already exists
-        printf(M_ERR_DB_ADD_DUP, id);
-        return ERR_DB_OP;
-    } else if (rc != SRCH_NOT_FOUND) {
-        printf(M_ERR_DB_READ);
+    if (fstat(fd, &st) == -1)
         return ERR_DB_FILE;
-    }
 
-    // Calculate the offset for the new student record
-    myoffset = id * STUDENT_RECORD_SIZE;
+    size_t len = (size_t)st.st_size;
 
-    // Populate the student struct for writing to the database
-    mystudent.id = id;
-    mystudent.gpa = gpa;
-    strncpy(mystudent.fname, fname, sizeof(mystudent.fname) - 1);
-    mystudent.fname[sizeof(mystudent.fname) - 1] = '\0';
-    strncpy(mystudent.lname, lname, sizeof(mystudent.lname) - 1);
-    mystudent.lname[sizeof(mystudent.lname) - 1] = '\0';
+    if (db_map.fd == fd && db_map.len == len)
+    {
+        load_flags();
+        return NO_ERROR;
+    }
 
-    // Seek to the calculated offset
-    off_t lseek_result = lseek(fd, myoffset, SEEK_SET);
-    if (lseek_result < 0) {
-        printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
+    if (db_map.fd != fd)
+        unmap_db();
+
+    if (len == 0)
+    {
+        unmap_db();
+        db_map.fd = fd;
+        return NO_ERROR;
     }
 
-    // Write the student record to the database
-    ssize_t bytes_written = write(fd, &mystudent, STUDENT_RECORD_SIZE);
-    if (bytes_written != STUDENT_RECORD_SIZE) {
-        printf(M_ERR_DB_WRITE);
+    if (db_map.base == NULL)
+        base = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    else
+        base = mremap(db_map.base, db_map.len, len, MREMAP_MAYMOVE);
+
+    if (base == MAP_FAILED)
         return ERR_DB_FILE;
-    }
 
-    // If we get here, the student was added successfully
-    printf(M_STD_ADDED, id);
+    db_map.fd = fd;
+    db_map.base = base;
+    db_map.len = len;
+    load_flags();
+
     return NO_ERROR;
 }
 
 /*
- *  del_student
- *      fd:     linux file descriptor
- *      id:     student id to be deleted
+ *  load_flags
  *
- *  Removes a student to the database.  Use the get_student() function to
- *  locate the student to be deleted. If there is a student at that location
- *  write an empty student record - see EMPTY_STUDENT_RECORD from db.h at
- *  that location.
- *
- *  returns:  NO_ERROR       student deleted from database
- *            ERR_DB_FILE    database file I/O issue
- *            ERR_DB_OP      database operation logically failed (aka student
- *                           not in database)
+ *  Reads the layout flags from the header of the mapped database into
+ *  db_map.flags.  An online compaction changes the layout of a file in
+ *  place (see compact_online), so this is done whenever the mapping is
+ *  checked, not only when the file was replaced.
+ */
+static void load_flags(void)
+{
+    const db_header_t *hdr = (const db_header_t *)db_map.base;
+
+    if (hdr != NULL && db_map.len >= sizeof(db_header_t) &&
+        hdr->magic == DB_MAGIC && hdr->version == DB_VERSION)
+        db_map.flags = __atomic_load_n(&hdr->flags, __ATOMIC_ACQUIRE);
+    else
+        db_map.flags = 0;
+}
+
+/*
+ *  write_db_header
+ *      fd:     linux file descriptor of the database file
+ *      flags:  DB_FLAG_* layout flags to record in the header
  *
+ *  Writes a db_header_t into slot 0 of the database file.
  *
- *  console:  M_STD_DEL_MSG      on success
- *            M_STD_NOT_FND_MSG  student not in database, cant be deleted
- *            M_ERR_DB_READ      error reading or seeking the database file
- *            M_ERR_DB_WRITE     error writing to db file (adding student)
+ *  returns:  NO_ERROR       header written
+ *            ERR_DB_FILE    database file I/O issue
  *
+ *  console:  Does not produce any console I/O
  */
-int del_student(int fd, int id)
+int write_db_header(int fd, int flags)
 {
-    // Check if the student exists
-    student_t student;
-    int rc = get_student(fd, id, &student);
-    if (rc == SRCH_NOT_FOUND) {
-        printf(M_STD_NOT_FND_MSG, id);
-        return SRCH_NOT_FOUND;
-    } else if (rc != NO_ERROR) {
-        printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
-    }
+    db_header_t hdr = {0};
 
-    // Calculate the offset of the student record
-    int offset = lseek(fd, 0, SEEK_CUR) - STUDENT_RECORD_SIZE;
-    if (offset == -1) {
-        printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
-    }
+    hdr.magic = DB_MAGIC;
+    hdr.version = DB_VERSION;
+    hdr.flags = flags;
 
-    // Seek to the beginning of the student record
-    if (lseek(fd, offset, SEEK_SET) == -1) {
-        printf(M_ERR_DB_WRITE);
+    if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
         return ERR_DB_FILE;
-    }
 
-    // Overwrite the student record with an empty record
-    int bytes_written = write(fd, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE);
-    if (bytes_written != STUDENT_RECORD_SIZE) {
-        printf(M_ERR_DB_WRITE);
-        return ERR_DB_FILE;
-    }
+    if (db_map.fd == fd)
+        db_map.flags = flags;
 
-    // Success
-    printf(M_STD_DEL_MSG, id);
     return NO_ERROR;
 }
 
 /*
- *  count_db_records
- *      fd:     linux file descriptor
+ *  truncate_db
+ *      fd:     linux file descriptor of the database file
+ *      flags:  DB_FLAG_* layout flags of the emptied file
  *
- *  Counts the number of records in the database.  Start by reading the
- *  database at the beginning, and continue reading individual records
- *  until you it EOF.  EOF is when the read() syscall returns 0. Check
- *  if a slot is empty or previously deleted by investigating if all of
- *  the bytes in the record read are zeros - I would suggest using memory
- *  compare memcmp() for this. Create a counter variable and initialize it
- *  to zero, every time a non-zero record is read increment the counter.
+ *  Empties the database file in place with the whole file write locked, so
+ *  no reader is walking the mapping while its pages go away.  Scans of a
+ *  snapshot hold no lock and are waited for first (see snap_quiesce).  The
+ *  new header is written before the file is cut back to it, so the header
+ *  never lies past the end of the file, and it carries the next generation
+ *  so the block caches and sidecar indexes of other processes see that
+ *  the file changed.  Readers map the file again once they hold their lock
+ *  (see db_records), so they never touch the pages past the new end.
  *
- *  returns:  <number>       returns the number of records in db on success
+ *  returns:  NO_ERROR       file emptied
  *            ERR_DB_FILE    database file I/O issue
- *            ERR_DB_OP      database operation logically failed (aka student
- *                           not in database)
- *
- *
- *  console:  M_DB_RECORD_CNT  on success, to report the number of students in db
- *            M_DB_EMPTY       on success if the record count in db is zero
- *            M_ERR_DB_READ    error reading or seeking the database file
- *            M_ERR_DB_WRITE   error writing to db file (adding student)
  *
+ *  console:  Does not produce any console I/O
  */
-int count_db_records(int fd)
+int truncate_db(int fd, int flags)
 {
-    // Seek to the beginning of the file
-    if (lseek(fd, 0, SEEK_SET) == -1) {
-        printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
-    }
-
-    student_t student;
-    int count = 0;
-    int bytes;
-
-    // Read each student record one by one
-    while ((bytes = read(fd, &student, STUDENT_RECORD_SIZE)) > 0) {
-        if (bytes != STUDENT_RECORD_SIZE) {
-            printf(M_ERR_DB_READ);
-            return ERR_DB_FILE;
-        }
-        if (student.id != 0) {
-            count++;
-        }
-    }
+    db_header_t hdr = {0};
+    int rc = ERR_DB_FILE;
 
-    // Handle read errors
-    if (bytes == -1) {
-        printf(M_ERR_DB_READ);
+    if (lock_current(fd) != NO_ERROR)
         return ERR_DB_FILE;
-    }
-
-    // Print the result
-    if (count == 0) {
-        printf(M_DB_EMPTY);
-    } else {
-        printf(M_DB_RECORD_CNT, count);
-    }
 
-    return count;
+    if (map_db(fd) != NO_ERROR)
+        goto out;
+
+    // the snapshot readers would fault on the pages cut off
+    if ((db_map.flags & DB_FLAG_DIRECT) &&
+        ((const db_header_t *)db_map.base)->snapshots && snap_quiesce(db_file, fd) != NO_ERROR)
+        goto out;
+
+    hdr.magic = DB_MAGIC;
+    hdr.version = DB_VERSION;
+    hdr.flags = flags;
+    hdr.gen = (db_map.flags != 0) ? db_gen() + 1 : 0;
+
+    if (pwrite(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+        ftruncate(fd, sizeof(hdr)) == 0 && map_db(fd) == NO_ERROR)
+        rc = NO_ERROR;
+out:
+    lock_db(fd, F_UNLCK);
+    return rc;
 }
 
 /*
- *  print_db
- *      fd:     linux file descriptor
- *
- *  Prints all records in the database.  Start by reading the
- *  database at the beginning, and continue reading individual records
- *  until you it EOF.  EOF is when the read() syscall returns 0. Check
- *  if a slot is empty or previously deleted by investigating if all of
- *  the bytes in the record read are zeros - I would suggest using memory
- *  compare memcmp() for this. Be careful as the database might be empty.
- *  on the first real row encountered print the header for the required output:
+ *  unmap_db
  *
- *     printf(STUDENT_PRINT_HDR_STRING, "ID",
- *                  "FIRST NAME", "LAST_NAME", "GPA");
- *
- *  then for each valid record encountered print the required output:
- *
- *     printf(STUDENT_PRINT_FMT_STRING, student.id, student.fname,
- *                    student.lname, calculated_gpa_from_student);
- *
- *  The code above assumes you are reading student records into a local
- *  variable named student that is of type student_t. Also dont forget that
- *  the GPA in the student structure is an int, to convert it into a real
- *  gpa divide by 100.0 and store in a float variable.
- *
- *  returns:  NO_ERROR       on success
- *            ERR_DB_FILE    database file I/O issue
- *
- *
- *  console:  <see above>      on success, print table or database empty
- *            M_ERR_DB_READ    error reading or seeking the database file
+ *  Releases the memory mapping of the database file, if any.
  *
+ *  returns:  nothing, this is a void function
  */
-int print_db(int fd)
+void unmap_db(void)
 {
-    // Seek to the beginning of the file
-    if (lseek(fd, 0, SEEK_SET) == -1) {
-        printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
-    }
-
-    student_t student;
-    int bytes;
-    bool header_printed = false;
+    if (db_map.base != NULL)
+        munmap(db_map.base, db_map.len);
 
-    // Read each student record one by one
-    while ((bytes = read(fd, &student, STUDENT_RECORD_SIZE)) > 0) {
-        if (bytes != STUDENT_RECORD_SIZE) {
-            printf(M_ERR_DB_READ);
-            return ERR_DB_FILE;
-        }
-        if (student.id != 0) {
-            // Print the header if it hasn't been printed yet
-            if (!header_printed) {
-                printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
-                header_printed = true;
-            }
+    // the blocks belong to this file
+    cache_clear();
 
-            // Print the student record
-            float real_gpa = student.gpa / 100.0;
-            printf(STUDENT_PRINT_FMT_STRING, student.id, student.fname, student.lname, real_gpa);
-        }
-    }
+    db_map.fd = -1;
+    db_map.base = NULL;
+    db_map.len = 0;
+    db_map.flags = 0;
+}
 
-    // Handle read errors
-    if (bytes == -1) {
-        printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
-    }
+/*
+ *  close_db
+ *      fd:  linux file descriptor of the database file
+ *
+ *  Unmaps and closes the database file opened with open_db().
+ *
+ *  returns:  the return value of close()
+ */
+int close_db(int fd)
+{
+    detach_store(fd);
+    return close(fd);
+}
 
-    // If no valid records were found, print a message
-    if (!header_printed) {
-        printf(M_DB_EMPTY);
+// drops the mapping, logs and sidecars of the database, fd stays open
+static void detach_store(int fd)
+{
+    if (db_map.fd == fd)
+    {
+        unmap_db();
+        close_sidecar(&db_bitmap);
+        close_sidecar(&db_names);
+        close_sidecar(&db_gpa);
+        close_sidecar(&db_cols);
+        close_sidecar(&db_hdir);
+        close_sidecar(&db_snap);
+        close_wal();
+        close_cdc();
     }
-
-    return NO_ERROR;
 }
 
 /*
- *  print_student
- *      *s:   a pointer to a student_t structure that should
- *            contain a valid student to be printed
- *
- *  Start by ensuring that provided student pointer is valid.  To do this
- *  make sure it is not NULL and that s->id is not zero.  After ensuring
- *  that the student is valid, print it the exact way that is described
- *  in the print_db() function by first printing the header then the
- *  student data:
- *
- *     printf(STUDENT_PRINT_HDR_STRING, "ID",
- *                  "FIRST NAME", "LAST_NAME", "GPA");
- *
- *     printf(STUDENT_PRINT_FMT_STRING, s->id, s->fname,
- *                    student.lname, calculated_gpa_from_s);
- *
- *  Dont forget that  the GPA in the student structure is an int, to convert
- *  it into a real gpa divide by 100.0 and store in a float variable.
+ *  db_replaced
+ *      fd:  linux file descriptor of the database file
  *
- *  returns:  nothing, this is a void function
+ *  compress_db() and pack_db() rename a new file over the database while
+ *  they hold the old one write locked.  A writer that waited for its lock
+ *  meanwhile gets it on the unlinked file, where the change would be lost.
+ *  Writers check once they hold their lock, and if the file was replaced
+ *  unlock, reopen it with reopen_store() and lock again.  Costs one stat()
+ *  per change, like the check the server makes per request (refresh_db).
  *
+ *  returns:  true if the name now belongs to another file than fd
+ */
+static bool db_replaced(int fd)
+{
+    struct stat cur, open_st;
+
+    return stat(db_file, &cur) == 0 && fstat(fd, &open_st) == 0 &&
+           (cur.st_ino != open_st.st_ino || cur.st_dev != open_st.st_dev);
+}
+
+/*
+ *  reopen_store
+ *      fd:  linux file descriptor of a database file that was replaced
  *
- *  console:  <see above>      on success, print table or database empty
- *            M_ERR_STD_PRINT  if the function argument s is NULL or if
- *                             s->id is zero
+ *  Opens the file now under the database name and moves it to fd with
+ *  dup2(), so the callers of a writer keep using the descriptor they
+ *  passed in.  The mapping, logs and sidecars of the old file go, those
+ *  of the new one are opened as open_store() does.  The caller holds no
+ *  lock on fd.
  *
+ *  returns:  NO_ERROR or ERR_DB_FILE, fd is closed then
  */
-void print_student(student_t *s)
+static int reopen_store(int fd)
 {
-    printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST NAME", "GPA");
+    int cur = open(db_file, O_RDWR);
 
-    float real_gpa = s->gpa / 100.0;
+    if (cur == -1)
+        return ERR_DB_FILE;
 
-    printf(STUDENT_PRINT_FMT_STRING, s->id, s->fname, s->lname, real_gpa);
+    detach_store(fd);
+    int rc = dup2(cur, fd);
+    close(cur);
+    if (rc == -1)
+        return ERR_DB_FILE;
+    return (attach_store(db_file, fd, false) < 0) ? ERR_DB_FILE : NO_ERROR;
 }
 
 /*
- *  NOTE IMPLEMENTING THIS FUNCTION IS EXTRA CREDIT
+ *  lock_current
+ *      fd:  linux file descriptor of the database file
  *
- *  compress_db
- *      fd:     linux file descriptor
+ *  Write locks the whole file, like lock_db(), for a writer that changes
+ *  the file as a whole.  The outermost lock makes sure it is the current
+ *  database file, see db_replaced().
  *
- *  This assignment takes advantage of the way Linux handles sparse files
- *  on disk. Thus if there is a large hole between student records, Linux
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int lock_current(int fd)
+{
+    for (;;)
+    {
+        if (lock_db(fd, F_WRLCK) != NO_ERROR)
+            return ERR_DB_FILE;
+        if (lock_depth() > 1 || !db_replaced(fd))
+            return NO_ERROR;
+
+        lock_db(fd, F_UNLCK);
+        if (reopen_store(fd) != NO_ERROR)
+            return ERR_DB_FILE;
+    }
+}
+
+/*
+ *  db_path
+ *      path:    where the name is stored, PATH_MAX bytes
+ *      prefix:  put in front of the database file name
+ *      suffix:  appended to the database file name
+ *
+ *  Names a file that lives next to the open database, for example its
+ *  temporary file (TMP_DB_PREFIX) or a sidecar (DB_BITMAP_SUFFIX).
+ *
+ *  returns:  path
+ */
+static const char *db_path(char *path, const char *prefix, const char *suffix)
+{
+    const char *name = strrchr(db_file, '/');
+    int dir = (name != NULL) ? (int)(name + 1 - db_file) : 0;
+
+    snprintf(path, PATH_MAX, "%.*s%s%s%s", dir, db_file, prefix, db_file + dir, suffix);
+    return path;
+}
+
+/*
+ *  db_records
+ *      fd:      linux file descriptor of the database file
+ *      first:   set to the first slot that can hold a student, which skips
+ *               the header in slot 0 when the file has one
+ *      nslots:  set to the number of student_t slots in the file
+ *
+ *  Refreshes the mapping (and the hash directory of a hash file) and returns
+ *  a pointer to the start of the student_t array.  A trailing partial
+ *  record means the file is damaged.
+ *
+ *  returns:  pointer to slot 0 (may be NULL when *nslots is 0), or
+ *            NULL with *nslots set to -1 on a database file error
+ */
+static const student_t *db_records(int fd, int *first, int *nslots)
+{
+    if (map_db(fd) != NO_ERROR || (db_map.len % STUDENT_RECORD_SIZE) != 0 ||
+        ((db_map.flags & DB_FLAG_HASH) && hash_sync() != NO_ERROR))
+    {
+        *nslots = -1;
+        return NULL;
+    }
+
+    *first = (db_map.flags != 0) ? 1 : 0;
+    *nslots = db_map.len / STUDENT_RECORD_SIZE;
+    return (const student_t *)db_map.base;
+}
+
+/*
+ *  next_extent
+ *      fd:      linux file descriptor of the database file
+ *      nslots:  number of slots in the file, from db_records()
+ *      *start:  in: slot to start looking from, out: first slot of the
+ *               next data extent
+ *      *end:    out: one past the last slot of that extent
+ *
+ *  The database is a sparse file, so most of a large file can be holes that
+ *  would only read back as zero pages.  This uses lseek() with SEEK_DATA
+ *  and SEEK_HOLE to find the next range of the file that actually has data
+ *  so scans can jump over the holes.  Scans loop like this:
+ *
+ *      for (int i = first, end; next_extent(fd, nslots, &i, &end); )
+ *          for (; i < end; i++)
+ *              ...rec[i]...
+ *
+ *  File systems without SEEK_DATA support report the rest of the file as
+ *  one extent, which degrades to a plain scan.  In a file being compacted
+ *  online the slots between compact_end and compact_next count as a hole
+ *  as well, whatever they hold (see compact_online).
+ *
+ *  returns:  true if an extent was found, false when there is no more data
+ */
+static bool next_extent(int fd, int nslots, int *start, int *end)
+{
+    const db_header_t *hdr = (const db_header_t *)db_map.base;
+    int moved = nslots, next = nslots;
+
+    // the slots an online compaction moved students out of are a hole
+    if (db_map.flags & DB_FLAG_COMPACTING)
+    {
+        moved = hdr->compact_end;
+        next = hdr->compact_next;
+        if (*start >= moved && *start < next)
+            *start = next;
+    }
+
+    if (*start >= nslots)
+        return false;
+
+    off_t data = lseek(fd, (off_t)*start * STUDENT_RECORD_SIZE, SEEK_DATA);
+    off_t hole = -1;
+    if (data == -1)
+    {
+        if (errno == ENXIO)
+            return false;       // nothing but a hole up to end of file
+        data = (off_t)*start * STUDENT_RECORD_SIZE;
+    }
+    else
+    {
+        hole = lseek(fd, data, SEEK_HOLE);
+    }
+    if (hole == -1)
+        hole = (off_t)nslots * STUDENT_RECORD_SIZE;
+
+    // extents are block aligned, round out to whole slots
+    if (data / STUDENT_RECORD_SIZE > *start)
+        *start = data / STUDENT_RECORD_SIZE;
+    if (*start >= moved && *start < next)
+    {
+        *start = next;
+        return next_extent(fd, nslots, start, end);
+    }
+    *end = (hole + STUDENT_RECORD_SIZE - 1) / STUDENT_RECORD_SIZE;
+    if (*end > nslots)
+        *end = nslots;
+    if (*start < moved && *end > moved)
+        *end = moved;
+
+    return *start < *end;
+}
+
+/*
+ *  compact_search
+ *      rec:     the mapped record array of a compacted database
+ *      first:   first record slot
+ *      nslots:  number of slots in the file
+ *      id:      the student id we are looking for
+ *
+ *  Binary search over a compacted (DB_FLAG_COMPACT) file, whose students
+ *  are packed from slot 1 in ascending id order.
+ *
+ *  returns:  the slot of the first student whose id is >= id, or nslots if
+ *            every student has a smaller id
+ */
+static int compact_search(const student_t *rec, int first, int nslots, int id)
+{
+    int lo = first;
+    int hi = nslots;
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (rec[mid].id < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/*
+ *  shift_records
+ *      fd:      linux file descriptor of the database file
+ *      from:    first slot to move
+ *      nslots:  number of slots in the file
+ *      delta:   +1 to open a gap at slot from, -1 to close the gap before it
+ *
+ *  Moves slots from..nslots-1 of a compacted file by one slot, in chunks of
+ *  BULK_BATCH_SLOTS.  Growing works from the end of the file and shrinking
+ *  from the start so no chunk overwrites records that were not moved yet.
+ *  The caller truncates the file after shrinking.
+ *
+ *  returns:  NO_ERROR       records moved
+ *            ERR_DB_WRITE   database file I/O issue
+ */
+static int shift_records(int fd, int from, int nslots, int delta)
+{
+    student_t *chunk = malloc(BULK_BATCH_SLOTS * sizeof(student_t));
+    int rc = NO_ERROR;
+
+    if (chunk == NULL)
+        return ERR_DB_WRITE;
+
+    for (int done = 0; done < nslots - from && rc == NO_ERROR; )
+    {
+        int n = nslots - from - done;
+        if (n > BULK_BATCH_SLOTS)
+            n = BULK_BATCH_SLOTS;
+
+        int slot = (delta > 0) ? nslots - done - n : from + done;
+        size_t len = (size_t)n * STUDENT_RECORD_SIZE;
+
+        if (pread(fd, chunk, len, (off_t)slot * STUDENT_RECORD_SIZE) != (ssize_t)len ||
+            pwrite(fd, chunk, len, (off_t)(slot + delta) * STUDENT_RECORD_SIZE) != (ssize_t)len)
+            rc = ERR_DB_WRITE;
+        done += n;
+    }
+
+    free(chunk);
+    return rc;
+}
+
+/*
+ *  db_gen
+ *
+ *  returns:  the generation in the header of the mapped database, see db.h
+ */
+static unsigned int db_gen(void)
+{
+    const db_header_t *hdr = (const db_header_t *)db_map.base;
+
+    return __atomic_load_n(&hdr->gen, __ATOMIC_ACQUIRE);
+}
+
+// growable array of students, filled by collect_student()
+typedef struct student_list {
+    student_t *students;
+    int n;
+    int capacity;
+} student_list_t;
+
+/*
+ *  collect_student
+ *      *s:   student to collect
+ *      arg:  points to the student_list_t to append to
+ *
+ *  scan_students() visitor that copies every student into a list.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE if the list cannot grow
+ */
+static int collect_student(const student_t *s, void *arg)
+{
+    student_list_t *list = arg;
+
+    if (list->n == list->capacity)
+    {
+        int capacity = list->capacity ? list->capacity * 2 : 4096;
+        student_t *grown = realloc(list->students, capacity * sizeof(student_t));
+        if (grown == NULL)
+            return ERR_DB_FILE;
+        list->students = grown;
+        list->capacity = capacity;
+    }
+    list->students[list->n++] = *s;
+    return NO_ERROR;
+}
+
+/*
+ *  sync_indexes
+ *      fd:  linux file descriptor of the database file
+ *
+ *  Rebuilds every open sidecar index whose generation does not match the
+ *  database header: the occupancy bitmap from the data extents of the file,
+ *  the name and GPA indexes and the columns from a scan of all students.  An index that cannot be
+ *  rebuilt is closed and the database is used without it.  The whole file
+ *  is read locked meanwhile.
+ *
+ *  returns:  nothing, this is a void function
+ */
+static void sync_indexes(int fd)
+{
+    int first, nslots;
+
+    if (db_map.base == NULL || lock_db(fd, F_RDLCK) != NO_ERROR)
+        return;
+
+    unsigned int gen = db_gen();
+
+    if (db_bitmap.base != NULL && sidecar_gen(&db_bitmap) != gen)
+    {
+        const student_t *rec = db_records(fd, &first, &nslots);
+        if (nslots < 0)
+        {
+            close_sidecar(&db_bitmap);
+        }
+        else
+        {
+            bitmap_clear_all();
+            for (int i = first, end; next_extent(fd, nslots, &i, &end); )
+            {
+                for (; i < end; i++)
+                {
+                    if (rec[i].id == i)
+                        bitmap_set(i);
+                }
+            }
+            set_sidecar_gen(&db_bitmap, gen);
+        }
+    }
+
+    bool names_stale = db_names.base != NULL && sidecar_gen(&db_names) != gen;
+    bool gpa_stale = db_gpa.base != NULL && sidecar_gen(&db_gpa) != gen;
+    bool cols_stale = db_cols.base != NULL && sidecar_gen(&db_cols) != gen;
+
+    if (names_stale || gpa_stale || cols_stale)
+    {
+        student_list_t list = {NULL, 0, 0};
+        bool scanned = scan_students(fd, collect_student, &list) == NO_ERROR;
+
+        // the scan is in id order, which gpa_load() and columns_load() need
+        // and names_load() destroys; hash files scan in bucket order
+        if (scanned && (db_map.flags & DB_FLAG_HASH))
+            qsort(list.students, list.n, sizeof(student_t), cmp_student_id);
+
+        if (cols_stale)
+        {
+            if (scanned && columns_load(list.students, list.n) == NO_ERROR)
+            {
+                set_sidecar_gen(&db_cols, gen);
+            }
+            else
+            {
+                // a shadow too small for the students would be rebuilt on
+                // every open, drop it
+                char path[PATH_MAX];
+
+                close_sidecar(&db_cols);
+                if (scanned)
+                    unlink(db_path(path, "", DB_COLS_SUFFIX));
+            }
+        }
+        if (gpa_stale)
+        {
+            if (scanned && gpa_load(list.students, list.n) == NO_ERROR)
+                set_sidecar_gen(&db_gpa, gen);
+            else
+                close_sidecar(&db_gpa);
+        }
+        if (names_stale)
+        {
+            if (scanned && names_load(list.students, list.n) == NO_ERROR)
+                set_sidecar_gen(&db_names, gen);
+            else
+                close_sidecar(&db_names);
+        }
+        free(list.students);
+    }
+
+    lock_db(fd, F_UNLCK);
+}
+
+/*
+ *  use_bitmap
+ *      fd:  linux file descriptor of the database file
+ *
+ *  returns:  true if the occupancy bitmap is open and matches the database,
+ *            so scans and counts can use it instead of reading every slot
+ */
+static bool use_bitmap(int fd)
+{
+    return db_map.fd == fd && (db_map.flags & DB_FLAG_DIRECT) &&
+           db_map.base != NULL && db_bitmap.base != NULL &&
+           sidecar_gen(&db_bitmap) == db_gen();
+}
+
+/*
+ *  is_packed
+ *      fd:  linux file descriptor of the database file
+ *
+ *  Refreshes the mapping like db_records(), which a packed file cannot use
+ *  since it has no student_t array.
+ *
+ *  returns:  true if the file uses the packed layout, see sdb_pack.c
+ */
+static bool is_packed(int fd)
+{
+    return map_db(fd) == NO_ERROR && db_map.fd == fd && (db_map.flags & DB_FLAG_PACKED);
+}
+
+/*
+ *  records_move
+ *      fd:  linux file descriptor of the database file
+ *
+ *  returns:  true if a change can move other students' records, compacted
+ *            files shift them, hash files split buckets and an online
+ *            compaction moves them, so changes and lookups lock the whole
+ *            file instead of a slot (see sdb_lock.c)
+ */
+static bool records_move(int fd)
+{
+    return db_map.fd == fd &&
+           (db_map.flags & (DB_FLAG_COMPACT | DB_FLAG_HASH | DB_FLAG_COMPACTING));
+}
+
+/*
+ *  save_blocks
+ *      fd:      linux file descriptor of the database file
+ *      slot:    first slot about to be written
+ *      nslots:  number of slots about to be written
+ *
+ *  Saves the blocks holding the slots for the scans reading a snapshot of
+ *  a direct-slot file, if there are any (see sdb_snapshot.c).  Call with
+ *  the header or the whole file write locked, before writing.
+ *
+ *  returns:  NO_ERROR or ERR_DB_WRITE
+ */
+static int save_blocks(int fd, int slot, int nslots)
+{
+    const db_header_t *hdr = (const db_header_t *)db_map.base;
+
+    if (db_map.fd != fd || !(db_map.flags & DB_FLAG_DIRECT) || hdr == NULL ||
+        __atomic_load_n(&hdr->snapshots, __ATOMIC_ACQUIRE) == 0)
+        return NO_ERROR;
+    return snap_save(db_file, fd, slot, nslots);
+}
+
+/*
+ *  take_snapshot
+ *      fd:    linux file descriptor of the database file, read locked as a
+ *             whole by the caller
+ *      snap:  the snapshot
+ *
+ *  Takes a snapshot of a direct-slot file, so a scan can go on without the
+ *  lock while changes carry on (see sdb_snapshot.c).  Not done for other
+ *  layouts, whose changes move records, nor under an outer whole file lock
+ *  that keeps the changes out anyway.
+ *
+ *  returns:  true if the snapshot was taken, release it with snap_end()
+ */
+static bool take_snapshot(int fd, snapshot_t *snap)
+{
+    if (lock_depth() != 1)
+        return false;
+
+    snap->rec = db_records(fd, &snap->first, &snap->nslots);
+    if (snap->nslots <= 0 || db_map.fd != fd ||
+        !(db_map.flags & DB_FLAG_DIRECT) || records_move(fd))
+        return false;
+
+    snap->gen = db_gen();
+    return snap_begin(db_file, fd, snap) == NO_ERROR;
+}
+
+/*
+ *  lock_change
+ *      fd:     linux file descriptor of the database file
+ *      id:     the student looked up or changed
+ *      type:   F_RDLCK or F_WRLCK
+ *      whole:  set to true if the whole file was locked, pass it to
+ *              unlock_change()
+ *
+ *  Locks the student's slot, or the whole file where records move (see
+ *  records_move).  An online compaction can start while the slot lock is
+ *  waited for, so the layout is checked again once the slot is locked and
+ *  the lock is traded for a whole file lock if records move by then.  A
+ *  write lock also checks that the file was not replaced, see
+ *  db_replaced().
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int lock_change(int fd, int id, int type, bool *whole)
+{
+    for (;;)
+    {
+        load_flags();
+        *whole = records_move(fd);
+        if (*whole)
+        {
+            if (type == F_WRLCK)
+                return lock_current(fd);
+            return lock_db(fd, type);
+        }
+
+        if (lock_student(fd, id, type) != NO_ERROR)
+            return ERR_DB_FILE;
+
+        // a change to a file replaced meanwhile would be lost
+        if (type == F_WRLCK && db_replaced(fd))
+        {
+            lock_student(fd, id, F_UNLCK);
+            if (reopen_store(fd) != NO_ERROR)
+                return ERR_DB_FILE;
+            continue;
+        }
+
+        load_flags();
+        if (!records_move(fd))
+            return NO_ERROR;
+        lock_student(fd, id, F_UNLCK);
+    }
+}
+
+static void unlock_change(int fd, int id, bool whole)
+{
+    whole ? lock_db(fd, F_UNLCK) : lock_student(fd, id, F_UNLCK);
+}
+
+/*
+ *  begin_update / end_update
+ *      fd:   linux file descriptor of the database file
+ *      gen:  the generation returned by begin_update()
+ *
+ *  Bracket every change to the records of a file with a header.
+ *  begin_update() bumps the generation in the database header before the
+ *  record is touched, which marks the sidecar indexes stale until
+ *  end_update() confirms they have been updated to match.  A crash in
+ *  between leaves the generations apart and the indexes are rebuilt by the
+ *  next open_db().
+ *
+ *  returns:  begin_update() returns the new generation
+ */
+static unsigned int begin_update(int fd)
+{
+    if (db_map.fd != fd || db_map.flags == 0 || db_map.base == NULL)
+        return 0;
+
+    unsigned int gen = db_gen() + 1;
+    pwrite(fd, &gen, sizeof(gen), offsetof(db_header_t, gen));
+    return gen;
+}
+
+static void end_update(unsigned int gen)
+{
+    if (gen != 0)
+    {
+        advance_sidecar_gen(&db_bitmap, gen);
+        advance_sidecar_gen(&db_names, gen);
+        advance_sidecar_gen(&db_gpa, gen);
+        advance_sidecar_gen(&db_cols, gen);
+        advance_sidecar_gen(&db_hdir, gen);
+    }
+}
+
+/*
+ *  begin_slot_update
+ *      fd:    linux file descriptor of a direct-slot file, the slot is
+ *             write locked by the caller
+ *      slot:  the slot about to be written
+ *      gen:   set to the generation returned by begin_update()
+ *
+ *  A change to a direct-slot file writes its record under the slot lock
+ *  only, so writers of other slots do not queue behind it.  The header
+ *  lock is taken twice, briefly: here to save the block for the snapshot
+ *  readers and bump the generation, and again after the record write for
+ *  the sidecar updates and end_update().  Writers that finish out of order
+ *  leave the sidecars stale (see advance_sidecar_gen) until sync_indexes()
+ *  rebuilds them.
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE or ERR_DB_WRITE
+ */
+static int begin_slot_update(int fd, int slot, unsigned int *gen)
+{
+    if (lock_header(fd, F_WRLCK) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    int rc = save_blocks(fd, slot, 1);
+    if (rc == NO_ERROR)
+        *gen = begin_update(fd);
+    lock_header(fd, F_UNLCK);
+    return rc;
+}
+
+// keep the sidecars that hold a copy of student data in step with a change,
+// call between begin_update() and end_update()
+static void index_insert(const student_t *s)
+{
+    names_insert(s);
+    gpa_insert(s);
+    columns_insert(s);
+}
+
+static void index_remove(const student_t *s)
+{
+    names_remove(s);
+    gpa_remove(s);
+    columns_remove(s);
+}
+
+/*
+ *  cached_block
+ *      fd:  linux file descriptor
+ *      id:  the student looked up
+ *
+ *  Finds the block of the student's slot in the block cache (see
+ *  sdb_cache.c), only direct-slot files keep students at a fixed slot.  A
+ *  cached block is checked against the generation in the mapped header, no
+ *  system call is made.  A block that is not cached is read with the whole
+ *  file read locked, so no change is half done while it is read.
+ *
+ *  returns:  the records of the block, NULL if the cache is off, the file
+ *            has another layout or the block could not be read
+ */
+static const student_t *cached_block(int fd, int id)
+{
+    int block = id / CACHE_BLOCK_SLOTS;
+
+    if (!cache_enabled() || db_map.fd != fd || db_map.base == NULL)
+        return NULL;
+
+    load_flags();
+    if (!(db_map.flags & DB_FLAG_DIRECT) || records_move(fd))
+        return NULL;
+
+    const student_t *rec = cache_find(block, db_gen());
+    if (rec != NULL)
+        return rec;
+
+    if (lock_db(fd, F_RDLCK) != NO_ERROR)
+        return NULL;
+    if (map_db(fd) == NO_ERROR && (db_map.flags & DB_FLAG_DIRECT) && !records_move(fd))
+        rec = cache_fill(fd, block, db_gen());
+    lock_db(fd, F_UNLCK);
+    return rec;
+}
+
+/*
+ *  get_student
+ *      fd:  linux file descriptor
+ *      id:  the student id we are looking forname of the
+ *      *s:  a pointer where the located (if found) student data will be
+ *           copied
+ *
+ *  Read locks the student's slot (the whole file for compacted and hash
+ *  files) for the lookup, see sdb_lock.c.  With the block cache on, a
+ *  student of a direct-slot file is looked up in its cached block instead,
+ *  see cached_block().
+ *
+ *  returns:  NO_ERROR       student located and copied into *s
+ *            ERR_DB_FILE    database file I/O issue
+ *            SRCH_NOT_FOUND student was not located in the database
+ *
+ *  console:  Does not produce any console I/O used by other functions
+ */
+int get_student(int fd, int id, student_t *s)
+{
+    const student_t *rec = (id >= MIN_STD_ID) ? cached_block(fd, id) : NULL;
+
+    if (rec != NULL)
+    {
+        rec += id % CACHE_BLOCK_SLOTS;
+        if (rec->id != id)
+            return SRCH_NOT_FOUND;
+        if (s != NULL)
+            *s = *rec;
+        return NO_ERROR;
+    }
+
+    // records may move under a lookup by slot
+    bool whole;
+
+    if (lock_change(fd, id, F_RDLCK, &whole) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    int rc = locate_student(fd, id, s, NULL);
+
+    unlock_change(fd, id, whole);
+    return rc;
+}
+
+/*
+ *  get_students
+ *      fd:   linux file descriptor
+ *      ids:  the students to look up
+ *      n:    number of ids
+ *      s:    n students, s[i] is where the student ids[i] is copied
+ *      rcs:  n return codes, rcs[i] is what get_student() would return for
+ *            ids[i]
+ *
+ *  Multi-get: looks up all the students under one read lock of the whole
+ *  file.  In a direct-slot file every student can only live in its slot,
+ *  so the slots are read as one batch (see read_batch() in sdb_uring.c)
+ *  instead of one pread() after the other.  Other layouts look up each
+ *  student with locate_student().
+ *
+ *  returns:  <number>       the number of students found
+ *            ERR_DB_FILE    database file I/O issue, rcs is undefined
+ *
+ *  console:  Does not produce any console I/O
+ */
+int get_students(int fd, const int *ids, int n, student_t *s, int *rcs)
+{
+    if (lock_db(fd, F_RDLCK) != NO_ERROR)
+        return ERR_DB_FILE;
+    load_flags();
+
+    int found = 0;
+    if (db_map.fd == fd && (db_map.flags & DB_FLAG_DIRECT) && !records_move(fd))
+    {
+        read_req_t *reqs = malloc((n ? n : 1) * sizeof(read_req_t));
+        int nreqs = 0;
+
+        if (reqs == NULL)
+        {
+            lock_db(fd, F_UNLCK);
+            return ERR_DB_FILE;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            if (ids[i] < MIN_STD_ID)
+                continue;
+            reqs[nreqs].buf = &s[i];
+            reqs[nreqs].len = STUDENT_RECORD_SIZE;
+            reqs[nreqs].offset = (off_t)ids[i] * STUDENT_RECORD_SIZE;
+            nreqs++;
+        }
+
+        if (read_batch(fd, reqs, nreqs) != NO_ERROR)
+            found = ERR_DB_FILE;
+        for (int i = 0, r = 0; i < n && found >= 0; i++)
+        {
+            // a short read means the slot lies past the end of the file
+            if (ids[i] < MIN_STD_ID)
+                rcs[i] = SRCH_NOT_FOUND;
+            else if (reqs[r++].bytes < 0)
+                rcs[i] = ERR_DB_FILE;
+            else if (reqs[r - 1].bytes != STUDENT_RECORD_SIZE || s[i].id != ids[i])
+                rcs[i] = SRCH_NOT_FOUND;
+            else
+                rcs[i] = NO_ERROR;
+            found += rcs[i] == NO_ERROR;
+        }
+        free(reqs);
+    }
+    else
+    {
+        for (int i = 0; i < n; i++)
+        {
+            rcs[i] = locate_student(fd, ids[i], &s[i], NULL);
+            found += rcs[i] == NO_ERROR;
+        }
+    }
+
+    lock_db(fd, F_UNLCK);
+    return found;
+}
+
+/*
+ *  locate_student
+ *      fd:      linux file descriptor
+ *      id:      the student id we are looking for
+ *      *s:      where the located student is copied (may be NULL)
+ *      *offset: where the file offset of the located record is stored
+ *               (may be NULL)
+ *
+ *  This is the worker behind get_student() and is used by del_student()
+ *  which also needs to know where the record lives in the file.  In a
+ *  direct-slot file (DB_FLAG_DIRECT in the header) the record can only live
+ *  at id * STUDENT_RECORD_SIZE, so a single positioned read answers the
+ *  query.  Hash files (DB_FLAG_HASH) read the one bucket page the hash
+ *  directory points at, see sdb_hash.c.  Packed files (DB_FLAG_PACKED) binary
+ *  search their id index, see sdb_pack.c.  Compacted files (DB_FLAG_COMPACT)
+ *  are searched with a binary search, as are the students an online
+ *  compaction already packed (DB_FLAG_COMPACTING).  Files without a header
+ *  are searched by running the scan kernel (see sdb_scan.c) over the data
+ *  extents of the mapped student_t array.
+ *
+ *  returns:  NO_ERROR       student located
+ *            ERR_DB_FILE    database file I/O issue
+ *            SRCH_NOT_FOUND student was not located in the database
+ *
+ *  console:  Does not produce any console I/O
+ */
+int locate_student(int fd, int id, student_t *s, off_t *offset)
+{
+    if (id < MIN_STD_ID)
+        return SRCH_NOT_FOUND;
+
+    if (db_map.fd == fd && (db_map.flags & DB_FLAG_DIRECT))
+    {
+        student_t student;
+        off_t myoffset = (off_t)id * STUDENT_RECORD_SIZE;
+
+        // a short read means the slot lies past the end of the file
+        ssize_t bytes = pread(fd, &student, STUDENT_RECORD_SIZE, myoffset);
+        if (bytes < 0)
+            return ERR_DB_FILE;
+        if (bytes != STUDENT_RECORD_SIZE || student.id != id)
+            return SRCH_NOT_FOUND;
+
+        if (s != NULL)
+            *s = student;
+        if (offset != NULL)
+            *offset = myoffset;
+        return NO_ERROR;
+    }
+
+    if (db_map.fd == fd && (db_map.flags & DB_FLAG_HASH))
+        return hash_locate(fd, id, s, offset);
+
+    // packed records have no offset, only reads look them up
+    if (db_map.fd == fd && (db_map.flags & DB_FLAG_PACKED))
+        return pack_find(db_map.base, db_map.len, id, s);
+
+    int first, nslots;
+    const student_t *rec = db_records(fd, &first, &nslots);
+
+    if (nslots < 0)
+        return ERR_DB_FILE;
+
+    if (db_map.flags & DB_FLAG_COMPACT)
+    {
+        int i = compact_search(rec, first, nslots, id);
+        if (i == nslots || rec[i].id != id)
+            return SRCH_NOT_FOUND;
+
+        if (s != NULL)
+            *s = rec[i];
+        if (offset != NULL)
+            *offset = (off_t)i * STUDENT_RECORD_SIZE;
+        return NO_ERROR;
+    }
+
+    // students below compact_next are packed, the others still live at
+    // their own slot
+    if (db_map.flags & DB_FLAG_COMPACTING)
+    {
+        const db_header_t *hdr = (const db_header_t *)rec;
+        int i = id, end = nslots;
+
+        if (id < hdr->compact_next)
+        {
+            end = hdr->compact_end;
+            i = compact_search(rec, first, end, id);
+        }
+        if (i >= end || rec[i].id != id)
+            return SRCH_NOT_FOUND;
+
+        if (s != NULL)
+            *s = rec[i];
+        if (offset != NULL)
+            *offset = (off_t)i * STUDENT_RECORD_SIZE;
+        return NO_ERROR;
+    }
+
+    for (int i = first, end; next_extent(fd, nslots, &i, &end); i = end)
+    {
+        int found = i + scan_find_id(&rec[i], end - i, id);
+        if (found < end)
+        {
+            if (s != NULL)
+                *s = rec[found];
+            if (offset != NULL)
+                *offset = (off_t)found * STUDENT_RECORD_SIZE;
+            return NO_ERROR;
+        }
+    }
+
+    return SRCH_NOT_FOUND;
+}
+
+/*
+ *  add_student
+ *      fd:     linux file descriptor
+ *      id:     student id (range is defined in db.h )
+ *      fname:  student first name
+ *      lname:  student last name
+ *      gpa:    GPA as an integer (range defined in db.h)
+ *
+ *  Adds a new student to the database.  After calculating the index for the
+ *  student, check if there is another student already at that location.  A good
+ *  way is to use something like memcmp() to ensure that the location for this
+ *  student contains all zero byes indicating the space is empty.
+ *
+ *  returns:  NO_ERROR       student added to database
+ *            ERR_DB_FILE    database file I/O issue
+ *            ERR_DB_OP      database operation logically failed (aka student
+ *                           already exists)
+ *
+ *
+ *  console:  M_STD_ADDED       on success
+ *            M_ERR_DB_ADD_DUP  student already exists
+ *            M_ERR_DB_READ     error reading or seeking the database file
+ *            M_ERR_DB_WRITE    error writing to db file (adding student)
+ *
+ */
+int add_student(int fd, int id, char *fname, char *lname, int gpa)
+{
+    student_t mystudent = {0};
+
+    // Populate the student struct for writing to the database
+    mystudent.id = id;
+    mystudent.gpa = gpa;
+    strncpy(mystudent.fname, fname, sizeof(mystudent.fname) - 1);
+    mystudent.fname[sizeof(mystudent.fname) - 1] = '\0';
+    strncpy(mystudent.lname, lname, sizeof(mystudent.lname) - 1);
+    mystudent.lname[sizeof(mystudent.lname) - 1] = '\0';
+
+    switch (insert_student(fd, &mystudent))
+    {
+    case NO_ERROR:
+        printf(M_STD_ADDED, id);
+        return NO_ERROR;
+    case ERR_DB_OP:
+        printf(M_ERR_DB_ADD_DUP, id);
+        return ERR_DB_OP;
+    case ERR_DB_READONLY:
+        printf(M_DB_PACKED_RO);
+        return ERR_DB_OP;
+    case ERR_DB_WRITE:
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    default:
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+}
+
+/*
+ *  insert_student
+ *      fd:     linux file descriptor
+ *      *s:     the student to store, s->id selects the slot
+ *
+ *  Does the work of add_student() without any console output so it can be
+ *  shared with the server mode: checks that the student does not exist yet,
+ *  logs the change in the write-ahead log (see sdb_wal.c) and the change log
+ *  (see sdb_cdc.c), then has store_student() write it.  When that fails a
+ *  delete is logged after the add in both logs, so neither a replay nor a
+ *  follower keeps the student.
+ *  The student's slot is write locked for the whole sequence (the whole
+ *  file for compacted and hash files), see sdb_lock.c.
+ *
+ *  returns:  NO_ERROR       student added to database
+ *            ERR_DB_FILE    error reading the database file
+ *            ERR_DB_WRITE   error writing the database file or the log
+ *            ERR_DB_OP      student already exists
+ *            ERR_DB_READONLY  the file is packed, see sdb_pack.c
+ *
+ *  console:  Does not produce any console I/O
+ */
+int insert_student(int fd, const student_t *s)
+{
+    // records may move, the file is then locked as a whole
+    bool whole;
+
+    if (lock_change(fd, s->id, F_WRLCK, &whole) != NO_ERROR)
+        return ERR_DB_FILE;
+    wal_begin();
+
+    // Check if the student already exists, packed files take no changes
+    int rc = locate_student(fd, s->id, NULL, NULL);
+    if (db_map.flags & DB_FLAG_PACKED)
+        rc = ERR_DB_READONLY;
+    else if (rc == NO_ERROR)
+        rc = ERR_DB_OP;
+    else if (rc != SRCH_NOT_FOUND)
+        rc = ERR_DB_FILE;
+    else if ((rc = wal_log(SDB_OP_ADD, s)) == NO_ERROR &&
+             ((rc = cdc_log(SDB_OP_ADD, s, 1)) != NO_ERROR ||
+              (rc = store_student(fd, s)) != NO_ERROR))
+    {
+        // take the add back, neither a replay nor a follower may redo it
+        cdc_log(SDB_OP_DEL, s, 1);
+        wal_log(SDB_OP_DEL, s);
+    }
+
+    wal_end(fd);
+    unlock_change(fd, s->id, whole);
+    return rc;
+}
+
+/*
+ *  set_progress
+ *      fd:    linux file descriptor of a file being compacted online
+ *      next:  new compact_next
+ *      end:   new compact_end
+ *
+ *  returns:  NO_ERROR or ERR_DB_WRITE
+ */
+static int set_progress(int fd, int next, int end)
+{
+    int progress[2] = {next, end};
+
+    if (pwrite(fd, progress, sizeof(progress), offsetof(db_header_t, compact_next)) != sizeof(progress))
+        return ERR_DB_WRITE;
+    return NO_ERROR;
+}
+
+/*
+ *  compacting_store
+ *      fd:  linux file descriptor of a file being compacted online
+ *      *s:  the student to store
+ *
+ *  Writes the record of a file with DB_FLAG_COMPACTING, without touching
+ *  the sidecars.  A student from compact_next on goes to its own slot.  One
+ *  below it joins the packed students, the packed students after it move
+ *  up a slot like in a compacted file.  The slot they move into is free: a
+ *  student missing below compact_next means fewer packed students than
+ *  slots below compact_next.
+ *
+ *  returns:  NO_ERROR       student written
+ *            ERR_DB_FILE    error reading the database file
+ *            ERR_DB_WRITE   error writing the database file
+ */
+static int compacting_store(int fd, const student_t *s)
+{
+    int first, nslots;
+    const student_t *rec = db_records(fd, &first, &nslots);
+    if (nslots < 0)
+        return ERR_DB_FILE;
+
+    const db_header_t *hdr = (const db_header_t *)rec;
+    int next = hdr->compact_next;
+    int end = hdr->compact_end;
+    off_t myoffset = (off_t)s->id * STUDENT_RECORD_SIZE;
+
+    if (s->id < next)
+    {
+        int pos = compact_search(rec, first, end, s->id);
+        myoffset = (off_t)pos * STUDENT_RECORD_SIZE;
+
+        if (pos == end || rec[pos].id != s->id)
+        {
+            if (end >= next || shift_records(fd, pos, end, +1) != NO_ERROR ||
+                set_progress(fd, next, end + 1) != NO_ERROR)
+                return ERR_DB_WRITE;
+        }
+    }
+
+    if (pwrite(fd, s, STUDENT_RECORD_SIZE, myoffset) != STUDENT_RECORD_SIZE)
+        return ERR_DB_WRITE;
+    return NO_ERROR;
+}
+
+/*
+ *  store_student
+ *      fd:     linux file descriptor
+ *      *s:     the student to store, s->id selects the slot
+ *
+ *  Writes the record at s->id * STUDENT_RECORD_SIZE and updates the
+ *  sidecars.  In a compacted file the students after the new one move up a
+ *  slot to keep the file sorted instead, a student that is already there is
+ *  overwritten in place.  A hash file stores it in its bucket, see
+ *  hash_store(), a file being compacted online where compacting_store()
+ *  puts it.  Also used to replay the log, so storing the same
+ *  student twice is harmless.
+ *
+ *  returns:  NO_ERROR       student written
+ *            ERR_DB_FILE    error reading the database file
+ *            ERR_DB_WRITE   error writing the database file
+ */
+int store_student(int fd, const student_t *s)
+{
+    if (db_map.fd == fd && (db_map.flags & DB_FLAG_HASH))
+    {
+        bool exists = hash_locate(fd, s->id, NULL, NULL) == NO_ERROR;
+
+        unsigned int gen = begin_update(fd);
+        int rc = hash_store(fd, s);
+        if (rc != NO_ERROR)
+            return rc;
+
+        // a split grows the file
+        map_db(fd);
+        if (!exists)
+            index_insert(s);
+        end_update(gen);
+        return NO_ERROR;
+    }
+
+    if (db_map.fd == fd && (db_map.flags & DB_FLAG_COMPACTING))
+    {
+        bool exists = locate_student(fd, s->id, NULL, NULL) == NO_ERROR;
+
+        unsigned int gen = begin_update(fd);
+        int rc = compacting_store(fd, s);
+        if (rc != NO_ERROR)
+            return rc;
+
+        map_db(fd);
+        if (!exists)
+            index_insert(s);
+        end_update(gen);
+        return NO_ERROR;
+    }
+
+    if (db_map.fd == fd && (db_map.flags & DB_FLAG_COMPACT))
+    {
+        int first, nslots;
+        const student_t *rec = db_records(fd, &first, &nslots);
+        if (nslots < 0)
+            return ERR_DB_FILE;
+
+        int pos = compact_search(rec, first, nslots, s->id);
+        bool exists = pos < nslots && rec[pos].id == s->id;
+
+        unsigned int gen = begin_update(fd);
+        if ((!exists && shift_records(fd, pos, nslots, +1) != NO_ERROR) ||
+            pwrite(fd, s, STUDENT_RECORD_SIZE, (off_t)pos * STUDENT_RECORD_SIZE) != STUDENT_RECORD_SIZE)
+            return ERR_DB_WRITE;
+
+        map_db(fd);
+        if (!exists)
+            index_insert(s);
+        end_update(gen);
+        return NO_ERROR;
+    }
+
+    // Write the student record at its slot under the slot lock only, the
+    // header lock is held just for the bookkeeping around it
+    off_t myoffset = (off_t)s->id * STUDENT_RECORD_SIZE;
+    unsigned int gen;
+    int rc = begin_slot_update(fd, s->id, &gen);
+    if (rc != NO_ERROR)
+        return rc;
+    if (pwrite(fd, s, STUDENT_RECORD_SIZE, myoffset) != STUDENT_RECORD_SIZE)
+        return ERR_DB_WRITE;
+    bitmap_set(s->id);
+
+    // without the lock the sidecars stay stale, the record is written
+    if (lock_header(fd, F_WRLCK) == NO_ERROR)
+    {
+        index_insert(s);
+        end_update(gen);
+        lock_header(fd, F_UNLCK);
+    }
+
+    // Grow the mapping if the write extended the file.  If this fails the
+    // next scan retries through db_records(), the record itself is on disk.
+    if (myoffset + STUDENT_RECORD_SIZE > (off_t)db_map.len)
+        map_db(fd);
+
+    return NO_ERROR;
+}
+
+/*
+ *  del_student
+ *      fd:     linux file descriptor
+ *      id:     student id to be deleted
+ *
+ *  Removes a student to the database.  Use the get_student() function to
+ *  locate the student to be deleted. If there is a student at that location
+ *  write an empty student record - see EMPTY_STUDENT_RECORD from db.h at
+ *  that location.
+ *
+ *  returns:  NO_ERROR       student deleted from database
+ *            ERR_DB_FILE    database file I/O issue
+ *            ERR_DB_OP      database operation logically failed (aka student
+ *                           not in database)
+ *
+ *
+ *  console:  M_STD_DEL_MSG      on success
+ *            M_STD_NOT_FND_MSG  student not in database, cant be deleted
+ *            M_ERR_DB_READ      error reading or seeking the database file
+ *            M_ERR_DB_WRITE     error writing to db file (adding student)
+ *
+ */
+int del_student(int fd, int id)
+{
+    switch (remove_student(fd, id))
+    {
+    case NO_ERROR:
+        printf(M_STD_DEL_MSG, id);
+        return NO_ERROR;
+    case SRCH_NOT_FOUND:
+        printf(M_STD_NOT_FND_MSG, id);
+        return SRCH_NOT_FOUND;
+    case ERR_DB_READONLY:
+        printf(M_DB_PACKED_RO);
+        return ERR_DB_OP;
+    case ERR_DB_WRITE:
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    default:
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+}
+
+/*
+ *  remove_student
+ *      fd:     linux file descriptor
+ *      id:     student id to be deleted
+ *
+ *  Does the work of del_student() without any console output: locates the
+ *  student, logs the change in the write-ahead log and the change log, then
+ *  has erase_student() remove it, with the same locking and the same undo
+ *  in the change log as insert_student().  A block of slots left without
+ *  students is then handed back to the file system, see punch_block().
+ *
+ *  returns:  NO_ERROR       student deleted from database
+ *            ERR_DB_FILE    error reading the database file
+ *            ERR_DB_WRITE   error writing the database file or the log
+ *            SRCH_NOT_FOUND student not in database
+ *            ERR_DB_READONLY  the file is packed, see sdb_pack.c
+ *
+ *  console:  Does not produce any console I/O
+ */
+int remove_student(int fd, int id)
+{
+    student_t student;
+    off_t offset;
+
+    // records may move, the file is then locked as a whole
+    bool whole;
+
+    if (lock_change(fd, id, F_WRLCK, &whole) != NO_ERROR)
+        return ERR_DB_FILE;
+    wal_begin();
+
+    // Check if the student exists and find where its record lives, the
+    // records of a packed file have no slot to erase
+    int rc = (db_map.flags & DB_FLAG_PACKED) ? ERR_DB_READONLY
+                                             : locate_student(fd, id, &student, &offset);
+    if (rc == NO_ERROR && (rc = wal_log(SDB_OP_DEL, &student)) == NO_ERROR &&
+        ((rc = cdc_log(SDB_OP_DEL, &student, 1)) != NO_ERROR ||
+         (rc = erase_student(fd, &student, offset)) != NO_ERROR))
+    {
+        cdc_log(SDB_OP_ADD, &student, 1);
+        wal_log(SDB_OP_ADD, &student);
+    }
+
+    wal_end(fd);
+    unlock_change(fd, id, whole);
+
+    // the delete may have emptied the last slot of its block
+    if (rc == NO_ERROR && !whole)
+        punch_block(fd, offset / STUDENT_RECORD_SIZE / PUNCH_SLOTS);
+    return rc;
+}
+
+/*
+ *  punch_block
+ *      fd:     linux file descriptor
+ *      block:  a block of PUNCH_SLOTS slots, block * PUNCH_SLOTS is its
+ *              first slot
+ *
+ *  Releases the storage of the block when none of its slots holds a
+ *  student any more, the file keeps its size and the block reads back as
+ *  zeros (fallocate() FALLOC_FL_PUNCH_HOLE).  The occupancy bitmap rules
+ *  out most blocks without touching the file.  Otherwise the block is
+ *  write locked, which waits for changes to its slots to finish and keeps
+ *  new ones out, and checked once more on disk before it is punched.  A
+ *  file system that cannot punch holes keeps the block.
+ */
+static void punch_block(int fd, int block)
+{
+    student_t rec[PUNCH_SLOTS];
+    int first = block * PUNCH_SLOTS;
+    off_t offset = (off_t)first * STUDENT_RECORD_SIZE;
+    off_t len = (off_t)PUNCH_SLOTS * STUDENT_RECORD_SIZE;
+
+    if (use_bitmap(fd))
+    {
+        int next = bitmap_next(first);
+        if (next >= first && next < first + PUNCH_SLOTS)
+            return;
+    }
+
+    if (lock_range(fd, F_WRLCK, offset, len) != NO_ERROR)
+        return;
+
+    // only whole blocks, the last block of the file may still grow
+    if (pread(fd, rec, len, offset) == len &&
+        scan_next_used(rec, PUNCH_SLOTS) == PUNCH_SLOTS)
+        fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, len);
+
+    lock_range(fd, F_UNLCK, offset, len);
+}
+
+/*
+ *  erase_student
+ *      fd:       linux file descriptor
+ *      student:  the student to delete, as stored in the database
+ *      offset:   where its record lives, from locate_student()
+ *
+ *  Overwrites the record with EMPTY_STUDENT_RECORD and updates the
+ *  sidecars.  In a compacted file the students after it move down a slot
+ *  and the file shrinks by one record instead.  A file being compacted
+ *  online does the same for the students it already packed.
+ *
+ *  returns:  NO_ERROR       student deleted
+ *            ERR_DB_WRITE   error writing the database file
+ */
+int erase_student(int fd, const student_t *student, off_t offset)
+{
+    if (db_map.flags & DB_FLAG_COMPACTING)
+    {
+        const db_header_t *hdr = (const db_header_t *)db_map.base;
+        int next = hdr->compact_next;
+        int end = hdr->compact_end;
+        int slot = offset / STUDENT_RECORD_SIZE;
+
+        unsigned int gen = begin_update(fd);
+        if (slot < end)
+        {
+            // the last packed slot becomes part of the hole before
+            // compact_next
+            if (shift_records(fd, slot + 1, end, -1) != NO_ERROR ||
+                set_progress(fd, next, end - 1) != NO_ERROR)
+                return ERR_DB_WRITE;
+        }
+        else if (pwrite(fd, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE, offset) != STUDENT_RECORD_SIZE)
+        {
+            return ERR_DB_WRITE;
+        }
+
+        index_remove(student);
+        end_update(gen);
+        return NO_ERROR;
+    }
+
+    if (db_map.flags & DB_FLAG_COMPACT)
+    {
+        int nslots = db_map.len / STUDENT_RECORD_SIZE;
+
+        unsigned int gen = begin_update(fd);
+        if (shift_records(fd, offset / STUDENT_RECORD_SIZE + 1, nslots, -1) != NO_ERROR ||
+            ftruncate(fd, (off_t)(nslots - 1) * STUDENT_RECORD_SIZE) == -1)
+            return ERR_DB_WRITE;
+
+        map_db(fd);
+        index_remove(student);
+        end_update(gen);
+        return NO_ERROR;
+    }
+
+    // Overwrite the student record with an empty record, locked like
+    // store_student() does
+    unsigned int gen;
+    int rc = begin_slot_update(fd, offset / STUDENT_RECORD_SIZE, &gen);
+    if (rc != NO_ERROR)
+        return rc;
+    if (pwrite(fd, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE, offset) != STUDENT_RECORD_SIZE)
+        return ERR_DB_WRITE;
+    bitmap_clear(student->id);
+
+    if (lock_header(fd, F_WRLCK) == NO_ERROR)
+    {
+        index_remove(student);
+        end_update(gen);
+        lock_header(fd, F_UNLCK);
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  replay_student
+ *      fd:  linux file descriptor
+ *      op:  SDB_OP_ADD or SDB_OP_DEL, from a write-ahead log record
+ *      s:   the student from the log record
+ *
+ *  Applies one log record to the database again, see open_wal().  Records
+ *  may already be in the database, replaying them is harmless.
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE or ERR_DB_WRITE
+ */
+int replay_student(int fd, int op, const student_t *s)
+{
+    student_t student;
+    off_t offset;
+
+    if (op == SDB_OP_ADD)
+        return store_student(fd, s);
+
+    int rc = locate_student(fd, s->id, &student, &offset);
+    if (rc == SRCH_NOT_FOUND)
+        return NO_ERROR;
+    if (rc != NO_ERROR)
+        return rc;
+    return erase_student(fd, &student, offset);
+}
+
+/*
+ *  parse_csv_student
+ *      line:  one line of a roster CSV file, modified in place
+ *      *s:    where the parsed student is stored
+ *
+ *  Parses a "id,first_name,last_name,gpa" line.  Blanks around fields and
+ *  the line terminator are ignored, names are truncated to fit student_t
+ *  the same way add_student() does it.
+ *
+ *  returns:  NO_ERROR       line parsed into *s
+ *            ERR_DB_OP      line is not a valid student record
+ *
+ *  console:  Does not produce any console I/O
+ */
+static int parse_csv_student(char *line, student_t *s)
+{
+    char *field[4];
+    char *p = line;
+    char *end;
+
+    for (int i = 0; i < 4; i++)
+    {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        field[i] = p;
+
+        p += strcspn(p, i < 3 ? "," : "\r\n");
+        if (i < 3 && *p != ',')
+            return ERR_DB_OP;
+
+        // trim trailing blanks and terminate the field
+        end = p;
+        while (end > field[i] && (end[-1] == ' ' || end[-1] == '\t'))
+            end--;
+        if (*p != '\0')
+            p++;
+        *end = '\0';
+    }
+
+    memset(s, 0, sizeof(*s));
+
+    s->id = (int)strtol(field[0], &end, 10);
+    if (end == field[0] || *end != '\0')
+        return ERR_DB_OP;
+
+    s->gpa = (int)strtol(field[3], &end, 10);
+    if (end == field[3] || *end != '\0')
+        return ERR_DB_OP;
+
+    if (*field[1] == '\0' || *field[2] == '\0')
+        return ERR_DB_OP;
+
+    strncpy(s->fname, field[1], sizeof(s->fname) - 1);
+    strncpy(s->lname, field[2], sizeof(s->lname) - 1);
+    return NO_ERROR;
+}
+
+// roster line waiting to be bulk loaded, the line number keeps the sort
+// stable so the first of several lines with the same id is the one loaded
+typedef struct roster_entry {
+    student_t student;
+    int lineno;
+    bool loaded;            //stored, not skipped, goes to the change log
+} roster_entry_t;
+
+/*
+ *  log_roster
+ *      roster:    students being bulk loaded
+ *      from, to:  the entries from up to, not including, to
+ *      op:        SDB_OP_ADD before they are written, SDB_OP_DEL to take
+ *                 the adds back when the write failed
+ *
+ *  Appends the entries marked loaded to the change log in one append.
+ *
+ *  returns:  NO_ERROR or ERR_DB_WRITE
+ */
+static int log_roster(const roster_entry_t *roster, int from, int to, int op)
+{
+    int n = 0;
+
+    for (int i = from; i < to; i++)
+        n += roster[i].loaded;
+    if (n == 0)
+        return NO_ERROR;
+
+    student_t *batch = malloc(n * sizeof(student_t));
+    if (batch == NULL)
+        return ERR_DB_WRITE;
+
+    n = 0;
+    for (int i = from; i < to; i++)
+    {
+        if (roster[i].loaded)
+            batch[n++] = roster[i].student;
+    }
+
+    int rc = cdc_log(op, batch, n);
+    free(batch);
+    return rc;
+}
+
+static int cmp_student_id(const void *a, const void *b)
+{
+    int ida = ((const student_t *)a)->id;
+    int idb = ((const student_t *)b)->id;
+
+    return (ida > idb) - (ida < idb);
+}
+
+static int cmp_roster_entry(const void *a, const void *b)
+{
+    const roster_entry_t *ra = a;
+    const roster_entry_t *rb = b;
+
+    if (ra->student.id != rb->student.id)
+        return (ra->student.id > rb->student.id) ? 1 : -1;
+    return (ra->lineno > rb->lineno) - (ra->lineno < rb->lineno);
+}
+
+/*
+ *  bulk_store_each
+ *      fd:       linux file descriptor of a hash database, or of one being
+ *                compacted online
+ *      roster:   students to load, sorted by id then line number
+ *      nroster:  number of roster entries
+ *      skipped:  incremented for every duplicate that is skipped
+ *      store:    hash_store() or compacting_store()
+ *
+ *  bulk_load() for files without id slots to write in batches: stores the
+ *  students one at a time, into their hash buckets or wherever an online
+ *  compaction wants them.
+ *
+ *  returns:  <number>       number of students loaded
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  M_ERR_DB_ADD_DUP  a student already exists
+ *            M_ERR_DB_READ, M_ERR_DB_WRITE on errors
+ */
+static int bulk_store_each(int fd, roster_entry_t *roster, int nroster, int *skipped,
+                           int (*store)(int fd, const student_t *s))
+{
+    int loaded = 0;
+
+    for (int i = 0; i < nroster; i++)
+    {
+        const student_t *s = &roster[i].student;
+        int rc = locate_student(fd, s->id, NULL, NULL);
+
+        if (rc == NO_ERROR)
+        {
+            printf(M_ERR_DB_ADD_DUP, s->id);
+            (*skipped)++;
+            continue;
+        }
+        if (rc != SRCH_NOT_FOUND)
+        {
+            printf(M_ERR_DB_READ);
+            return ERR_DB_FILE;
+        }
+        if (cdc_log(SDB_OP_ADD, s, 1) != NO_ERROR)
+        {
+            printf(M_ERR_DB_WRITE);
+            return ERR_DB_FILE;
+        }
+        if (store(fd, s) != NO_ERROR)
+        {
+            cdc_log(SDB_OP_DEL, s, 1);
+            printf(M_ERR_DB_WRITE);
+            return ERR_DB_FILE;
+        }
+        roster[i].loaded = true;
+        loaded++;
+    }
+
+    return loaded;
+}
+
+/*
+ *  bulk_merge_compact
+ *      fd:       linux file descriptor of a compacted database
+ *      roster:   students to load, sorted by id then line number
+ *      nroster:  number of roster entries
+ *      skipped:  incremented for every duplicate that is skipped
+ *
+ *  bulk_load() for compacted files: merges the sorted roster with the sorted
+ *  records already in the file and writes the result back in one pwrite().
+ *
+ *  returns:  <number>       number of students loaded
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  M_ERR_DB_ADD_DUP  a student already exists
+ *            M_ERR_DB_READ, M_ERR_DB_WRITE, M_ERR_BULK_MEM on errors
+ */
+static int bulk_merge_compact(int fd, roster_entry_t *roster, int nroster, int *skipped)
+{
+    int first, nslots;
+    const student_t *rec = db_records(fd, &first, &nslots);
+
+    if (nslots < 0)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    student_t *merged = malloc(((size_t)nslots - first + nroster) * sizeof(student_t));
+    if (merged == NULL)
+    {
+        printf(M_ERR_BULK_MEM);
+        return ERR_DB_FILE;
+    }
+
+    int n = 0, loaded = 0, i = first, j = 0;
+    while (i < nslots || j < nroster)
+    {
+        if (j == nroster || (i < nslots && rec[i].id <= roster[j].student.id))
+        {
+            merged[n++] = rec[i++];
+            continue;
+        }
+        if (n > 0 && merged[n - 1].id == roster[j].student.id)
+        {
+            printf(M_ERR_DB_ADD_DUP, roster[j].student.id);
+            (*skipped)++;
+            j++;
+            continue;
+        }
+        roster[j].loaded = true;
+        merged[n++] = roster[j++].student;
+        loaded++;
+    }
+
+    size_t len = (size_t)n * STUDENT_RECORD_SIZE;
+    if (loaded > 0 &&
+        (log_roster(roster, 0, nroster, SDB_OP_ADD) != NO_ERROR ||
+         pwrite(fd, merged, len, (off_t)first * STUDENT_RECORD_SIZE) != (ssize_t)len))
+    {
+        log_roster(roster, 0, nroster, SDB_OP_DEL);
+        printf(M_ERR_DB_WRITE);
+        loaded = ERR_DB_FILE;
+    }
+
+    free(merged);
+    return loaded;
+}
+
+/*
+ *  bulk_load
+ *      fd:  linux file descriptor
+ *      fp:  stream with the roster in CSV format, one
+ *           "id,first_name,last_name,gpa" record per line
+ *
+ *  Loads a whole roster in one pass.  Every line is parsed and checked with
+ *  validate_range(), then the students are sorted by id so they can be
+ *  written in large sequential batches: each batch covers up to
+ *  BULK_BATCH_SLOTS consecutive slots, is read once to check for students
+ *  that already exist, has the new records merged in and is written back
+ *  with a single pwrite().  Lines that cannot be parsed, are out of range or
+ *  duplicate an existing student are reported and skipped.  A first line
+ *  whose id is not a number is taken for a header naming the columns and
+ *  skipped quietly.
+ *
+ *  Files without a header are scanned once up front so that duplicates
+ *  stored away from their id slot are detected as well.  Compacted files
+ *  have the roster merged into their sorted records instead, hash files
+ *  store the students into their buckets.  The whole file is write locked
+ *  while the records are written.  The students of each write are appended
+ *  to the change log (see sdb_cdc.c) before it, and logged as deleted again
+ *  when it fails.
+ *
+ *  returns:  NO_ERROR       all lines were loaded
+ *            ERR_DB_OP      some lines were skipped, the rest were loaded
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  M_BULK_LOADED     on completion, with the number loaded
+ *            M_ERR_BULK_LINE   a line could not be parsed
+ *            M_ERR_BULK_RNG    a line has an id or gpa out of range
+ *            M_ERR_DB_ADD_DUP  a student already exists
+ *            M_ERR_DB_READ     error reading the database file
+ *            M_ERR_DB_WRITE    error writing the database file
+ */
+int bulk_load(int fd, FILE *fp)
+{
+    roster_entry_t *roster = NULL;
+    int nroster = 0;
+    int capacity = 0;
+    int skipped = 0;
+    int loaded = 0;
+    int rc = NO_ERROR;
+    char *line = NULL;
+    size_t linecap = 0;
+    int lineno = 0;
+    bool header_checked = false;
+    unsigned char *seen = NULL;
+    student_t *batch = NULL;
+
+    while (getline(&line, &linecap, fp) != -1)
+    {
+        student_t s;
+
+        lineno++;
+        if (line[strspn(line, " \t\r\n")] == '\0')
+            continue;
+
+        // the first line may be a header such as "id,fname,lname,gpa"
+        if (!header_checked)
+        {
+            char *end;
+
+            header_checked = true;
+            strtol(line, &end, 10);
+            if (end == line)
+                continue;
+        }
+
+        if (parse_csv_student(line, &s) != NO_ERROR)
+        {
+            printf(M_ERR_BULK_LINE, lineno);
+            skipped++;
+            continue;
+        }
+        if (validate_range(s.id, s.gpa) != NO_ERROR)
+        {
+            printf(M_ERR_BULK_RNG, lineno);
+            skipped++;
+            continue;
+        }
+
+        if (nroster == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 4096;
+            roster_entry_t *grown = realloc(roster, capacity * sizeof(roster_entry_t));
+            if (grown == NULL)
+            {
+                printf(M_ERR_BULK_MEM);
+                rc = ERR_DB_FILE;
+                goto done;
+            }
+            roster = grown;
+        }
+        roster[nroster].student = s;
+        roster[nroster].lineno = lineno;
+        roster[nroster].loaded = false;
+        nroster++;
+    }
+
+    qsort(roster, nroster, sizeof(roster_entry_t), cmp_roster_entry);
+
+    // the load writes many slots at once, keep everyone else out
+    if (lock_current(fd) != NO_ERROR)
+    {
+        printf(M_ERR_DB_WRITE);
+        rc = ERR_DB_FILE;
+        goto done;
+    }
+    // an online compaction may have started since the file was opened
+    load_flags();
+
+    // a packed file takes no changes
+    if (db_map.flags & DB_FLAG_PACKED)
+    {
+        printf(M_DB_PACKED_RO);
+        rc = ERR_DB_OP;
+        goto done;
+    }
+
+    // inserting every student into the name and GPA indexes and the columns
+    // would be quadratic, let them go stale and rebuild them once the load
+    // is done
+    if (db_names.base != NULL)
+        set_sidecar_gen(&db_names, SIDECAR_STALE);
+    if (db_gpa.base != NULL)
+        set_sidecar_gen(&db_gpa, SIDECAR_STALE);
+    if (db_cols.base != NULL)
+        set_sidecar_gen(&db_cols, SIDECAR_STALE);
+
+    // a hash file has no id slots, nor has a file half way through an
+    // online compaction, store the students one at a time
+    if (db_map.fd == fd && (db_map.flags & (DB_FLAG_HASH | DB_FLAG_COMPACTING)))
+    {
+        unsigned int gen = begin_update(fd);
+        loaded = bulk_store_each(fd, roster, nroster, &skipped,
+                                 (db_map.flags & DB_FLAG_HASH) ? hash_store : compacting_store);
+        end_update(gen);
+        if (loaded < 0)
+        {
+            rc = ERR_DB_FILE;
+            goto done;
+        }
+        goto loaded;
+    }
+
+    // a compacted file has no id slots, merge the roster in instead
+    if (db_map.fd == fd && (db_map.flags & DB_FLAG_COMPACT))
+    {
+        unsigned int gen = begin_update(fd);
+        loaded = bulk_merge_compact(fd, roster, nroster, &skipped);
+        end_update(gen);
+        if (loaded < 0)
+        {
+            rc = ERR_DB_FILE;
+            goto done;
+        }
+        goto loaded;
+    }
+
+    // old style files may hold a student anywhere, remember who exists
+    if (!(db_map.flags & DB_FLAG_DIRECT))
+    {
+        int first, nslots;
+        const student_t *rec = db_records(fd, &first, &nslots);
+
+        seen = calloc(MAX_STD_ID / 8 + 1, 1);
+        if (nslots < 0 || seen == NULL)
+        {
+            printf(nslots < 0 ? M_ERR_DB_READ : M_ERR_BULK_MEM);
+            rc = ERR_DB_FILE;
+            goto done;
+        }
+        for (int i = first, end; next_extent(fd, nslots, &i, &end); )
+        {
+            for (; i < end; i++)
+            {
+                int id = rec[i].id;
+                if (id >= MIN_STD_ID && id <= MAX_STD_ID)
+                    seen[id / 8] |= 1 << (id % 8);
+            }
+        }
+    }
+
+    batch = malloc(BULK_BATCH_SLOTS * sizeof(student_t));
+    if (batch == NULL)
+    {
+        printf(M_ERR_BULK_MEM);
+        rc = ERR_DB_FILE;
+        goto done;
+    }
+
+    for (int i = 0; i < nroster;)
+    {
+        int from = i;
+        int first_id = roster[i].student.id;
+        int j = i;
+
+        while (j < nroster && roster[j].student.id - first_id < BULK_BATCH_SLOTS)
+            j++;
+
+        int nslots = roster[j - 1].student.id - first_id + 1;
+        off_t offset = (off_t)first_id * STUDENT_RECORD_SIZE;
+        size_t len = (size_t)nslots * STUDENT_RECORD_SIZE;
+
+        // read what is on disk for the batch, holes and EOF read as zeros
+        ssize_t bytes = pread(fd, batch, len, offset);
+        if (bytes < 0)
+        {
+            printf(M_ERR_DB_READ);
+            rc = ERR_DB_FILE;
+            goto done;
+        }
+        memset((char *)batch + bytes, 0, len - bytes);
+
+        int added = 0;
+        for (; i < j; i++)
+        {
+            int id = roster[i].student.id;
+            student_t *slot = &batch[id - first_id];
+
+            if (slot->id != DELETED_STUDENT_ID ||
+                (seen != NULL && (seen[id / 8] & (1 << (id % 8)))))
+            {
+                printf(M_ERR_DB_ADD_DUP, id);
+                skipped++;
+                continue;
+            }
+            *slot = roster[i].student;
+            roster[i].loaded = true;
+            added++;
+        }
+
+        if (added == 0)
+            continue;
+
+        if (log_roster(roster, from, j, SDB_OP_ADD) != NO_ERROR)
+        {
+            printf(M_ERR_DB_WRITE);
+            rc = ERR_DB_FILE;
+            goto done;
+        }
+
+        unsigned int gen = begin_update(fd);
+        if (save_blocks(fd, first_id, nslots) != NO_ERROR ||
+            pwrite(fd, batch, len, offset) != (ssize_t)len)
+        {
+            log_roster(roster, from, j, SDB_OP_DEL);
+            printf(M_ERR_DB_WRITE);
+            rc = ERR_DB_FILE;
+            goto done;
+        }
+        for (int k = 0; k < nslots; k++)
+        {
+            if (batch[k].id != DELETED_STUDENT_ID)
+                bitmap_set(batch[k].id);
+        }
+        end_update(gen);
+        loaded += added;
+    }
+
+loaded:
+    // grow the mapping over the new records
+    map_db(fd);
+    lock_db(fd, F_UNLCK);
+    sync_indexes(fd);
+
+    printf(M_BULK_LOADED, loaded);
+    if (skipped > 0)
+        rc = ERR_DB_OP;
+
+done:
+    lock_db(fd, F_UNLCK);
+    free(batch);
+    free(seen);
+    free(line);
+    free(roster);
+    return rc;
+}
+
+/*
+ *  count_db_records
+ *      fd:     linux file descriptor
+ *
+ *  Counts the number of records in the database.  The mapped student_t
+ *  array is walked in place from the beginning to the end of the file, and
+ *  every slot whose id is not DELETED_STUDENT_ID is counted.  Empty slots
+ *  and holes in the sparse file read back as all zero bytes.
+ *
+ *  returns:  <number>       returns the number of records in db on success
+ *            ERR_DB_FILE    database file I/O issue
+ *            ERR_DB_OP      database operation logically failed (aka student
+ *                           not in database)
+ *
+ *
+ *  console:  M_DB_RECORD_CNT  on success, to report the number of students in db
+ *            M_DB_EMPTY       on success if the record count in db is zero
+ *            M_ERR_DB_READ    error reading or seeking the database file
+ *            M_ERR_DB_WRITE   error writing to db file (adding student)
+ *
+ */
+int count_db_records(int fd)
+{
+    int count = count_students(fd);
+
+    if (count < 0) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    // Print the result
+    if (count == 0) {
+        printf(M_DB_EMPTY);
+    } else {
+        printf(M_DB_RECORD_CNT, count);
+    }
+
+    return count;
+}
+
+/*
+ *  count_students
+ *      fd:     linux file descriptor
+ *
+ *  Does the work of count_db_records() without any console output, with the
+ *  whole file read locked (see sdb_lock.c) or, for a scan of a direct-slot
+ *  file, of a snapshot (see sdb_snapshot.c).  With a usable occupancy bitmap
+ *  this is a popcount, otherwise the scan kernel counts the data extents of
+ *  the mapped record array, skipping holes, split between threads for large
+ *  files (see sdb_parallel.c).
+ *
+ *  returns:  <number>       the number of records in db
+ *            ERR_DB_FILE    database file I/O issue
+ */
+int count_students(int fd)
+{
+    snapshot_t snap;
+
+    if (lock_db(fd, F_RDLCK) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    // the bitmap answers at once, a scan counts a snapshot instead of
+    // keeping changes waiting
+    if (!use_bitmap(fd) && take_snapshot(fd, &snap))
+    {
+        lock_db(fd, F_UNLCK);
+        int count = count_records(fd, &snap);
+
+        snap_end(fd);
+        return count;
+    }
+
+    int count = count_records(fd, NULL);
+
+    lock_db(fd, F_UNLCK);
+    return count;
+}
+
+// a scan split between threads by run_parts(), result holds one entry per
+// range
+typedef struct range_scan {
+    int fd;
+    const student_t *rec;
+    void *result;
+    const snapshot_t *snap; //read the snapshot instead of rec, or NULL
+} range_scan_t;
+
+static int walk_snapshot(const snapshot_t *snap, int lo, int hi,
+                         int (*visit)(const student_t *, void *), void *arg);
+
+static int count_range(int part, int lo, int hi, void *arg);
+
+// walk_range() visitor that counts students
+static int count_student(const student_t *s, void *arg)
+{
+    (void)s;
+    (*(int *)arg)++;
+    return NO_ERROR;
+}
+
+// count_students() with the file read locked, or of the snapshot snap
+static int count_records(int fd, const snapshot_t *snap)
+{
+    int first, nslots;
+    const student_t *rec;
+
+    if (snap != NULL)
+    {
+        rec = snap->rec;
+        first = snap->first;
+        nslots = snap->nslots;
+    }
+    else
+    {
+        if (is_packed(fd))
+            return pack_count(db_map.base, db_map.len);
+
+        rec = db_records(fd, &first, &nslots);
+        if (nslots < 0)
+            return ERR_DB_FILE;
+    }
+
+    // every occupied slot has its bit set
+    if (use_bitmap(fd))
+        return bitmap_count();
+
+    // a compacted file holds nothing but students
+    if (db_map.flags & DB_FLAG_COMPACT)
+        return nslots - first;
+
+    // Walk the data extents of the mapped record array in place, the scan
+    // kernel tests many id words at a time.  Large files are split between
+    // threads, see sdb_parallel.c
+    int parts = scan_parts(nslots - first);
+    int counts[parts];
+    range_scan_t scan = {fd, rec, counts, snap};
+
+    if (run_parts(parts, first, nslots, count_range, &scan) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    int count = 0;
+    for (int p = 0; p < parts; p++)
+        count += counts[p];
+
+    return count;
+}
+
+// run_parts() worker of count_records(), counts the students in [lo, hi)
+static int count_range(int part, int lo, int hi, void *arg)
+{
+    range_scan_t *scan = arg;
+    int count = 0;
+
+    // bucket headers are not students, hash files are walked
+    if (scan->snap != NULL)
+    {
+        int rc = walk_snapshot(scan->snap, lo, hi, count_student, &count);
+        if (rc != NO_ERROR)
+            return rc;
+    }
+    else if (db_map.flags & DB_FLAG_HASH)
+    {
+        walk_range(scan->fd, scan->rec, lo, hi, count_student, &count);
+    }
+    else
+    {
+        for (int i = lo, end; next_extent(scan->fd, hi, &i, &end); i = end)
+            count += scan_count_ids(&scan->rec[i], end - i);
+    }
+
+    ((int *)scan->result)[part] = count;
+    return NO_ERROR;
+}
+
+/*
+ *  scan_students
+ *      fd:     linux file descriptor
+ *      visit:  called for every student in the database, in slot order
+ *      arg:    passed through to visit
+ *
+ *  Walks the mapped record array in place and calls visit() for each slot
+ *  that holds a student.  A direct-slot file is scanned as a snapshot taken
+ *  at the start (see sdb_snapshot.c), other files are read locked as a
+ *  whole for the scan.  When
+ *  the occupancy bitmap is usable only the slots whose bit is set are
+ *  visited, otherwise only the data extents of the file are walked (see
+ *  next_extent), with the scan kernel jumping over empty slots.  A visit()
+ *  result other than NO_ERROR stops the scan and is returned.
+ *
+ *  returns:  NO_ERROR       every student was visited
+ *            ERR_DB_FILE    database file I/O issue
+ *            <rc>           whatever visit() returned to stop the scan
+ */
+int scan_students(int fd, int (*visit)(const student_t *, void *), void *arg)
+{
+    snapshot_t snap;
+
+    if (lock_db(fd, F_RDLCK) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    // changes go on while a snapshot is scanned
+    if (take_snapshot(fd, &snap))
+    {
+        lock_db(fd, F_UNLCK);
+        int rc = walk_snapshot(&snap, snap.first, snap.nslots, visit, arg);
+        snap_end(fd);
+        return rc;
+    }
+
+    int rc = walk_students(fd, visit, arg);
+
+    lock_db(fd, F_UNLCK);
+    return rc;
+}
+
+// scan_students() with the file read locked
+static int walk_students(int fd, int (*visit)(const student_t *, void *), void *arg)
+{
+    if (is_packed(fd))
+        return pack_scan(db_map.base, db_map.len, visit, arg);
+
+    int first, nslots;
+    const student_t *rec = db_records(fd, &first, &nslots);
+
+    if (nslots < 0)
+        return ERR_DB_FILE;
+
+    return walk_range(fd, rec, first, nslots, visit, arg);
+}
+
+// walk_students() over the slots [lo, hi) of the mapped record array rec,
+// does not remap, so several threads may walk at once
+static int walk_range(int fd, const student_t *rec, int lo, int hi,
+                      int (*visit)(const student_t *, void *), void *arg)
+{
+    if (use_bitmap(fd)) {
+        for (int id = bitmap_next(lo); id >= 0 && id < hi; id = bitmap_next(id + 1)) {
+            if (rec[id].id == id) {
+                int rc = visit(&rec[id], arg);
+                if (rc != NO_ERROR)
+                    return rc;
+            }
+        }
+        return NO_ERROR;
+    }
+
+    // the scan kernel skips runs of empty slots, in a hash file only the
+    // students the directory points at count (see hash_owns)
+    bool hashed = db_map.flags & DB_FLAG_HASH;
+    for (int i = lo, end; next_extent(fd, hi, &i, &end); ) {
+        for (i += scan_next_used(&rec[i], end - i); i < end;
+             i += 1 + scan_next_used(&rec[i + 1], end - i - 1)) {
+            if (hashed && !hash_owns(i, rec[i].id))
+                continue;
+            int rc = visit(&rec[i], arg);
+            if (rc != NO_ERROR)
+                return rc;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  walk_snapshot
+ *      snap:   the snapshot
+ *      lo:     first slot to visit
+ *      hi:     one past the last slot to visit, at most snap->nslots
+ *      visit:  called for every student in [lo, hi), in slot order
+ *      arg:    passed through to visit
+ *
+ *  walk_range() of a snapshot, block by block as snap_block() hands them
+ *  out.  Has a cursor of its own, so several threads may walk at once.
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE or whatever visit() returned to stop
+ */
+static int walk_snapshot(const snapshot_t *snap, int lo, int hi,
+                         int (*visit)(const student_t *, void *), void *arg)
+{
+    student_t buf[SNAP_BLOCK_SLOTS];
+    snap_cursor_t cur;
+    int rc = NO_ERROR;
+
+    if (snap_cursor_init(&cur, snap) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    for (int block = lo / SNAP_BLOCK_SLOTS; rc == NO_ERROR && block * SNAP_BLOCK_SLOTS < hi; block++)
+    {
+        const student_t *rec = snap_block(&cur, block, buf);
+        int base = block * SNAP_BLOCK_SLOTS;
+        int i = (lo > base) ? lo - base : 0;
+        int end = (hi - base < SNAP_BLOCK_SLOTS) ? hi - base : SNAP_BLOCK_SLOTS;
+
+        if (rec == NULL)
+        {
+            rc = ERR_DB_FILE;
+            break;
+        }
+        for (i += scan_next_used(&rec[i], end - i); i < end && rc == NO_ERROR;
+             i += 1 + scan_next_used(&rec[i + 1], end - i - 1))
+            rc = visit(&rec[i], arg);
+    }
+
+    snap_cursor_free(&cur);
+    return rc;
+}
+
+/*
+ *  print_db_row
+ *      *s:    student to print
+ *      arg:   points to a bool that tracks if the table header was printed
+ *
+ *  scan_students() visitor used by print_db(), prints the table header
+ *  before the first row.
+ *
+ *  returns:  NO_ERROR
+ */
+int print_db_row(const student_t *s, void *arg)
+{
+    bool *header_printed = arg;
+
+    bool wide = wide_ids();
+
+    // Print the header if it hasn't been printed yet
+    if (!*header_printed) {
+        printf(wide ? STUDENT_PRINT_WIDE_HDR_STRING : STUDENT_PRINT_HDR_STRING,
+               "ID", "FIRST NAME", "LAST_NAME", "GPA");
+        *header_printed = true;
+    }
+
+    // Print the student record
+    float real_gpa = s->gpa / 100.0;
+    printf(wide ? STUDENT_PRINT_WIDE_FMT_STRING : STUDENT_PRINT_FMT_STRING,
+           s->id, s->fname, s->lname, real_gpa);
+    return NO_ERROR;
+}
+
+// scan_students() visitor of a serial print_db(), the table header goes
+// before the first row
+static int print_table_row(const student_t *s, void *arg)
+{
+    table_buf_t *tb = arg;
+
+    if (tb->rows == 0 && table_header(tb) != NO_ERROR)
+        return ERR_DB_FILE;
+    return table_row(s, tb);
+}
+
+// run_parts() worker of print_db(), renders the rows of [lo, hi) into an
+// in-memory table
+static int print_range(int part, int lo, int hi, void *arg)
+{
+    range_scan_t *scan = arg;
+    table_buf_t *tb = &((table_buf_t *)scan->result)[part];
+
+    if (scan->snap != NULL)
+        return walk_snapshot(scan->snap, lo, hi, table_row, tb);
+    return walk_range(scan->fd, scan->rec, lo, hi, table_row, tb);
+}
+
+// print_db() of a large file: the ranges are rendered by threads and then
+// written out in range order, which is the order of a serial scan
+static int print_parallel(int fd, const student_t *rec, const snapshot_t *snap,
+                          int first, int nslots, int parts, table_buf_t *out)
+{
+    table_buf_t *tb = malloc(parts * sizeof(table_buf_t));
+    range_scan_t scan = {fd, rec, tb, snap};
+
+    if (tb == NULL)
+        return ERR_DB_FILE;
+    for (int p = 0; p < parts; p++)
+        table_init(&tb[p], -1);
+
+    int rc = run_parts(parts, first, nslots, print_range, &scan);
+    for (int p = 0; p < parts; p++)
+    {
+        if (rc == NO_ERROR && tb[p].rows > 0)
+        {
+            if (out->rows == 0)
+                rc = table_header(out);
+            if (rc == NO_ERROR)
+                rc = table_append(out, tb[p].buf, tb[p].len);
+            out->rows += tb[p].rows;
+        }
+        table_free(&tb[p]);
+    }
+
+    free(tb);
+    return rc;
+}
+
+/*
+ *  print_db
+ *      fd:     linux file descriptor
+ *
+ *  Prints all records in the database.  The mapped student_t array is
+ *  walked in place from the beginning to the end of the file, skipping
+ *  empty or previously deleted slots (id is DELETED_STUDENT_ID).  Be
+ *  careful as the database might be empty.  Hash files print in bucket
+ *  order, not id order.  Large files are split into ranges that are
+ *  formatted by a pool of threads (see sdb_parallel.c) and printed in id
+ *  order.  Packed files are decoded record by record in id order (see
+ *  sdb_pack.c).  The rows are rendered by the table formatter (see
+ *  sdb_format.c), byte for byte what printf() with STUDENT_PRINT_HDR_STRING
+ *  before the first row and STUDENT_PRINT_FMT_STRING for every row would
+ *  print, and written out in large blocks.  A direct-slot file prints a
+ *  snapshot (see sdb_snapshot.c), so adds and deletes go ahead while the
+ *  table is written out.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  the table        on success, or M_DB_EMPTY
+ *            M_ERR_DB_READ    error reading or seeking the database file
+ *
+ */
+int print_db(int fd)
+{
+    table_buf_t out;
+    snapshot_t snap;
+    int first, nslots;
+    int rc = ERR_DB_FILE;
+
+    if (lock_db(fd, F_RDLCK) != NO_ERROR) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    // the table of a snapshot goes out while changes carry on
+    bool snapped = take_snapshot(fd, &snap);
+    if (snapped)
+        lock_db(fd, F_UNLCK);
+
+    table_init(&out, STDOUT_FILENO);
+    const student_t *rec = NULL;
+    if (snapped) {
+        rec = snap.rec;
+        first = snap.first;
+        nslots = snap.nslots;
+    } else if (is_packed(fd)) {
+        // records are decoded one at a time, there are no slots to split
+        rc = pack_scan(db_map.base, db_map.len, print_table_row, &out);
+        nslots = -1;
+    } else {
+        rec = db_records(fd, &first, &nslots);
+    }
+    if (nslots >= 0) {
+        int parts = scan_parts(nslots - first);
+        if (parts > 1)
+            rc = print_parallel(fd, rec, snapped ? &snap : NULL, first, nslots, parts, &out);
+        else if (snapped)
+            rc = walk_snapshot(&snap, first, nslots, print_table_row, &out);
+        else
+            rc = walk_range(fd, rec, first, nslots, print_table_row, &out);
+    }
+    if (snapped)
+        snap_end(fd);
+    else
+        lock_db(fd, F_UNLCK);
+
+    if (rc == NO_ERROR)
+        rc = table_flush(&out);
+    bool header_printed = out.rows > 0;
+    table_free(&out);
+
+    if (rc != NO_ERROR) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    // If no valid records were found, print a message
+    if (!header_printed) {
+        printf(M_DB_EMPTY);
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  search_names
+ *      fd:      linux file descriptor
+ *      prefix:  last name prefix to search for
+ *
+ *  Prints every student whose last name starts with prefix, compared without
+ *  regard to case, in the same table format as print_db() but ordered by last
+ *  name, first name and id.  The name index answers the search without
+ *  touching the database file; if the index is not available the database
+ *  is scanned and the matches are sorted.
+ *
+ *  returns:  NO_ERROR        at least one student was printed
+ *            SRCH_NOT_FOUND  no student matches the prefix
+ *            ERR_DB_FILE     database file I/O issue
+ *
+ *  console:  <see print_db>  on success
+ *            M_SRCH_NO_MATCH no student matches the prefix
+ *            M_ERR_DB_READ   error reading the database file
+ */
+int search_names(int fd, char *prefix)
+{
+    bool header_printed = false;
+    int found;
+
+    // the index and the records must not change under the search
+    if (lock_db(fd, F_RDLCK) != NO_ERROR)
+    {
+        found = ERR_DB_FILE;
+    }
+    else if (db_names.base != NULL && sidecar_gen(&db_names) == db_gen())
+    {
+        found = names_search(prefix, print_db_row, &header_printed);
+    }
+    else
+    {
+        student_list_t list = {NULL, 0, 0};
+        size_t plen = strlen(prefix);
+
+        found = scan_students(fd, collect_student, &list);
+        if (found == NO_ERROR)
+        {
+            int n = 0;
+            for (int i = 0; i < list.n; i++)
+            {
+                if (strncasecmp(list.students[i].lname, prefix, plen) == 0)
+                    list.students[n++] = list.students[i];
+            }
+            qsort(list.students, n, sizeof(student_t), cmp_student_name);
+            for (int i = 0; i < n; i++)
+                print_db_row(&list.students[i], &header_printed);
+            found = n;
+        }
+        free(list.students);
+    }
+    lock_db(fd, F_UNLCK);
+
+    if (found < 0)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    if (found == 0)
+    {
+        printf(M_SRCH_NO_MATCH, prefix);
+        return SRCH_NOT_FOUND;
+    }
+
+    return NO_ERROR;
+}
+
+// gpa_range() visitor state for query_gpa_range()
+typedef struct gpa_query {
+    int fd;
+    bool header_printed;
+} gpa_query_t;
+
+static int print_gpa_match(int id, void *arg)
+{
+    gpa_query_t *query = arg;
+    student_t student;
+
+    int rc = locate_student(query->fd, id, &student, NULL);
+    if (rc != NO_ERROR)
+        return rc;
+
+    return print_db_row(&student, &query->header_printed);
+}
+
+static int cmp_student_gpa(const void *a, const void *b)
+{
+    const student_t *sa = a;
+    const student_t *sb = b;
+
+    if (sa->gpa != sb->gpa)
+        return (sa->gpa > sb->gpa) - (sa->gpa < sb->gpa);
+    return (sa->id > sb->id) - (sa->id < sb->id);
+}
+
+/*
+ *  query_gpa_range
+ *      fd:      linux file descriptor
+ *      lo, hi:  inclusive GPA range, as 3 digit ints
+ *
+ *  Prints every student with a GPA between lo and hi in the same table
+ *  format as print_db(), ordered by GPA then id.  The GPA index lists the
+ *  ids in the range directly, so only the matching records are read; if
+ *  the index is not available the database is scanned and the matches are
+ *  sorted.
+ *
+ *  returns:  NO_ERROR        at least one student was printed
+ *            SRCH_NOT_FOUND  no student has a GPA in the range
+ *            ERR_DB_FILE     database file I/O issue
+ *
+ *  console:  <see print_db>  on success
+ *            M_RNG_NO_MATCH  no student has a GPA in the range
+ *            M_ERR_DB_READ   error reading the database file
+ */
+int query_gpa_range(int fd, int lo, int hi)
+{
+    gpa_query_t query = {fd, false};
+    int found;
+
+    // the index and the records must not change under the query
+    if (lock_db(fd, F_RDLCK) != NO_ERROR)
+    {
+        found = ERR_DB_FILE;
+    }
+    else if (db_gpa.base != NULL && sidecar_gen(&db_gpa) == db_gen())
+    {
+        found = gpa_range(lo, hi, print_gpa_match, &query);
+    }
+    else
+    {
+        student_list_t list = {NULL, 0, 0};
+
+        found = scan_students(fd, collect_student, &list);
+        if (found == NO_ERROR)
+        {
+            int n = 0;
+            for (int i = 0; i < list.n; i++)
+            {
+                if (list.students[i].gpa >= lo && list.students[i].gpa <= hi)
+                    list.students[n++] = list.students[i];
+            }
+            qsort(list.students, n, sizeof(student_t), cmp_student_gpa);
+            for (int i = 0; i < n; i++)
+                print_db_row(&list.students[i], &query.header_printed);
+            found = n;
+        }
+        free(list.students);
+    }
+    lock_db(fd, F_UNLCK);
+
+    if (found < 0)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    if (found == 0)
+    {
+        printf(M_RNG_NO_MATCH, lo, hi);
+        return SRCH_NOT_FOUND;
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  print_sorted
+ *      fd:     linux file descriptor
+ *      order:  SORT_BY_LNAME or SORT_BY_GPA
+ *
+ *  Prints all students in the same table format as print_db(), ordered by
+ *  last name, first name and id (as search_names() does) or by GPA and id.
+ *  The students of a scan go through an external merge sort (see
+ *  sdb_sort.c) that keeps to the SDB_SORT_MEM_ENV budget and writes sorted
+ *  runs to a temporary file next to the database when they do not fit, so
+ *  any database can be sorted whatever its size.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  <see print_db>   on success, print table or database empty
+ *            M_ERR_DB_READ    error reading the database file or writing
+ *                             the sort runs
+ */
+int print_sorted(int fd, int order)
+{
+    char path[PATH_MAX];
+    table_buf_t out;
+    xsort_t xs;
+
+    int rc = sort_init(&xs, (order == SORT_BY_GPA) ? cmp_student_gpa : cmp_student_name,
+                       db_path(path, TMP_DB_PREFIX, ".sort.XXXXXX"));
+    if (rc == NO_ERROR)
+        rc = scan_students(fd, sort_add, &xs);
+
+    table_init(&out, STDOUT_FILENO);
+    if (rc == NO_ERROR)
+        rc = sort_finish(&xs, print_table_row, &out);
+    if (rc == NO_ERROR)
+        rc = table_flush(&out);
+    bool header_printed = out.rows > 0;
+    table_free(&out);
+    sort_free(&xs);
+
+    if (rc != NO_ERROR) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    if (!header_printed) {
+        printf(M_DB_EMPTY);
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  analyze_db
+ *      fd:  linux file descriptor
+ *
+ *  Prints the number of students, the average, minimum and maximum GPA and
+ *  a histogram of the GPAs.  The aggregates are computed by gpa_stats() over
+ *  the gpa column of the columnar shadow, so only 4 bytes per student are
+ *  read.  The shadow is created (from a scan of the database) the first
+ *  time it is needed and maintained by every change after that.  Files
+ *  without a header have no shadow and are scanned instead.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  M_GPA_STATS and the histogram on success
+ *            M_DB_EMPTY     the database has no students
+ *            M_ERR_DB_READ  error reading the database file
+ */
+int analyze_db(int fd)
+{
+    gpa_stats_t st;
+    const int *gpas;
+    int n;
+
+    if (db_map.fd == fd && db_map.flags != 0 && db_cols.base == NULL &&
+        open_columns(db_file, true) == NO_ERROR)
+        sync_indexes(fd);
+
+    // the column must not change under the aggregation
+    if (lock_db(fd, F_RDLCK) != NO_ERROR)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    if (db_cols.base != NULL && sidecar_gen(&db_cols) == db_gen() &&
+        (gpas = columns_gpa(&n)) != NULL)
+    {
+        gpa_stats(gpas, n, &st);
+    }
+    else
+    {
+        student_list_t list = {NULL, 0, 0};
+
+        if (scan_students(fd, collect_student, &list) != NO_ERROR)
+        {
+            lock_db(fd, F_UNLCK);
+            free(list.students);
+            printf(M_ERR_DB_READ);
+            return ERR_DB_FILE;
+        }
+
+        // gather the gpa column in place
+        int *column = (int *)list.students;
+        for (int i = 0; i < list.n; i++)
+            column[i] = list.students[i].gpa;
+        gpa_stats(column, list.n, &st);
+        free(list.students);
+    }
+    lock_db(fd, F_UNLCK);
+
+    if (st.count == 0)
+    {
+        printf(M_DB_EMPTY);
+        return NO_ERROR;
+    }
+
+    printf(M_GPA_STATS, st.count, st.sum / 100.0 / st.count, st.min / 100.0, st.max / 100.0);
+    printf(M_GPA_HIST_HDR);
+    for (int b = 0; b < GPA_HIST_BUCKETS; b++)
+    {
+        int hi = b == GPA_HIST_BUCKETS - 1 ? MAX_STD_GPA : (b + 1) * GPA_HIST_WIDTH - 1;
+        printf(M_GPA_HIST_ROW, b * GPA_HIST_WIDTH / 100.0, hi / 100.0, st.hist[b]);
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  print_student
+ *      *s:   a pointer to a student_t structure that should
+ *            contain a valid student to be printed
+ *
+ *  Start by ensuring that provided student pointer is valid.  To do this
+ *  make sure it is not NULL and that s->id is not zero.  After ensuring
+ *  that the student is valid, print it the exact way that is described
+ *  in the print_db() function by first printing the header then the
+ *  student data:
+ *
+ *     printf(STUDENT_PRINT_HDR_STRING, "ID",
+ *                  "FIRST NAME", "LAST_NAME", "GPA");
+ *
+ *     printf(STUDENT_PRINT_FMT_STRING, s->id, s->fname,
+ *                    student.lname, calculated_gpa_from_s);
+ *
+ *  Dont forget that  the GPA in the student structure is an int, to convert
+ *  it into a real gpa divide by 100.0 and store in a float variable.
+ *
+ *  returns:  nothing, this is a void function
+ *
+ *
+ *  console:  <see above>      on success, print table or database empty
+ *            M_ERR_STD_PRINT  if the function argument s is NULL or if
+ *                             s->id is zero
+ *
+ */
+void print_student(student_t *s)
+{
+    bool wide = wide_ids();
+
+    printf(wide ? STUDENT_PRINT_WIDE_HDR_STRING : STUDENT_PRINT_HDR_STRING,
+           "ID", "FIRST NAME", "LAST NAME", "GPA");
+
+    float real_gpa = s->gpa / 100.0;
+
+    printf(wide ? STUDENT_PRINT_WIDE_FMT_STRING : STUDENT_PRINT_FMT_STRING,
+           s->id, s->fname, s->lname, real_gpa);
+}
+
+/*
+ *  replace_db
+ *      image:  the new database file
+ *      len:    its length
+ *
+ *  Writes the new file to the temporary database file, syncs it and then
+ *  atomically renames it over the database file, for compress_db() and
+ *  pack_db().  The caller keeps the database write locked meanwhile.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ *
+ *  console:  M_ERR_DB_OPEN    the temporary file cannot be created
+ *            M_ERR_DB_WRITE   error writing the temporary file
+ *            M_ERR_DB_CREATE  the temporary file cannot be renamed
+ */
+static int replace_db(const void *image, size_t len)
+{
+    char tmp_file[PATH_MAX];
+    db_path(tmp_file, TMP_DB_PREFIX, "");
+
+    mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+    int tmp_fd = open(tmp_file, O_RDWR | O_CREAT | O_TRUNC, mode);
+    if (tmp_fd == -1)
+    {
+        printf(M_ERR_DB_OPEN);
+        return ERR_DB_FILE;
+    }
+
+    ssize_t bytes = write(tmp_fd, image, len);
+    if (bytes != (ssize_t)len || fsync(tmp_fd) == -1)
+    {
+        printf(M_ERR_DB_WRITE);
+        close(tmp_fd);
+        unlink(tmp_file);
+        return ERR_DB_FILE;
+    }
+    close(tmp_fd);
+
+    if (rename(tmp_file, db_file) == -1)
+    {
+        printf(M_ERR_DB_CREATE);
+        unlink(tmp_file);
+        return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  NOTE IMPLEMENTING THIS FUNCTION IS EXTRA CREDIT
+ *
+ *  compress_db
+ *      fd:     linux file descriptor
+ *
+ *  This assignment takes advantage of the way Linux handles sparse files
+ *  on disk. Thus if there is a large hole between student records, Linux
  *  will not use any physical storage.  However, when a database record is
  *  deleted storage is used to write a blank - see EMPTY_STUDENT_RECORD from
  *  db.h - record.
@@ -416,14 +3232,24 @@ void print_student(student_t *s)
  *  records. There are a number of ways to do this, but since this is extra credit
  *  you need to figure this out on your own.
  *
- *  At a high level create a temporary database file then copy all valid students from
- *  the active database (passed in via fd) to the temporary file. When this is done
- *  rename the temporary database file to the name of the real database file. See
- *  the constants in db.h for required file names:
+ *  Plain compaction would break the id * STUDENT_RECORD_SIZE addressing, so
+ *  the compressed file uses a different layout: a header flagged with
+ *  DB_FLAG_COMPACT followed by the valid students packed from slot 1 in
+ *  ascending id order.  The file is sized to the live records, lookups use
+ *  a binary search (see locate_student), and adds and deletes shift the
+ *  records after them to keep the file sorted.  Zeroing the database with
+ *  -z goes back to the direct-slot layout.
+ *
+ *  The compressed file is written to a temporary database file, synced, and
+ *  then atomically renamed over the real database file.  See the constants
+ *  in db.h for the file names:
  *
  *         #define DB_FILE     "student.db"        //name of database file
  *         #define TMP_DB_FILE ".tmp_student.db"   //for extra credit
  *
+ *  A database opened under another name is written to TMP_DB_PREFIX plus
+ *  its name, in the same directory.
+ *
  *  Note that you are passed in the fd of the database file to be compressed,
  *  it is very likely you will need to close it to overwrite it with the
  *  compressed version of the file.  To ensure the caller can work with the
@@ -448,247 +3274,632 @@ void print_student(student_t *s)
  */
 int compress_db(int fd)
 {
-    // TODO
-    printf(M_NOT_IMPL);
+    student_t *students = NULL;
+    int n = 0;
+    int capacity = 0;
+    int first, nslots;
+
+    // hash files grow with the students, not their ids
+    if (db_map.fd == fd && (db_map.flags & DB_FLAG_HASH))
+    {
+        printf(M_DB_HASH_COMPACT);
+        return fd;
+    }
+
+    // the log describes the old file, make it durable and empty the log
+    if (wal_checkpoint(fd, true) != NO_ERROR)
+    {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    // keep changes out until the new file replaced the old one
+    if (lock_current(fd) != NO_ERROR)
+    {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    // gather the valid students, slot 0 of the new file is the header
+    if (is_packed(fd))
+    {
+        student_list_t list = {NULL, 0, 0};
+
+        if (collect_student(&EMPTY_STUDENT_RECORD, &list) != NO_ERROR ||
+            pack_scan(db_map.base, db_map.len, collect_student, &list) != NO_ERROR)
+        {
+            lock_db(fd, F_UNLCK);
+            printf(M_ERR_DB_READ);
+            free(list.students);
+            return ERR_DB_FILE;
+        }
+        students = list.students;
+        n = list.n - 1;
+    }
+    else
+    {
+        const student_t *rec = db_records(fd, &first, &nslots);
+        if (nslots < 0)
+        {
+            lock_db(fd, F_UNLCK);
+            printf(M_ERR_DB_READ);
+            return ERR_DB_FILE;
+        }
+
+        for (int i = first, end; next_extent(fd, nslots, &i, &end); )
+        {
+            for (i += scan_next_used(&rec[i], end - i); i < end;
+                 i += 1 + scan_next_used(&rec[i + 1], end - i - 1))
+            {
+                if (n + 1 >= capacity)
+                {
+                    capacity = capacity ? capacity * 2 : 4096;
+                    student_t *grown = realloc(students, capacity * sizeof(student_t));
+                    if (grown == NULL)
+                    {
+                        lock_db(fd, F_UNLCK);
+                        printf(M_ERR_DB_READ);
+                        free(students);
+                        return ERR_DB_FILE;
+                    }
+                    students = grown;
+                }
+                students[++n] = rec[i];
+            }
+        }
+    }
+
+    if (students == NULL && (students = malloc(sizeof(student_t))) == NULL)
+    {
+        lock_db(fd, F_UNLCK);
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    // direct-slot files are already in id order, old style files may not be
+    qsort(students + 1, n, sizeof(student_t), cmp_student_id);
+
+    db_header_t *hdr = (db_header_t *)students;
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->magic = DB_MAGIC;
+    hdr->version = DB_VERSION;
+    hdr->flags = DB_FLAG_COMPACT;
+    // a new generation makes the indexes of the old file stale
+    hdr->gen = db_gen() + 1;
+
+    size_t len = (size_t)(n + 1) * STUDENT_RECORD_SIZE;
+    int rc = replace_db(students, len);
+    free(students);
+    lock_db(fd, F_UNLCK);
+    if (rc != NO_ERROR)
+        return ERR_DB_FILE;
+
+    // compacted files have no use for the occupancy bitmap, nor for the
+    // journal of an online compaction this one finished
+    char path[PATH_MAX];
+    close_db(fd);
+    unlink(db_path(path, "", DB_BITMAP_SUFFIX));
+    journal_remove(db_file);
+
+    fd = open_db(db_file, false);
+    if (fd < 0)
+        return ERR_DB_FILE;
+
+    printf(M_DB_COMPRESSED_OK);
     return fd;
 }
 
 /*
- *  validate_range
- *      id:  proposed student id
- *      gpa: proposed gpa
+ *  pack_db
+ *      fd:     linux file descriptor
  *
- *  This function validates that the id and gpa are in the allowable ranges
- *  as per the specifications.  It checks if the values are within the
- *  inclusive range using constents in db.h
+ *  The -x packed option.  Rewrites the database in the packed layout
+ *  (DB_FLAG_PACKED, see sdb_pack.c), which stores every student in a few
+ *  bytes more than its names instead of a 64 byte slot, for databases that
+ *  are only read any more.  Any layout can be packed.  Like compress_db()
+ *  the new file replaces the database through the temporary database file.
+ *  A packed file answers lookups, counts, prints and the queries, changes
+ *  are refused until -x turns it back into a compacted file.
  *
- *  returns:    NO_ERROR       on success, both ID and GPA are in range
- *              EXIT_FAIL_ARGS if either ID or GPA is out of range
+ *  returns:  <number>       the fd of the packed database file
+ *            ERR_DB_FILE    database file I/O issue
  *
- *  console:  This function does not produce any output
+ *  console:  M_DB_PACKED_OK   on success, with the students and file size
+ *            M_ERR_DB_READ    error reading the database file, or out of
+ *                             memory
+ *            <see compress_db> errors replacing the database file
+ */
+int pack_db(int fd)
+{
+    student_list_t list = {NULL, 0, 0};
+    char *image = NULL;
+    size_t len;
+
+    // the log describes the old file, make it durable and empty the log
+    if (wal_checkpoint(fd, true) != NO_ERROR)
+    {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    // keep changes out until the new file replaced the old one
+    if (lock_current(fd) != NO_ERROR)
+    {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    // hash files scan in bucket order, old style files in slot order
+    int rc = walk_students(fd, collect_student, &list);
+    if (rc == NO_ERROR)
+    {
+        qsort(list.students, list.n, sizeof(student_t), cmp_student_id);
+        // a new generation makes the indexes of the old file stale
+        rc = pack_encode(list.students, list.n, db_gen() + 1, &image, &len);
+    }
+    free(list.students);
+    if (rc != NO_ERROR)
+    {
+        lock_db(fd, F_UNLCK);
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    rc = replace_db(image, len);
+    free(image);
+    lock_db(fd, F_UNLCK);
+    if (rc != NO_ERROR)
+        return ERR_DB_FILE;
+
+    // the bitmap and hash directory belong to the old layout
+    char path[PATH_MAX];
+    close_db(fd);
+    unlink(db_path(path, "", DB_BITMAP_SUFFIX));
+    unlink(db_path(path, "", DB_HDIR_SUFFIX));
+    journal_remove(db_file);
+
+    fd = open_db(db_file, false);
+    if (fd < 0)
+        return ERR_DB_FILE;
+
+    printf(M_DB_PACKED_OK, list.n, (long)len);
+    return fd;
+}
+
+/*
+ *  compact_online
+ *      fd:     linux file descriptor
+ *      steps:  stop after this many steps, 0 runs the compaction to the end
+ *
+ *  compress_db() rewrites the whole file with everyone else locked out.
+ *  This compacts a direct-slot file into the same layout (DB_FLAG_COMPACT)
+ *  in place instead, COMPACT_STEP_SLOTS students at a time.  Each step
+ *  write locks the whole file only while it moves its students, adds,
+ *  deletes and scans of other processes run between the steps.
  *
+ *  While the compaction runs the header is flagged DB_FLAG_COMPACTING and
+ *  records how far it got: the students with an id below compact_next are
+ *  packed in id order from slot 1 up to compact_end, the students from
+ *  compact_next on are still at their own slot, and the slots in between
+ *  are a hole (see next_extent).  Lookups and changes handle both halves
+ *  (see locate_student and compacting_store).  A step packs the next
+ *  students after compact_end.  Since they can land on slots the step
+ *  reads from, the step is written to the journal (see sdb_journal.c)
+ *  before it starts and done again by the next open_db() if it was cut
+ *  short.  The progress is in the header, so an interrupted compaction
+ *  continues where it stopped when -X is run again.  The last step
+ *  truncates the file behind the packed students and flags it
+ *  DB_FLAG_COMPACT.
+ *
+ *  Files that are already compact, packed or use the hash layout are left
+ *  alone, files without a header can only be compacted by compress_db().
+ *
+ *  returns:  NO_ERROR       compaction finished, or paused after steps
+ *            ERR_DB_OP      the file has no header
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  M_DB_COMPACTED     compaction finished, with the students moved
+ *            M_DB_COMPACT_STEP  paused after steps, with the students moved
+ *            M_DB_IS_COMPACT    the file is compacted or packed already
+ *            M_DB_HASH_COMPACT  hash files are compact by design
+ *            M_DB_NO_HEADER     the file has no header
+ *            M_ERR_DB_WRITE     error writing the database file or journal
  */
-int validate_range(int id, int gpa)
+int compact_online(int fd, int steps)
 {
+    int moved = 0;
+    int rc = NO_ERROR;
+    bool done = false;
 
-    if ((id < MIN_STD_ID) || (id > MAX_STD_ID))
-        return EXIT_FAIL_ARGS;
+    for (int n = 0; !done && (steps <= 0 || n < steps); n++)
+    {
+        // let changes waiting for the lock in between steps
+        if (n > 0)
+            sched_yield();
 
-    if ((gpa < MIN_STD_GPA) || (gpa > MAX_STD_GPA))
-        return EXIT_FAIL_ARGS;
+        if (lock_current(fd) != NO_ERROR || map_db(fd) != NO_ERROR)
+        {
+            lock_db(fd, F_UNLCK);
+            printf(M_ERR_DB_WRITE);
+            return ERR_DB_FILE;
+        }
+
+        int flags = db_map.flags;
+        if (!(flags & (DB_FLAG_DIRECT | DB_FLAG_COMPACTING)))
+        {
+            lock_db(fd, F_UNLCK);
+            if (flags & DB_FLAG_HASH)
+                printf(M_DB_HASH_COMPACT);
+            else if (flags & (DB_FLAG_COMPACT | DB_FLAG_PACKED))
+                printf(M_DB_IS_COMPACT);
+            else
+                printf(M_DB_NO_HEADER);
+            return flags ? NO_ERROR : ERR_DB_OP;
+        }
+
+        if (flags & DB_FLAG_DIRECT)
+            rc = compact_begin(fd);
+        else if (n == 0)
+            rc = compact_recover(db_file, fd);
+
+        if (rc == NO_ERROR)
+            rc = compact_step(fd, &moved, &done);
+        if (rc == NO_ERROR && done)
+            rc = compact_finish(fd);
+
+        lock_db(fd, F_UNLCK);
+        if (rc != NO_ERROR)
+        {
+            printf(M_ERR_DB_WRITE);
+            return ERR_DB_FILE;
+        }
+    }
+
+    printf(done ? M_DB_COMPACTED : M_DB_COMPACT_STEP, moved);
+    return NO_ERROR;
+}
+
+/*
+ *  compact_begin
+ *      fd:  linux file descriptor of a direct-slot file, write locked
+ *
+ *  Flags the file DB_FLAG_COMPACTING with nothing packed yet, once the
+ *  scans reading a snapshot of the file are done.  The occupancy bitmap is
+ *  of no use once students move, it is removed and the new generation
+ *  keeps other processes from trusting their copy.
+ *
+ *  returns:  NO_ERROR or ERR_DB_WRITE
+ */
+static int compact_begin(int fd)
+{
+    char path[PATH_MAX];
+
+    // records are about to move under the scans reading a snapshot
+    if (((const db_header_t *)db_map.base)->snapshots && snap_quiesce(db_file, fd) != NO_ERROR)
+        return ERR_DB_WRITE;
 
+    db_header_t hdr = *(const db_header_t *)db_map.base;
+
+    journal_remove(db_file);
+    close_sidecar(&db_bitmap);
+    unlink(db_path(path, "", DB_BITMAP_SUFFIX));
+
+    hdr.flags = DB_FLAG_COMPACTING;
+    hdr.gen = db_gen() + 1;
+    hdr.compact_next = 1;
+    hdr.compact_end = 1;
+    if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+        return ERR_DB_WRITE;
+
+    load_flags();
+    end_update(hdr.gen);
     return NO_ERROR;
 }
 
 /*
- *  usage
- *      exename:  the name of the executable from argv[0]
+ *  compact_step
+ *      fd:     linux file descriptor of a file being compacted, write
+ *              locked
+ *      moved:  incremented by the number of students packed
+ *      done:   set to true when every student is packed
+ *
+ *  Packs the next COMPACT_STEP_SLOTS students from compact_next on behind
+ *  the packed ones, see compact_online().
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE or ERR_DB_WRITE
+ */
+static int compact_step(int fd, int *moved, bool *done)
+{
+    int first, nslots;
+    const student_t *rec = db_records(fd, &first, &nslots);
+    if (nslots < 0)
+        return ERR_DB_FILE;
+
+    student_t *batch = malloc(COMPACT_STEP_SLOTS * sizeof(student_t));
+    if (batch == NULL)
+        return ERR_DB_FILE;
+
+    const db_header_t *hdr = (const db_header_t *)rec;
+    compact_step_t step = {hdr->compact_next, hdr->compact_end, 0, 0, 0};
+
+    int i = step.next;
+    for (int end; step.count < COMPACT_STEP_SLOTS && next_extent(fd, nslots, &i, &end); )
+    {
+        for (i += scan_next_used(&rec[i], end - i); i < end && step.count < COMPACT_STEP_SLOTS;
+             i += 1 + scan_next_used(&rec[i + 1], end - i - 1))
+            batch[step.count++] = rec[i];
+    }
+
+    // a full batch stops at the next student, otherwise the file is done
+    if (step.count == COMPACT_STEP_SLOTS)
+        step.new_next = i;
+    else
+        step.new_next = (step.next > nslots) ? step.next : nslots;
+    step.new_end = step.end + step.count;
+
+    int rc = NO_ERROR;
+    if (step.count > 0)
+        rc = journal_step(db_file, &step, batch);
+    if (rc == NO_ERROR)
+        rc = apply_step(fd, &step, batch);
+    free(batch);
+
+    *moved += step.count;
+    *done = step.new_next >= nslots;
+    return rc;
+}
+
+/*
+ *  apply_step
+ *      fd:    linux file descriptor of a file being compacted, write locked
+ *      step:  the step
+ *      rec:   the step->count students it packs
  *
- *  Prints this programs expected usage
+ *  Writes the students from slot step->end on, then records the progress
+ *  in the header.  Both are synced, the journal only protects the step
+ *  until the next one replaces it.  The slots the students were moved out
+ *  of are punched out of the file.
  *
- *  returns:    nothing, this is a void function
+ *  returns:  NO_ERROR or ERR_DB_WRITE
+ */
+static int apply_step(int fd, const compact_step_t *step, const student_t *rec)
+{
+    size_t len = (size_t)step->count * STUDENT_RECORD_SIZE;
+
+    if (pwrite(fd, rec, len, (off_t)step->end * STUDENT_RECORD_SIZE) != (ssize_t)len ||
+        fdatasync(fd) == -1 ||
+        set_progress(fd, step->new_next, step->new_end) != NO_ERROR ||
+        fdatasync(fd) == -1)
+        return ERR_DB_WRITE;
+
+    // a file system that cannot punch holes keeps the slots, they read as a
+    // hole all the same
+    if (step->new_next > step->new_end)
+        fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  (off_t)step->new_end * STUDENT_RECORD_SIZE,
+                  (off_t)(step->new_next - step->new_end) * STUDENT_RECORD_SIZE);
+    return NO_ERROR;
+}
+
+/*
+ *  compact_finish
+ *      fd:  linux file descriptor of a file whose students are all packed,
+ *           write locked
  *
- *  console:  This function prints the usage information
+ *  Cuts the file off behind the packed students and flags it
+ *  DB_FLAG_COMPACT.  The students did not change, so the sidecar indexes
+ *  still match.
  *
+ *  returns:  NO_ERROR or ERR_DB_WRITE
  */
-void usage(char *exename)
+static int compact_finish(int fd)
 {
-    printf("usage: %s -[h|a|c|d|f|p|z] options.  Where:\n", exename);
-    printf("\t-h:  prints help\n");
-    printf("\t-a id first_name last_name gpa(as 3 digit int):  adds a student\n");
-    printf("\t-c:  counts the records in the database\n");
-    printf("\t-d id:  deletes a student\n");
-    printf("\t-f id:  finds and prints a student in the database\n");
-    printf("\t-p:  prints all records in the student database\n");
-    printf("\t-x:  compress the database file [EXTRA CREDIT]\n");
-    printf("\t-z:  zero db file (remove all records)\n");
+    db_header_t hdr = *(const db_header_t *)db_map.base;
+
+    if (ftruncate(fd, (off_t)hdr.compact_end * STUDENT_RECORD_SIZE) == -1)
+        return ERR_DB_WRITE;
+
+    hdr.flags = DB_FLAG_COMPACT;
+    hdr.compact_next = 0;
+    hdr.compact_end = 0;
+    if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || fdatasync(fd) == -1)
+        return ERR_DB_WRITE;
+
+    map_db(fd);
+    journal_remove(db_file);
+    return NO_ERROR;
 }
 
-// Welcome to main()
-int main(int argc, char *argv[])
+/*
+ *  compact_recover
+ *      dbFile:  name of the database file
+ *      fd:      linux file descriptor of a file being compacted
+ *
+ *  Does the step in the journal again if it is the one the progress in the
+ *  header stops at, the compaction was then interrupted during the step.
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE or ERR_DB_WRITE
+ */
+static int compact_recover(const char *dbFile, int fd)
 {
-    char opt;      // user selected option
-    int fd;        // file descriptor of database files
-    int rc;        // return code from various operations
-    int exit_code; // exit code to shell
-    int id;        // userid from argv[2]
-    int gpa;       // gpa from argv[5]
+    compact_step_t step;
+    student_t *rec;
 
-    // space for a student structure which we will get back from
-    // some of the functions we will be writing such as get_student(),
-    // and print_student().
-    student_t student = {0};
+    if (lock_db(fd, F_WRLCK) != NO_ERROR)
+        return ERR_DB_FILE;
 
-    // This function must have at least one arg, and the arg must start
-    // with a dash
-    if ((argc < 2) || (*argv[1] != '-'))
+    int rc = NO_ERROR;
+    const db_header_t *hdr = (const db_header_t *)db_map.base;
+    load_flags();
+    if (db_map.flags & DB_FLAG_COMPACTING)
     {
-        usage(argv[0]);
-        exit(1);
+        rc = journal_load(dbFile, &step, &rec);
+        if (rc == NO_ERROR)
+        {
+            if (step.next == hdr->compact_next && step.end == hdr->compact_end)
+                rc = apply_step(fd, &step, rec);
+            free(rec);
+        }
+        else if (rc == SRCH_NOT_FOUND)
+        {
+            rc = NO_ERROR;
+        }
     }
 
-    // The option is the first character after the dash for example
-    //-h -a -c -d -f -p -x -z
-    opt = (char)*(argv[1] + 1); // get the option flag
+    lock_db(fd, F_UNLCK);
+    return rc;
+}
+
+/*
+ *  punch_db
+ *      fd:  linux file descriptor
+ *
+ *  Releases the storage of every block of PUNCH_SLOTS slots that holds no
+ *  student, for files whose deletes left empty blocks behind before
+ *  deletes punched them (see punch_block), or written by older versions.
+ *  Runs of empty blocks are punched with one fallocate() each.  The whole
+ *  file is write locked for the pass.  Compacted and hash files have no
+ *  empty blocks, nor have packed files.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  M_DB_PUNCHED    on success, with the number of blocks released
+ *            M_DB_IS_COMPACT the file is packed
+ *            M_ERR_DB_READ   error reading the database file
+ *            M_ERR_DB_WRITE  the file system cannot punch holes
+ */
+int punch_db(int fd)
+{
+    int first, nslots;
+    int punched = 0;
+    int rc = NO_ERROR;
 
-    // handle the help flag and then exit normally
-    if (opt == 'h')
+    if (lock_current(fd) != NO_ERROR)
     {
-        usage(argv[0]);
-        exit(EXIT_OK);
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
     }
 
-    // now lets open the file and continue if there is no error
-    // note we are not truncating the file using the second
-    // parameter
-    fd = open_db(DB_FILE, false);
-    if (fd < 0)
+    // a packed file has no empty slots
+    if (is_packed(fd))
     {
-        exit(EXIT_FAIL_DB);
+        lock_db(fd, F_UNLCK);
+        printf(M_DB_IS_COMPACT);
+        return NO_ERROR;
     }
 
-    // set rc to the return code of the operation to ensure the program
-    // use that to determine the proper exit_code.  Look at the header
-    // sdbsc.h for expected values.
+    const student_t *rec = db_records(fd, &first, &nslots);
+    if (nslots < 0)
+    {
+        lock_db(fd, F_UNLCK);
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
 
-    exit_code = EXIT_OK;
-    switch (opt)
+    // whole blocks of each data extent, the partial block at the end of
+    // the file is left alone
+    for (int i = 0, end; rc == NO_ERROR && next_extent(fd, nslots, &i, &end); i = end)
     {
-    case 'a':
-        //   arv[0] arv[1]  arv[2]      arv[3]    arv[4]  arv[5]
-        // prog_name     -a      id  first_name last_name     gpa
-        //-------------------------------------------------------
-        // example:  prog_name -a 1 John Doe 341
-        if (argc != 6)
+        int run = 0;
+        int b = (i + PUNCH_SLOTS - 1) / PUNCH_SLOTS;
+
+        for (; (b + 1) * PUNCH_SLOTS <= end; b++)
         {
-            usage(argv[0]);
-            exit_code = EXIT_FAIL_ARGS;
-            break;
+            if (scan_next_used(&rec[b * PUNCH_SLOTS], PUNCH_SLOTS) == PUNCH_SLOTS)
+            {
+                run++;
+                continue;
+            }
+            if (run > 0 && fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                                     (off_t)(b - run) * PUNCH_SLOTS * STUDENT_RECORD_SIZE,
+                                     (off_t)run * PUNCH_SLOTS * STUDENT_RECORD_SIZE) == -1)
+                rc = ERR_DB_WRITE;
+            punched += run;
+            run = 0;
         }
+        if (run > 0 && rc == NO_ERROR &&
+            fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                      (off_t)(b - run) * PUNCH_SLOTS * STUDENT_RECORD_SIZE,
+                      (off_t)run * PUNCH_SLOTS * STUDENT_RECORD_SIZE) == -1)
+            rc = ERR_DB_WRITE;
+        punched += run;
+    }
 
-        // convert id and gpa to ints from argv.  For this assignment assume
-        // they are valid numbers
-        id = atoi(argv[2]);
-        gpa = atoi(argv[5]);
+    lock_db(fd, F_UNLCK);
 
-        exit_code = validate_range(id, gpa);
-        if (exit_code == EXIT_FAIL_ARGS)
-        {
-            printf(M_ERR_STD_RNG);
-            break;
-        }
+    if (rc != NO_ERROR)
+    {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
 
-        rc = add_student(fd, id, argv[3], argv[4], gpa);
-        if (rc < 0)
-            exit_code = EXIT_FAIL_DB;
+    printf(M_DB_PUNCHED, punched);
+    return NO_ERROR;
+}
 
-        break;
+/*
+ *  validate_range
+ *      id:  proposed student id
+ *      gpa: proposed gpa
+ *
+ *  This function validates that the id and gpa are in the allowable ranges
+ *  as per the specifications.  It checks if the values are within the
+ *  inclusive range using constents in db.h, ids up to MAX_HASH_STD_ID are
+ *  valid in an open hash file, or when no database is open
+ *
+ *  returns:    NO_ERROR       on success, both ID and GPA are in range
+ *              EXIT_FAIL_ARGS if either ID or GPA is out of range
+ *
+ *  console:  This function does not produce any output
+ *
+ */
+int validate_range(int id, int gpa)
+{
+    // hash files are not addressed by id, they take 9 digit ids.  A client
+    // of a server has no file open, the server checks the id again against
+    // the layout of its file
+    int max_id = (db_map.fd == -1 || (db_map.flags & DB_FLAG_HASH)) ? MAX_HASH_STD_ID : MAX_STD_ID;
 
-    case 'c':
-        //    arv[0] arv[1]
-        // prog_name     -c
-        //-----------------
-        // example:  prog_name -c
-        rc = count_db_records(fd);
-        if (rc < 0)
-            exit_code = EXIT_FAIL_DB;
-        break;
+    if ((id < MIN_STD_ID) || (id > max_id))
+        return EXIT_FAIL_ARGS;
 
-    case 'd':
-        //   arv[0]  arv[1]  arv[2]
-        // prog_name     -d      id
-        //-------------------------
-        // example:  prog_name -d 100
-        if (argc != 3)
-        {
-            usage(argv[0]);
-            exit_code = EXIT_FAIL_ARGS;
-            break;
-        }
-        id = atoi(argv[2]);
-        rc = del_student(fd, id);
-        if (rc < 0)
-            exit_code = EXIT_FAIL_DB;
+    if ((gpa < MIN_STD_GPA) || (gpa > MAX_STD_GPA))
+        return EXIT_FAIL_ARGS;
 
-        break;
+    return NO_ERROR;
+}
 
-    case 'f':
-        //    arv[0] arv[1]  arv[2]
-        // prog_name     -f      id
-        //-------------------------
-        // example:  prog_name -f 100
-        if (argc != 3)
-        {
-            usage(argv[0]);
-            exit_code = EXIT_FAIL_ARGS;
-            break;
-        }
-        id = atoi(argv[2]);
-        rc = get_student(fd, id, &student);
+// name of the database file open_db() opened last, the server reopens the
+// file under it (DB_FILE until then)
+const char *db_name(void)
+{
+    return db_file;
+}
 
-        switch (rc)
-        {
-        case NO_ERROR:
-            print_student(&student);
-            break;
-        case SRCH_NOT_FOUND:
-            printf(M_STD_NOT_FND_MSG, id);
-            exit_code = EXIT_FAIL_DB;
-            break;
-        default:
-            printf(M_ERR_DB_READ);
-            exit_code = EXIT_FAIL_DB;
-            break;
-        }
-        break;
-
-    case 'p':
-        //    arv[0] arv[1]
-        // prog_name     -p
-        //-----------------
-        // example:  prog_name -p
-        rc = print_db(fd);
-        if (rc < 0)
-            exit_code = EXIT_FAIL_DB;
-        break;
-
-    case 'x':
-        //    arv[0] arv[1]
-        // prog_name     -x
-        //-----------------
-        // example:  prog_name -x
-
-        // remember compress_db returns a fd of the compressed database.
-        // we close it after this switch statement
-        fd = compress_db(fd);
-        if (fd < 0)
-            exit_code = EXIT_FAIL_DB;
-        break;
-
-    case 'z':
-        //    arv[0] arv[1]
-        // prog_name     -x
-        //-----------------
-        // example:  prog_name -x
-        // HINT:  close the db file, we already have fd
-        //       and reopen db indicating truncate=true
-        close(fd);
-        fd = open_db(DB_FILE, true);
-        if (fd < 0)
-        {
-            exit_code = EXIT_FAIL_DB;
-            break;
-        }
-        printf(M_DB_ZERO_OK);
-        exit_code = EXIT_OK;
-        break;
-    default:
-        usage(argv[0]);
-        exit_code = EXIT_FAIL_ARGS;
-    }
+/*
+ *  db_layout / set_remote_layout / wide_ids
+ *      flags:  DB_FLAG_* of the file a server has open, from its replies
+ *
+ *  The tables of a hash file get the 9 digit ID column of
+ *  STUDENT_PRINT_WIDE_FMT_STRING.  A client prints the students a server
+ *  sends, so the server passes the layout of its file along with every
+ *  reply (see sdb_response_t) and the client's tables follow it.
+ *
+ *  returns:  db_layout() the flags of the open file, wide_ids() true if
+ *            the tables need the wide ID column
+ */
+int db_layout(void)
+{
+    return db_map.flags;
+}
 
-    // dont forget to close the file before exiting, and setting the
-    // proper exit code - see the header file for expected values
-    close(fd);
-    exit(exit_code);
+void set_remote_layout(int flags)
+{
+    remote_flags = flags;
+}
+
+bool wide_ids(void)
+{
+    return ((db_map.flags | remote_flags) & DB_FLAG_HASH) != 0;
 }
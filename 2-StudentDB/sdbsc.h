@@ -1,30 +1,378 @@
 #ifndef __SDB_H__
+#define __SDB_H__
 
 #include "db.h" //get student record type
 
+//memory mapped view of the database file, see map_db()
+typedef struct db_map {
+    int     fd;         //file descriptor the mapping belongs to
+    char   *base;       //start of the mapping, NULL if the file is empty
+    size_t  len;        //bytes mapped, always the file size after map_db()
+    int     flags;      //DB_FLAG_* from the file header, 0 if no header
+} db_map_t;
+
 //prototypes for functions go below for this assignment
-int open_db(char *dbFile, bool should_truncate);
+int open_db(const char *dbFile, bool should_truncate);
+int open_store(const char *dbFile, bool should_truncate);
+int close_db(int fd);
+int map_db(int fd);
+void unmap_db(void);
+int locate_student(int fd, int id, student_t *s, off_t *offset);
+int write_db_header(int fd, int flags);
+int truncate_db(int fd, int flags);
+
+//sidecar files hold data derived from the database, see sdb_sidecar.c
+typedef struct sidecar {
+    int     fd;
+    char   *base;       //mapping of the whole file, starts with the header
+    size_t  len;
+} sidecar_t;
+
+typedef struct sidecar_header {
+    int magic;
+    unsigned int gen;   //db_header_t.gen the contents match
+    int count;          //entries that follow, where the sidecar has entries
+    char reserved[52];
+} sidecar_header_t;
+
+#define SIDECAR_STALE   (~0u)   //a gen no database has, forces a rebuild
+
+#define sidecar_header(sc)  ((sidecar_header_t *)(sc)->base)
+
+int open_sidecar(sidecar_t *sc, const char *dbFile, const char *suffix,
+                 int magic, size_t min_len, bool create);
+int grow_sidecar(sidecar_t *sc, size_t len);
+void close_sidecar(sidecar_t *sc);
+unsigned int sidecar_gen(sidecar_t *sc);
+void set_sidecar_gen(sidecar_t *sc, unsigned int gen);
+void advance_sidecar_gen(sidecar_t *sc, unsigned int gen);
+
+//occupancy bitmap sidecar, see sdb_bitmap.c
+extern sidecar_t db_bitmap;
+int open_bitmap(const char *dbFile);
+void bitmap_clear_all(void);
+void bitmap_set(int id);
+void bitmap_clear(int id);
+int bitmap_count(void);
+int bitmap_next(int id);
+
+//extendible hash layout, see sdb_hash.c
+#define HASH_PAGE_SLOTS 64                  //records per bucket page (4KB)
+#define SDB_LAYOUT_ENV  "SDBSC_LAYOUT"      //"hash" picks the layout of new files
+
+extern sidecar_t db_hdir;
+int open_hash(const char *dbFile, int fd, unsigned int gen);
+int hash_sync(void);
+bool hash_owns(int slot, int id);
+int hash_locate(int fd, int id, student_t *s, off_t *offset);
+int hash_store(int fd, const student_t *s);
+
+//packed archive layout, see sdb_pack.c
+int pack_encode(const student_t *students, int n, unsigned int gen, char **image, size_t *len);
+int pack_count(const char *base, size_t len);
+int pack_find(const char *base, size_t len, int id, student_t *s);
+int pack_scan(const char *base, size_t len, int (*visit)(const student_t *, void *), void *arg);
+
+//block cache for lookups, see sdb_cache.c
+#define CACHE_BLOCK_SLOTS   64              //records per cached block (4KB)
+#define SDB_CACHE_ENV       "SDBSC_CACHE"   //blocks the server caches, 0 (default) for none
+
+int cache_init(int nblocks);
+bool cache_enabled(void);
+void cache_clear(void);
+const student_t *cache_find(int block, unsigned int gen);
+const student_t *cache_fill(int fd, int block, unsigned int gen);
+void cache_stats(long *hits, long *misses);
+
+//batched positioned reads for multi-gets, see sdb_uring.c
+#define READ_BATCH_MAX  256             //reads submitted to the kernel at once
+#define SDB_IO_ENV      "SDBSC_IO"      //"pread" turns io_uring batches off
+
+typedef struct read_req {
+    void *buf;
+    size_t len;
+    off_t offset;
+    ssize_t bytes;          //set by read_batch(), as pread() returns it
+} read_req_t;
+
+int read_batch(int fd, read_req_t *reqs, int n);
+
+//change data capture log and followers, see sdb_cdc.c
+#define CDC_BATCH_RECORDS   1024        //changes a follower reads and applies at once
+#define CDC_POLL_MS         100         //a follower at the end of the log waits this long
+
+int open_cdc(const char *dbFile, bool truncate);
+int start_cdc(const char *dbFile, int fd);
+void close_cdc(void);
+int cdc_log(int op, const student_t *s, int n);
+int cdc_sync(void);
+int follow_log(const char *logFile, const char *replica, bool once);
+
+//online compaction step journal, see sdb_journal.c and compact_online()
+#define COMPACT_STEP_SLOTS  4096        //students moved per compaction step (256KB)
+
+typedef struct compact_step {
+    int next, end;          //db_header_t compact_next/compact_end before the step
+    int new_next, new_end;  //and after it
+    int count;              //students written from slot end on
+} compact_step_t;
+
+int journal_step(const char *dbFile, const compact_step_t *step, const student_t *rec);
+int journal_load(const char *dbFile, compact_step_t *step, student_t **rec);
+void journal_remove(const char *dbFile);
+
+//snapshot readers, see sdb_snapshot.c
+#define SNAP_BLOCK_SLOTS    64              //records per saved block (4KB)
+
+typedef struct snapshot {
+    const student_t *rec;   //the mapped record array when it was taken
+    int first;              //first slot that can hold a student
+    int nslots;             //slots of the file when it was taken
+    unsigned int gen;       //db_header_t.gen it sees
+} snapshot_t;
+
+typedef struct snap_cursor {
+    const snapshot_t *snap;
+    int seen;               //saved blocks looked at so far
+    int *saved;             //per block of the snapshot, its saved copy or -1
+} snap_cursor_t;
+
+extern sidecar_t db_snap;
+int snap_begin(const char *dbFile, int fd, snapshot_t *snap);
+void snap_end(int fd);
+int snap_save(const char *dbFile, int fd, int slot, int nslots);
+int snap_quiesce(const char *dbFile, int fd);
+int snap_cursor_init(snap_cursor_t *cur, const snapshot_t *snap);
+void snap_cursor_free(snap_cursor_t *cur);
+const student_t *snap_block(snap_cursor_t *cur, int block, student_t *buf);
+
+//name index sidecar, see sdb_names.c
+extern sidecar_t db_names;
+int open_names(const char *dbFile);
+int names_load(student_t *students, int n);
+int names_insert(const student_t *s);
+void names_remove(const student_t *s);
+int names_search(const char *prefix, int (*visit)(const student_t *, void *), void *arg);
+int cmp_student_name(const void *a, const void *b);
+
+//gpa range index sidecar, see sdb_gpa.c
+extern sidecar_t db_gpa;
+int open_gpa(const char *dbFile);
+int gpa_load(const student_t *students, int n);
+int gpa_insert(const student_t *s);
+void gpa_remove(const student_t *s);
+int gpa_range(int lo, int hi, int (*visit)(int, void *), void *arg);
+
+//record locks, see sdb_lock.c
+int lock_range(int fd, int type, off_t start, off_t len);
+int lock_db(int fd, int type);
+int lock_byte(int fd, int type, off_t start, bool wait);
+int lock_depth(void);
+#define lock_student(fd, id, type) \
+    lock_range(fd, type, (off_t)(id) * STUDENT_RECORD_SIZE, STUDENT_RECORD_SIZE)
+#define lock_header(fd, type) \
+    lock_range(fd, type, 0, STUDENT_RECORD_SIZE)
+
+//write-ahead log, see sdb_wal.c
+#define WAL_SYNC                0       //a change returns once it is logged on disk
+#define WAL_LAZY                1       //the log reaches the disk with a later sync
+#define SDB_DURABILITY_ENV      "SDBSC_DURABILITY"  //"sync" (default) or "lazy"
+#define WAL_CHECKPOINT_BYTES    (1 << 20)           //log size that triggers a checkpoint
+
+int open_wal(const char *dbFile, int fd, bool truncate);
+void close_wal(void);
+void wal_begin(void);
+int wal_log(int op, const student_t *s);
+void wal_end(int fd);
+int wal_checkpoint(int fd, bool wait);
+void set_durability(int durability);
+int get_durability(void);
+int parse_durability(const char *name);
+
+//record scan kernels with runtime cpu dispatch, see sdb_scan.c
+#define SDB_SCAN_ENV    "SDBSC_SCAN"    //"scalar" or "sse2" forces a kernel set
+
+int scan_count_ids(const student_t *rec, int n);
+int scan_find_id(const student_t *rec, int n, int id);
+int scan_next_used(const student_t *rec, int n);
+
+//parallel scans, see sdb_parallel.c
+#define SDB_THREADS_ENV "SDBSC_THREADS" //number of scan threads, 1 scans serially
+
+int scan_threads(void);
+int scan_parts(int nslots);
+int run_parts(int parts, int first, int nslots,
+              int (*work)(int part, int lo, int hi, void *arg), void *arg);
+
+//table formatter for print_db, see sdb_format.c
+#define TABLE_BUF_SIZE  (256 * 1024)    //bytes per write()
+
+typedef struct table_buf {
+    char *buf;
+    size_t len;
+    size_t cap;
+    int rows;               //rows appended by table_row()
+    int fd;                 //written to when full, -1 keeps it in memory
+    bool wide;              //9 digit ID column, see wide_ids()
+} table_buf_t;
+
+void table_init(table_buf_t *tb, int fd);
+int table_header(table_buf_t *tb);
+int table_row(const student_t *s, void *arg);
+int table_append(table_buf_t *tb, const char *data, size_t len);
+int table_flush(table_buf_t *tb);
+void table_free(table_buf_t *tb);
+
+//external merge sort for ordered prints, see sdb_sort.c
+#define SDB_SORT_MEM_ENV    "SDBSC_SORT_MEM"    //sort memory budget in KB
+#define SORT_BY_LNAME       1                   //last name, first name, id
+#define SORT_BY_GPA         2                   //gpa, id
+
+typedef struct sort_run {
+    off_t start;            //file offset of its first student
+    long count;
+} sort_run_t;
+
+typedef struct xsort {
+    int (*cmp)(const void *, const void *);
+    student_t *buf;         //students not written to a run yet
+    int nbuf;
+    int cap;                //students that fit the budget
+    size_t budget;          //bytes
+    char *path;             //mkstemp() template of the temporary file
+    int fd;                 //temporary file, -1 until the first run
+    off_t end;              //of the temporary file
+    sort_run_t *runs;
+    int nruns;
+    int runs_cap;
+} xsort_t;
+
+int sort_init(xsort_t *xs, int (*cmp)(const void *, const void *), const char *path);
+int sort_add(const student_t *s, void *arg);
+int sort_finish(xsort_t *xs, int (*visit)(const student_t *, void *), void *arg);
+void sort_free(xsort_t *xs);
+
+//columnar shadow sidecar and gpa analytics, see sdb_columns.c
+#define GPA_HIST_WIDTH      50      //gpa points per histogram bucket
+#define GPA_HIST_BUCKETS    (MAX_STD_GPA / GPA_HIST_WIDTH)
+
+typedef struct gpa_stats {
+    int count;
+    long long sum;
+    int min;
+    int max;
+    int hist[GPA_HIST_BUCKETS];
+} gpa_stats_t;
+
+extern sidecar_t db_cols;
+int open_columns(const char *dbFile, bool create);
+int columns_load(const student_t *students, int n);
+void columns_insert(const student_t *s);
+void columns_remove(const student_t *s);
+const int *columns_gpa(int *n);
+void gpa_stats(const int *gpas, int n, gpa_stats_t *st);
+
 int add_student(int fd, int id, char *fname, char *lname, int gpa);
 int get_student(int fd, int id, student_t *s);
+int get_students(int fd, const int *ids, int n, student_t *s, int *rcs);
 int del_student(int fd, int id);
+int insert_student(int fd, const student_t *s);
+int store_student(int fd, const student_t *s);
+int remove_student(int fd, int id);
+int erase_student(int fd, const student_t *student, off_t offset);
+int replay_student(int fd, int op, const student_t *s);
+int count_students(int fd);
+int scan_students(int fd, int (*visit)(const student_t *, void *), void *arg);
+int print_db_row(const student_t *s, void *arg);
+int search_names(int fd, char *prefix);
+int query_gpa_range(int fd, int lo, int hi);
+int analyze_db(int fd);
+int bulk_load(int fd, FILE *fp);
 int compress_db(int fd);
+int pack_db(int fd);
+int punch_db(int fd);
+int compact_online(int fd, int steps);
 void print_student(student_t *s);
 int validate_range(int id, int gpa);
+const char *db_name(void);
+int db_layout(void);
+void set_remote_layout(int flags);
+bool wide_ids(void);
 int count_db_records(int fd);
 int print_db(int fd);
+int print_sorted(int fd, int order);
 void usage(char *);
 
+//server mode, see sdb_server.c and sdb_client.c.  The server keeps the
+//database open and answers requests from clients on a unix domain socket.
+//A request is one sdb_request_t, the reply is a sequence of frames, each a
+//sdb_response_t followed by nrecords student_t records.  The last frame has
+//no records and carries the result: one of the error codes below, or the
+//number of students for SDB_OP_COUNT.  The op codes are the matching
+//command line options.
+typedef struct sdb_request {
+    int op;                 //SDB_OP_*
+    int durability;         //WAL_SYNC or WAL_LAZY for SDB_OP_ADD and SDB_OP_DEL
+    student_t student;      //student to add, or just the id to get/delete
+} sdb_request_t;
+
+typedef struct sdb_response {
+    int rc;                 //result code, see above
+    int nrecords;           //student_t records following this header
+    int flags;              //DB_FLAG_* of the server's file, for the tables
+} sdb_response_t;
+
+#define SDB_OP_ADD          'a'
+#define SDB_OP_COUNT        'c'
+#define SDB_OP_DEL          'd'
+#define SDB_OP_GET          'f'
+#define SDB_OP_PRINT        'p'
+#define SDB_OP_ZERO         'z'
+
+#define SDB_SOCKET_PATH     "student.sock"  //default server socket
+#define SDB_SOCKET_ENV      "SDBSC_SOCKET"  //when set, forward to this server
+#define SDB_FRAME_RECORDS   1024            //students per reply frame (64K)
+#define SDB_LISTEN_BACKLOG  64
+#define SDB_MAX_CLIENTS     64              //connections served at a time
+#define SDB_IO_TIMEOUT_MS   2000            //a stalled client is dropped
+
+int start_server(int *fd, const char *path);
+int boot_server(const char *path);
+int exec_client_request(int *fd, int sock, const sdb_request_t *req);
+int send_all(int sock, const void *buf, size_t len);
+int recv_all(int sock, void *buf, size_t len);
+int connect_server(const char *path);
+int remote_add_student(int sock, int id, char *fname, char *lname, int gpa);
+int remote_get_student(int sock, int id, student_t *s);
+int remote_del_student(int sock, int id);
+int remote_count_db_records(int sock);
+int remote_print_db(int sock);
+int remote_zero_db(int sock);
+
 //error codes to be returned from individual functions
 // NO_ERROR is returned if there are no errors
 // ERR_DB_FILE is returned if there is are any issues with the database file itself
 // ERR_DB_OP is returned if an operation did not work aka add or delete a student
 // SRCH_NOT_FOUND is returned if the student is not found (get_student, and del_student)
+// ERR_DB_WRITE is returned by insert_student and remove_student when writing
+//              the database file failed, the other functions report ERR_DB_FILE
+// ERR_DB_READONLY is returned by insert_student and remove_student for a
+//              packed database file
 #define NO_ERROR        0
 #define ERR_DB_FILE     -1
 #define ERR_DB_OP       -2
 #define SRCH_NOT_FOUND  -3
+#define ERR_DB_WRITE    -4
+#define ERR_DB_READONLY -5
+#define ERR_SDB_COMM    -50     //server mode communication errors
 #define NOT_IMPLEMENTED_YET 0
 
+//bulk loads read and write this many record slots per batch (1MB)
+#define BULK_BATCH_SLOTS    16384
+
+//deletes release a block of this many empty slots (4KB) to the file system
+#define PUNCH_SLOTS         64
+
 
 //error codes to be returned to the shell
 // EXIT_OK          program executed without error
@@ -44,14 +392,40 @@ void usage(char *);
 #define M_ERR_DB_WRITE    "Error writing DB file, exiting!\n"
 #define M_ERR_DB_ADD_DUP  "Cant add student with ID=%d, already exists in db.\n"
 #define M_ERR_STD_PRINT   "Cant print student. Student is NULL or ID is zero\n"
+#define M_ERR_BULK_OPEN   "Cant open roster file %s!\n"
+#define M_ERR_BULK_LINE   "Line %d: cant parse student record, skipped.\n"
+#define M_ERR_BULK_RNG    "Line %d: either ID or GPA out of allowable range, skipped.\n"
+#define M_ERR_BULK_MEM    "Out of memory loading roster, exiting!\n"
 
 #define M_STD_ADDED       "Student %d added to database.\n"
+#define M_BULK_LOADED     "%d student(s) loaded into database.\n"
 #define M_STD_DEL_MSG     "Student %d was deleted from database.\n"
 #define M_STD_NOT_FND_MSG "Student %d was not found in database.\n"
 #define M_DB_COMPRESSED_OK "Database successfully compressed!\n"
+#define M_DB_HASH_COMPACT "Database uses the hash layout, it is already compact.\n"
+#define M_DB_PUNCHED      "Released %d empty block(s) of the database file.\n"
+#define M_DB_COMPACTED    "Database compacted online, %d student(s) moved.\n"
+#define M_DB_COMPACT_STEP "Compaction paused after %d student(s) moved, run -X again to resume.\n"
+#define M_DB_IS_COMPACT   "Database is already compact.\n"
+#define M_DB_PACKED_OK    "Database successfully packed, %d student(s) in %ld bytes.\n"
+#define M_DB_PACKED_RO    "Database is packed and read only, expand it with -x first.\n"
+#define M_DB_NO_HEADER    "Database has no header, compress it with -x.\n"
 #define M_DB_ZERO_OK      "All database records removed!\n"
 #define M_DB_EMPTY        "Database contains no student records.\n"
+#define M_SRCH_NO_MATCH   "No students found with last name starting with %s.\n"
+#define M_RNG_NO_MATCH    "No students found with GPA between %d and %d.\n"
+#define M_GPA_STATS       "Students: %d  average GPA: %.2f  minimum GPA: %.2f  maximum GPA: %.2f\n"
+#define M_GPA_HIST_HDR    "GPA RANGE    STUDENTS\n"
+#define M_GPA_HIST_ROW    "%.2f-%.2f    %d\n"
+#define M_ERR_GPA_RNG     "Cant query, GPA range out of allowable range!\n"
 #define M_DB_RECORD_CNT   "Database contains %d student record(s).\n"
+#define M_SERVER_STARTED  "sdbsc server listening on %s\n"
+#define M_SERVER_STOPPED  "sdbsc server stopped.\n"
+#define M_ERR_SERVER      "Cant start server on %s, exiting!\n"
+#define M_ERR_CONNECT     "Cant connect to server on %s, exiting!\n"
+#define M_ERR_COMM        "Communication error with server, exiting!\n"
+#define M_CDC_FOLLOWED    "Replica %s is at change %lld, %d change(s) applied.\n"
+#define M_ERR_CDC_OPEN    "Cant follow change log %s!\n"
 #define M_NOT_IMPL        "The requested operation is not implemented yet!\n"
 
 //useful format strings for print students
@@ -61,4 +435,9 @@ void usage(char *);
 #define  STUDENT_PRINT_HDR_STRING   "%-6s %-24s %-32s %-3s\n"
 #define  STUDENT_PRINT_FMT_STRING   "%-6d %-24.24s %-32.32s %-3.2f\n"
 
+//hash files take ids up to MAX_HASH_STD_ID, their tables get a wider ID
+//column, see wide_ids()
+#define  STUDENT_PRINT_WIDE_HDR_STRING   "%-9s %-24s %-32s %-3s\n"
+#define  STUDENT_PRINT_WIDE_FMT_STRING   "%-9d %-24.24s %-32.32s %-3.2f\n"
+
 #endif
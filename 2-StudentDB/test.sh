@@ -0,0 +1,1017 @@
+#!/usr/bin/env bats
+
+# File: test.sh
+#
+# Tests for the student database.  Every test starts from an empty
+# student.db in the current directory.
+
+setup() {
+    rm -f student.db student.db.* .tmp_student.db
+}
+
+@test "Empty database counts zero records" {
+    run ./sdbsc -c
+
+    [ "$status" -eq 0 ]
+    [ "$output" = "Database contains no student records." ]
+}
+
+@test "Add and find a student" {
+    run ./sdbsc -a 1 john doe 345
+    [ "$status" -eq 0 ]
+    [ "$output" = "Student 1 added to database." ]
+
+    run ./sdbsc -f 1
+    [ "$status" -eq 0 ]
+    [ "${lines[1]}" = "1      john                     doe                              3.45" ]
+}
+
+@test "Adding a duplicate student fails" {
+    ./sdbsc -a 7 john doe 345
+
+    run ./sdbsc -a 7 jane doe 390
+    [ "$status" -eq 1 ]
+    [ "$output" = "Cant add student with ID=7, already exists in db." ]
+}
+
+@test "Out of range id or gpa is rejected" {
+    run ./sdbsc -a 100001 john doe 345
+    [ "$status" -eq 2 ]
+
+    run ./sdbsc -a 1 john doe 501
+    [ "$status" -eq 2 ]
+}
+
+@test "Delete removes a student" {
+    ./sdbsc -a 3 jane doe 390
+
+    run ./sdbsc -d 3
+    [ "$status" -eq 0 ]
+    [ "$output" = "Student 3 was deleted from database." ]
+
+    run ./sdbsc -f 3
+    [ "$status" -eq 1 ]
+    [ "$output" = "Student 3 was not found in database." ]
+
+    run ./sdbsc -d 3
+    [ "$status" -eq 1 ]
+}
+
+@test "Count and print see records across a sparse file" {
+    ./sdbsc -a 1 john doe 345
+    ./sdbsc -a 99999 jane smith 400
+    ./sdbsc -a 50000 bob jones 250
+
+    run ./sdbsc -c
+    [ "$output" = "Database contains 3 student record(s)." ]
+
+    run ./sdbsc -p
+    [ "$status" -eq 0 ]
+    [ "${#lines[@]}" -eq 4 ]
+    [ "${lines[1]}" = "1      john                     doe                              3.45" ]
+    [ "${lines[2]}" = "50000  bob                      jones                            2.50" ]
+    [ "${lines[3]}" = "99999  jane                     smith                            4.00" ]
+}
+
+@test "Zero removes all records" {
+    ./sdbsc -a 1 john doe 345
+
+    run ./sdbsc -z
+    [ "$status" -eq 0 ]
+
+    run ./sdbsc -p
+    [ "$output" = "Database contains no student records." ]
+}
+
+@test "New database files start with a header in slot 0" {
+    ./sdbsc -a 2 john doe 345
+
+    # magic "SDB1" followed by version 1 and the direct-slot flag
+    run bash -c "head -c 12 student.db | od -An -tx4 | tr -s ' '"
+    [ "$output" = " 53444231 00000001 00000001" ]
+
+    # the record still lives at id * 64
+    [ "$(stat -c %s student.db)" -eq 192 ]
+}
+
+@test "Files without a header fall back to scanning" {
+    # hand build an old style file: slot 0 empty, student 5 stored in slot 1
+    {
+        head -c 64 /dev/zero
+        printf '\x05\x00\x00\x00'
+        printf 'ann'; head -c 21 /dev/zero
+        printf 'lee'; head -c 29 /dev/zero
+        printf '\x2c\x01\x00\x00'
+    } > student.db
+
+    run ./sdbsc -f 5
+    [ "$status" -eq 0 ]
+    [ "${lines[1]}" = "5      ann                      lee                              3.00" ]
+
+    run ./sdbsc -d 5
+    [ "$status" -eq 0 ]
+
+    run ./sdbsc -c
+    [ "$output" = "Database contains no student records." ]
+}
+
+@test "Bulk load a roster from a file" {
+    printf '3,jane,doe,390\n1,john,doe,345\nbad line\n2,bob,jones,600\n' > roster.csv
+    ./sdbsc -a 4 ann lee 300
+
+    run ./sdbsc -b roster.csv
+    rm -f roster.csv
+    [ "$status" -eq 1 ]
+    [ "${lines[0]}" = "Line 3: cant parse student record, skipped." ]
+    [ "${lines[1]}" = "Line 4: either ID or GPA out of allowable range, skipped." ]
+    [ "${lines[2]}" = "2 student(s) loaded into database." ]
+
+    run ./sdbsc -c
+    [ "$output" = "Database contains 3 student record(s)." ]
+
+    # a header naming the columns is skipped quietly
+    printf 'id,fname,lname,gpa\n5,amy,lee,310\n6,bo,li,250\n' > roster.csv
+    run ./sdbsc -b roster.csv
+    rm -f roster.csv
+    [ "$status" -eq 0 ]
+    [ "$output" = "2 student(s) loaded into database." ]
+    run ./sdbsc -c
+    [ "$output" = "Database contains 5 student record(s)." ]
+}
+
+@test "Bulk load from stdin skips existing students" {
+    ./sdbsc -a 1 john doe 345
+
+    run ./sdbsc -b <<EOF
+1, john , doe , 345
+7, jane , doe , 390
+EOF
+    [ "$status" -eq 1 ]
+    [ "${lines[0]}" = "Cant add student with ID=1, already exists in db." ]
+    [ "${lines[1]}" = "1 student(s) loaded into database." ]
+
+    run ./sdbsc -f 7
+    [ "${lines[1]}" = "7      jane                     doe                              3.90" ]
+}
+
+@test "Server mode serves forwarded requests" {
+    ./sdbsc -S test.sock > /dev/null &
+    server=$!
+    for i in $(seq 50); do [ -S test.sock ] && break; sleep 0.1; done
+
+    export SDBSC_SOCKET=test.sock
+    run ./sdbsc -a 1 john doe 345
+    [ "$output" = "Student 1 added to database." ]
+    run ./sdbsc -a 1 john doe 345
+    [ "$status" -eq 1 ]
+    run ./sdbsc -f 1
+    [ "${lines[1]}" = "1      john                     doe                              3.45" ]
+    run ./sdbsc -c
+    [ "$output" = "Database contains 1 student record(s)." ]
+    run ./sdbsc -d 1
+    [ "$output" = "Student 1 was deleted from database." ]
+    run ./sdbsc -p
+    [ "$output" = "Database contains no student records." ]
+    unset SDBSC_SOCKET
+
+    kill $server
+    wait $server
+    [ ! -e test.sock ]
+}
+
+@test "Occupancy bitmap follows adds and deletes" {
+    ./sdbsc -a 1 john doe 345
+    ./sdbsc -a 64 jane doe 390
+    ./sdbsc -a 100000 bob jones 250
+    ./sdbsc -d 64
+    [ -f student.db.bitmap ]
+
+    run ./sdbsc -c
+    [ "$output" = "Database contains 2 student record(s)." ]
+
+    run ./sdbsc -p
+    [ "${#lines[@]}" -eq 3 ]
+    [ "${lines[2]}" = "100000 bob                      jones                            2.50" ]
+}
+
+@test "Missing or stale bitmap is rebuilt" {
+    ./sdbsc -a 1 john doe 345
+    ./sdbsc -a 2 jane doe 390
+    rm student.db.bitmap
+
+    run ./sdbsc -c
+    [ "$output" = "Database contains 2 student record(s)." ]
+
+    # a bitmap from another database does not match this one
+    cp student.db.bitmap saved.bitmap
+    ./sdbsc -z
+    cp saved.bitmap student.db.bitmap
+    rm saved.bitmap
+
+    run ./sdbsc -c
+    [ "$output" = "Database contains no student records." ]
+}
+
+@test "Scans jump over holes in files without a header" {
+    # old style sparse file with students 5 and 99999, nothing in between
+    record() {
+        printf "$1"; printf "$2"; head -c $((24 - ${#2})) /dev/zero
+        printf "$3"; head -c $((32 - ${#3})) /dev/zero; printf "$4"
+    }
+    record '\x05\x00\x00\x00' ann lee '\x2c\x01\x00\x00' |
+        dd of=student.db bs=64 seek=5 conv=notrunc status=none
+    record '\x9f\x86\x01\x00' bob ray '\xc8\x00\x00\x00' |
+        dd of=student.db bs=64 seek=99999 conv=notrunc status=none
+
+    run ./sdbsc -c
+    [ "$output" = "Database contains 2 student record(s)." ]
+
+    run ./sdbsc -p
+    [ "${lines[1]}" = "5      ann                      lee                              3.00" ]
+    [ "${lines[2]}" = "99999  bob                      ray                              2.00" ]
+
+    run ./sdbsc -f 99999
+    [ "$status" -eq 0 ]
+}
+
+@test "Compress packs the database and keeps it searchable" {
+    ./sdbsc -a 3 jane doe 390
+    ./sdbsc -a 99999 bob jones 250
+    ./sdbsc -a 50000 ann lee 300
+    ./sdbsc -a 7 john doe 345
+    ./sdbsc -d 50000
+
+    run ./sdbsc -x
+    [ "$status" -eq 0 ]
+    [ "$output" = "Database successfully compressed!" ]
+
+    # header plus three students
+    [ "$(stat -c %s student.db)" -eq 256 ]
+    [ ! -e .tmp_student.db ]
+
+    run ./sdbsc -f 99999
+    [ "${lines[1]}" = "99999  bob                      jones                            2.50" ]
+    run ./sdbsc -f 50000
+    [ "$status" -eq 1 ]
+
+    run ./sdbsc -c
+    [ "$output" = "Database contains 3 student record(s)." ]
+}
+
+@test "Compressed database stays sorted through adds and deletes" {
+    ./sdbsc -a 10 a a 100
+    ./sdbsc -a 30 c c 300
+    ./sdbsc -x
+
+    ./sdbsc -a 20 b b 200
+    ./sdbsc -a 5 z z 50
+    ./sdbsc -d 10
+    run ./sdbsc -a 30 c c 300
+    [ "$status" -eq 1 ]
+    printf '25,d,d,250\n1,e,e,10\n' | ./sdbsc -b
+
+    run ./sdbsc -p
+    [ "${#lines[@]}" -eq 6 ]
+    [ "${lines[1]%% *}" = "1" ]
+    [ "${lines[2]%% *}" = "5" ]
+    [ "${lines[3]%% *}" = "20" ]
+    [ "${lines[4]%% *}" = "25" ]
+    [ "${lines[5]%% *}" = "30" ]
+    [ "$(stat -c %s student.db)" -eq 384 ]
+}
+
+@test "Search by last name prefix" {
+    ./sdbsc -a 1 john smith 345
+    ./sdbsc -a 2 jane Smithers 390
+    ./sdbsc -a 3 bob jones 300
+    ./sdbsc -a 4 amy SMALL 310
+
+    run ./sdbsc -s sm
+    [ "$status" -eq 0 ]
+    [ "${#lines[@]}" -eq 4 ]
+    [ "${lines[1]}" = "4      amy                      SMALL                            3.10" ]
+    [ "${lines[2]%% *}" = "1" ]
+    [ "${lines[3]%% *}" = "2" ]
+
+    run ./sdbsc -s smiths
+    [ "$status" -eq 1 ]
+    [ "$output" = "No students found with last name starting with smiths." ]
+}
+
+@test "Name index follows deletes, compress and bulk loads" {
+    ./sdbsc -a 1 john smith 345
+    ./sdbsc -a 2 jane smithers 390
+    ./sdbsc -d 1
+    [ -f student.db.names ]
+
+    run ./sdbsc -s smith
+    [ "${#lines[@]}" -eq 2 ]
+    [ "${lines[1]%% *}" = "2" ]
+
+    ./sdbsc -x
+    printf '7,al,smit,100\n' | ./sdbsc -b
+    run ./sdbsc -s smi
+    [ "${#lines[@]}" -eq 3 ]
+    [ "${lines[1]%% *}" = "7" ]
+    [ "${lines[2]%% *}" = "2" ]
+}
+
+@test "Missing name index is rebuilt" {
+    ./sdbsc -a 1 john smith 345
+    ./sdbsc -a 2 jane jones 390
+    run ./sdbsc -s j
+    expected="$output"
+
+    rm student.db.names
+    run ./sdbsc -s j
+    [ "$output" = "$expected" ]
+    [ -f student.db.names ]
+}
+
+@test "Query by gpa range" {
+    ./sdbsc -a 1 a a 150
+    ./sdbsc -a 2 b b 360
+    ./sdbsc -a 3 c c 199
+    ./sdbsc -a 9 d d 400
+
+    run ./sdbsc -q 0 199
+    [ "$status" -eq 0 ]
+    [ "${#lines[@]}" -eq 3 ]
+    [ "${lines[1]%% *}" = "1" ]
+    [ "${lines[2]%% *}" = "3" ]
+
+    ./sdbsc -d 2
+    run ./sdbsc -q 350 400
+    [ "${#lines[@]}" -eq 2 ]
+    [ "${lines[1]}" = "9      d                        d                                4.00" ]
+
+    run ./sdbsc -q 200 300
+    [ "$status" -eq 1 ]
+    [ "$output" = "No students found with GPA between 200 and 300." ]
+
+    run ./sdbsc -q 300 200
+    [ "$status" -eq 2 ]
+}
+
+@test "Gpa index follows bulk loads and compress" {
+    printf '4,a,a,300\n2,b,b,300\n7,c,c,100\n' | ./sdbsc -b
+    ./sdbsc -x
+    ./sdbsc -a 5 e e 300
+    run ./sdbsc -q 0 500
+    expected="$output"
+    [ "${#lines[@]}" -eq 5 ]
+    [ "${lines[1]%% *}" = "7" ]
+    [ "${lines[2]%% *}" = "2" ]
+    [ "${lines[3]%% *}" = "4" ]
+    [ "${lines[4]%% *}" = "5" ]
+
+    rm student.db.gpa
+    run ./sdbsc -q 0 500
+    [ "$output" = "$expected" ]
+}
+
+@test "Gpa analytics" {
+    ./sdbsc -a 1 a a 150
+    ./sdbsc -a 2 b b 360
+    ./sdbsc -a 3 c c 500
+    [ ! -f student.db.cols ]
+
+    run ./sdbsc -A
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Students: 3  average GPA: 3.37  minimum GPA: 1.50  maximum GPA: 5.00" ]
+    [ "${lines[5]}" = "1.50-1.99    1" ]
+    [ "${lines[9]}" = "3.50-3.99    1" ]
+    [ "${lines[11]}" = "4.50-5.00    1" ]
+    [ -f student.db.cols ]
+
+    ./sdbsc -d 3
+    printf '4,d,d,100\n' | ./sdbsc -b
+    run ./sdbsc -A
+    [ "${lines[0]}" = "Students: 3  average GPA: 2.03  minimum GPA: 1.00  maximum GPA: 3.60" ]
+    [ "${lines[11]}" = "4.50-5.00    0" ]
+}
+
+@test "Scan kernels agree on files without a header" {
+    for i in $(seq 1 40); do echo "$i,f$i,l$i,$((i * 10))"; done | ./sdbsc -b
+    for i in 3 9 10 11 12 13 14 15 16 17 33 40; do ./sdbsc -d $i; done
+    rm -f student.db.*
+    dd if=/dev/zero of=student.db bs=64 count=1 conv=notrunc 2>/dev/null
+
+    run ./sdbsc -p
+    expected="$output"
+    [ "${#lines[@]}" -eq 29 ]
+
+    for kernel in scalar sse2; do
+        run env SDBSC_SCAN=$kernel ./sdbsc -c
+        [ "$output" = "Database contains 28 student record(s)." ]
+        run env SDBSC_SCAN=$kernel ./sdbsc -p
+        [ "$output" = "$expected" ]
+        run env SDBSC_SCAN=$kernel ./sdbsc -f 39
+        [ "$status" -eq 0 ]
+        run env SDBSC_SCAN=$kernel ./sdbsc -f 33
+        [ "$status" -eq 1 ]
+    done
+}
+
+@test "Write-ahead log repairs the database after a reboot" {
+    ./sdbsc -a 5 a b 300
+    SDBSC_DURABILITY=lazy ./sdbsc -a 7 c d 200
+    ./sdbsc -d 5
+    [ "$(stat -c %s student.db.wal)" -eq 280 ]
+
+    # lose record 7 as if the page cache never reached the disk, then make
+    # the log look like it was written before a reboot
+    dd if=/dev/zero of=student.db bs=64 seek=7 count=1 conv=notrunc 2>/dev/null
+    printf 'x' | dd of=student.db.wal bs=1 seek=16 conv=notrunc 2>/dev/null
+
+    run ./sdbsc -f 7
+    [ "$status" -eq 0 ]
+    [ "${lines[1]}" = "7      c                        d                                2.00" ]
+    run ./sdbsc -f 5
+    [ "$status" -eq 1 ]
+    run ./sdbsc -c
+    [ "$output" = "Database contains 1 student record(s)." ]
+    [ "$(stat -c %s student.db.wal)" -eq 64 ]
+}
+
+@test "Concurrent adds all commit" {
+    for i in $(seq 1 50); do ./sdbsc -a $i a b 100 > /dev/null & done
+    wait
+
+    run ./sdbsc -c
+    [ "$output" = "Database contains 50 student record(s)." ]
+}
+
+@test "Compress checkpoints the write-ahead log" {
+    ./sdbsc -a 1 a b 100
+    ./sdbsc -a 2 c d 200
+    ./sdbsc -x
+    [ "$(stat -c %s student.db.wal)" -eq 64 ]
+
+    ./sdbsc -d 1
+    printf 'x' | dd of=student.db.wal bs=1 seek=16 conv=notrunc 2>/dev/null
+    run ./sdbsc -p
+    [ "${#lines[@]}" -eq 2 ]
+    [ "${lines[1]%% *}" = "2" ]
+}
+
+@test "Concurrent adds and deletes keep the indexes in step" {
+    for i in $(seq 1 40); do ./sdbsc -a $i a b$i 100 > /dev/null; done
+    for i in $(seq 1 40); do ./sdbsc -d $i > /dev/null & ./sdbsc -a $((i + 100)) a c$i 200 > /dev/null & done
+    wait
+
+    run ./sdbsc -c
+    [ "$output" = "Database contains 40 student record(s)." ]
+    run ./sdbsc -q 200 200
+    [ "${#lines[@]}" -eq 41 ]
+    run ./sdbsc -s c
+    [ "${#lines[@]}" -eq 41 ]
+}
+
+@test "Concurrent duplicate adds store the student once" {
+    for i in $(seq 1 20); do ./sdbsc -a 7 a b 100 > /dev/null & done
+    wait
+
+    run ./sdbsc -c
+    [ "$output" = "Database contains 1 student record(s)." ]
+    run ./sdbsc -s b
+    [ "${#lines[@]}" -eq 2 ]
+}
+
+@test "Parallel scans match a serial scan" {
+    seq 1 7 100000 | awk '{ printf "%d,f%d,l%d,%d\n", $1, $1, $1, $1 % 500 }' | ./sdbsc -b
+
+    run env SDBSC_THREADS=1 ./sdbsc -p
+    expected="$output"
+    [ "${#lines[@]}" -eq 14287 ]
+    run env SDBSC_THREADS=4 ./sdbsc -p
+    [ "$output" = "$expected" ]
+
+    # without a header there is no bitmap, the count scans too
+    rm -f student.db.*
+    dd if=/dev/zero of=student.db bs=64 count=1 conv=notrunc 2>/dev/null
+    run env SDBSC_THREADS=1 ./sdbsc -p
+    expected="$output"
+    for threads in 3 4; do
+        run env SDBSC_THREADS=$threads ./sdbsc -c
+        [ "$output" = "Database contains 14286 student record(s)." ]
+        run env SDBSC_THREADS=$threads ./sdbsc -p
+        [ "$output" = "$expected" ]
+    done
+}
+
+@test "Print formatter matches printf" {
+    ./sdbsc -a 1 a aa 0
+    ./sdbsc -a 22 abcdefghijklmnopqrstuvwxyz ab 5
+    ./sdbsc -a 333 b ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghij 99
+    ./sdbsc -a 99999 c b 500
+
+    # name search prints through printf, same order here
+    run ./sdbsc -s ""
+    expected="$output"
+    run ./sdbsc -p
+    [ "$output" = "$expected" ]
+    [ "${lines[1]}" = "1      a                        aa                               0.00" ]
+    [ "${lines[4]}" = "99999  c                        b                                5.00" ]
+}
+
+@test "Hash layout stores 9 digit ids in a small file" {
+    export SDBSC_LAYOUT=hash
+    run ./sdbsc -a 100000 a b 100
+    [ "$status" -eq 0 ]
+    run ./sdbsc -a 1000000000 a b 100
+    [ "$status" -eq 2 ]
+
+    # enough students to split buckets and double the directory
+    seq 123000001 7919 163000000 | awk '{ printf "%d,f%d,l%d,%d\n", $1, $1, $1, $1 % 500 }' | ./sdbsc -b
+    run ./sdbsc -c
+    [ "$output" = "Database contains 5053 student record(s)." ]
+    [ "$(stat -c %s student.db)" -lt 1000000 ]
+    run ./sdbsc -s l12300
+    [ "${#lines[@]}" -eq 3 ]
+
+    run ./sdbsc -f 123007920
+    [ "$status" -eq 0 ]
+    [ "${lines[1]%% *}" = "123007920" ]
+    run ./sdbsc -d 123007920
+    [ "$status" -eq 0 ]
+    run ./sdbsc -f 123007920
+    [ "$status" -eq 1 ]
+
+    run ./sdbsc -p
+    [ "${#lines[@]}" -eq 5053 ]
+
+    # the directory is rebuilt from the bucket headers
+    expected="$(./sdbsc -p)"
+    rm -f student.db.hdir
+    run ./sdbsc -p
+    [ "$output" = "$expected" ]
+    run ./sdbsc -c
+    [ "$output" = "Database contains 5052 student record(s)." ]
+}
+
+@test "Deletes and -P release empty blocks" {
+    rm -f student.db*
+    seq 1 4000 | awk '{ printf "%d,f%d,l%d,%d\n", $1, $1, $1, $1 % 400 }' | ./sdbsc -b
+    sync student.db
+    before=$(stat -c %b student.db)
+
+    # ids 64-127 fill the second 4KB block, deleting them all frees it
+    for id in $(seq 64 127); do
+        ./sdbsc -d $id > /dev/null
+    done
+    [ "$(stat -c %b student.db)" -lt "$before" ]
+    run ./sdbsc -c
+    [ "$output" = "Database contains 3936 student record(s)." ]
+
+    # blocks emptied behind the program's back are released by -P
+    expected="$(./sdbsc -p | awk '$1 < 192 || $1 > 383')"
+    dd if=/dev/zero of=student.db bs=4096 seek=3 count=3 conv=notrunc 2> /dev/null
+    rm -f student.db.bitmap student.db.names student.db.gpa student.db.cols
+    before=$(stat -c %b student.db)
+    run ./sdbsc -P
+    [ "$status" -eq 0 ]
+    [ "$output" = "Released 3 empty block(s) of the database file." ]
+    [ "$(stat -c %b student.db)" -lt "$before" ]
+    run ./sdbsc -p
+    [ "$output" = "$expected" ]
+
+    run ./sdbsc -P
+    [ "$output" = "Released 0 empty block(s) of the database file." ]
+}
+
+@test "Online compaction runs in steps and resumes" {
+    rm -f student.db*
+    seq 10 10 100000 | awk '{ printf "%d,f%d,l%d,%d\n", $1, $1, $1, $1 % 500 }' | ./sdbsc -b
+    expected="$(./sdbsc -p)"
+
+    run ./sdbsc -X 1
+    [ "$status" -eq 0 ]
+    [ "$output" = "Compaction paused after 4096 student(s) moved, run -X again to resume." ]
+    run ./sdbsc -p
+    [ "$output" = "$expected" ]
+
+    # changes on both sides of the progress mark
+    ./sdbsc -a 15 a b 100
+    ./sdbsc -a 99995 c d 200
+    ./sdbsc -d 20
+    ./sdbsc -d 90000
+    run ./sdbsc -f 15
+    [ "$status" -eq 0 ]
+    run ./sdbsc -f 20
+    [ "$status" -eq 1 ]
+    run ./sdbsc -c
+    [ "$output" = "Database contains 10000 student record(s)." ]
+    run ./sdbsc -s l4000
+    [ "${#lines[@]}" -eq 3 ]
+
+    run ./sdbsc -X
+    [ "$output" = "Database compacted online, 5904 student(s) moved." ]
+    [ "$(stat -c %s student.db)" -eq $((10001 * 64)) ]
+    [ ! -e student.db.journal ]
+    run ./sdbsc -X
+    [ "$output" = "Database is already compact." ]
+
+    run ./sdbsc -p
+    [ "${#lines[@]}" -eq 10001 ]
+    [ "${lines[1]%% *}" = "10" ]
+    [ "${lines[2]%% *}" = "15" ]
+    [ "${lines[10000]%% *}" = "100000" ]
+    run ./sdbsc -f 99995
+    [ "$status" -eq 0 ]
+    run ./sdbsc -f 90000
+    [ "$status" -eq 1 ]
+}
+
+@test "Online compaction redoes an interrupted step" {
+    rm -f student.db*
+    seq 1 2 20000 | awk '{ printf "%d,f%d,l%d,%d\n", $1, $1, $1, $1 % 500 }' | ./sdbsc -b
+    expected="$(./sdbsc -p)"
+
+    # the step moved its students, but the progress never reached the header
+    ./sdbsc -X 1 > /dev/null
+    printf '\001\000\000\000\001\000\000\000' | dd of=student.db bs=1 seek=16 conv=notrunc 2>/dev/null
+
+    run ./sdbsc -p
+    [ "$output" = "$expected" ]
+    run ./sdbsc -X
+    [ "$output" = "Database compacted online, 5904 student(s) moved." ]
+    run ./sdbsc -p
+    [ "$output" = "$expected" ]
+}
+
+@test "Online compaction lets adds run between steps" {
+    rm -f student.db*
+    seq 3 3 60000 | awk '{ printf "%d,f%d,l%d,%d\n", $1, $1, $1, $1 % 500 }' | ./sdbsc -b
+
+    ./sdbsc -X > /dev/null &
+    for i in $(seq 1 3 300); do ./sdbsc -a $i a b 100 > /dev/null; done
+    wait
+
+    run ./sdbsc -X
+    [ "$output" = "Database is already compact." ]
+    run ./sdbsc -c
+    [ "$output" = "Database contains 20100 student record(s)." ]
+    [ "$(stat -c %s student.db)" -eq $((20101 * 64)) ]
+    [ "$(./sdbsc -p | awk 'NR > 1 { print $1 }' | sort -n -c && echo sorted)" = "sorted" ]
+}
+
+@test "Benchmark reports every operation per distribution" {
+    make -s bench/sdb_bench
+    run bash -c './bench/sdb_bench -n 300 -o 20 -r 2 2> /dev/null'
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = '{"bench":"sdbsc","students":300,"ops":20,"reps":2,"seed":1,"layout":"direct"}' ]
+    [ "$(printf '%s\n' "${lines[@]}" | grep -c '"p99_us":')" -eq 21 ]
+    printf '%s\n' "${lines[@]}" | grep -q '"dist":"sparse","op":"compress","samples":2,'
+    [ ! -e student.db ]
+}
+
+@test "Library block cache answers repeated lookups" {
+    make -s examples/sdb_shell
+    rm -f lib.db lib.db.*
+    run bash -c "printf 'add 1 a b 300\nadd 2 c d 310\nget 1\nget 2\nget 1\nget 7\nstats\nadd 7 e f 320\nget 7\nstats\n' | ./examples/sdb_shell -c 16 lib.db"
+    [ "$status" -eq 0 ]
+    [ "${lines[4]}" = "1      a                        b                                3.00" ]
+    [ "${lines[5]}" = "Student 7 was not found in database." ]
+    [ "${lines[6]}" = "cache hits: 3 misses: 1" ]
+    [ "${lines[8]}" = "7      e                        f                                3.20" ]
+    [ "${lines[9]}" = "cache hits: 3 misses: 2" ]
+
+    # the library works on its own file only
+    [ ! -e student.db ]
+    run bash -c "echo 'get 2' | ./examples/sdb_shell lib.db"
+    [ "$output" = "2      c                        d                                3.10" ]
+    rm -f lib.db lib.db.*
+}
+
+@test "Library block cache sees changes of other processes" {
+    make -s examples/sdb_shell
+    ./sdbsc -a 5 a b 300 > /dev/null
+    rm -f shell.in shell.out
+    mkfifo shell.in
+    ./examples/sdb_shell -c 16 < shell.in > shell.out &
+    exec 3> shell.in
+
+    echo "get 7" >&3
+    until grep -q "not found" shell.out; do sleep 0.05; done
+    ./sdbsc -a 7 c d 310 > /dev/null
+    echo "get 7" >&3
+    echo "get 7" >&3
+    echo "stats" >&3
+    exec 3>&-
+    wait
+
+    run cat shell.out
+    rm -f shell.in shell.out
+    [ "${lines[1]}" = "7      c                        d                                3.10" ]
+    [ "${lines[2]}" = "${lines[1]}" ]
+    [ "${lines[3]}" = "cache hits: 1 misses: 2" ]
+}
+
+@test "Print shows a snapshot while changes go ahead" {
+    seq 1 20000 | grep -vx 19999 | awk '{print $1", a , b , 300"}' | ./sdbsc -b > /dev/null
+    rm -f print.out print.pipe
+    mkfifo print.pipe
+    SDBSC_THREADS=1 ./sdbsc -p > print.pipe &
+    exec 4< print.pipe
+    read -r line <&4
+
+    # the print is stalled on the pipe, changes do not wait for it
+    run timeout 5 ./sdbsc -a 19999 x y 310
+    [ "$status" -eq 0 ]
+    run timeout 5 ./sdbsc -d 20000
+    [ "$status" -eq 0 ]
+
+    cat <&4 > print.out
+    exec 4<&-
+    wait
+
+    run grep -c "^20000 " print.out
+    [ "$output" = "1" ]
+    run grep -c "^19999 " print.out
+    [ "$output" = "0" ]
+    run wc -l < print.out
+    [ "$output" = "19999" ]
+    rm -f print.out print.pipe
+
+    run ./sdbsc -f 19999
+    [ "${lines[1]}" = "19999  x                        y                                3.10" ]
+    run ./sdbsc -c
+    [ "$output" = "Database contains 19999 student record(s)." ]
+}
+
+@test "Multi-get prints students in request order" {
+    ./sdbsc -a 1 john doe 345
+    ./sdbsc -a 70 jane doe 390
+    ./sdbsc -a 5000 bob jones 250
+
+    run ./sdbsc -f 5000 2 1 70
+    [ "$status" -eq 1 ]
+    [ "${#lines[@]}" -eq 5 ]
+    [ "${lines[1]}" = "5000   bob                      jones                            2.50" ]
+    [ "${lines[2]}" = "Student 2 was not found in database." ]
+    [ "${lines[3]}" = "1      john                     doe                              3.45" ]
+    [ "${lines[4]}" = "70     jane                     doe                              3.90" ]
+    expected="$output"
+
+    # ids from stdin, and the same answers without io_uring
+    run bash -c "echo '5000 2 1 70' | ./sdbsc -f"
+    [ "$output" = "$expected" ]
+    run bash -c "printf '5000\n2\n1\n70\n' | SDBSC_IO=pread ./sdbsc -f -"
+    [ "$output" = "$expected" ]
+
+    run bash -c "seq 1 600 | ./sdbsc -f | grep -c 'not found'"
+    [ "$output" = "598" ]
+    run bash -c "echo '70 1' | ./sdbsc -f"
+    [ "$status" -eq 0 ]
+}
+
+@test "Packed archive keeps the students in a fraction of the space" {
+    seq 1 2000 | awk '{print $1", first" $1 % 7 " , last" $1 % 5 " , " $1 % 500}' | ./sdbsc -b > /dev/null
+    ./sdbsc -d 1000
+    ./sdbsc -p > before.out
+    size=$(stat -c %s student.db)
+
+    run ./sdbsc -x packed
+    [ "$status" -eq 0 ]
+    [[ "$output" == "Database successfully packed, 1999 student(s) in "* ]]
+    [ $(( $(stat -c %s student.db) * 3 )) -lt "$size" ]
+
+    run bash -c "./sdbsc -p | cmp - before.out"
+    [ "$status" -eq 0 ]
+    run ./sdbsc -c
+    [ "$output" = "Database contains 1999 student record(s)." ]
+    run ./sdbsc -f 1000 1999
+    [ "${lines[0]}" = "Student 1000 was not found in database." ]
+    [ "${lines[2]}" = "1999   first4                   last4                            4.99" ]
+    run ./sdbsc -s last3
+    [ "${#lines[@]}" -eq 401 ]
+
+    # a packed file takes no changes until it is expanded again
+    run ./sdbsc -a 3000 a b 300
+    [ "$status" -eq 1 ]
+    [ "$output" = "Database is packed and read only, expand it with -x first." ]
+    run ./sdbsc -d 5
+    [ "$output" = "Database is packed and read only, expand it with -x first." ]
+
+    run ./sdbsc -x
+    [ "$output" = "Database successfully compressed!" ]
+    run bash -c "./sdbsc -p | cmp - before.out"
+    [ "$status" -eq 0 ]
+    run ./sdbsc -a 3000 a b 300
+    [ "$output" = "Student 3000 added to database." ]
+    rm -f before.out
+}
+
+@test "Ordered print sorts by last name or gpa within a small memory budget" {
+    run ./sdbsc -p --order-by gpa
+    [ "$output" = "Database contains no student records." ]
+
+    seq 1 20000 | awk '{print $1", f" $1 * 31 % 97 " , l" $1 * 7919 % 331 " , " $1 * 37 % 501}' | ./sdbsc -b > /dev/null
+    ./sdbsc -d 777 > /dev/null
+    ./sdbsc -p > ids.out
+
+    # 64KB holds 1024 students, so the runs are merged over several passes
+    run bash -c "SDBSC_SORT_MEM=64 ./sdbsc -p --order-by gpa | tail -n +2 | cmp - <(tail -n +2 ids.out | LC_ALL=C sort -b -k4,4n -k1,1n)"
+    [ "$status" -eq 0 ]
+    run bash -c "SDBSC_SORT_MEM=64 ./sdbsc -p --order-by lname | tail -n +2 | cmp - <(tail -n +2 ids.out | LC_ALL=C sort -b -k3,3 -k2,2 -k1,1n)"
+    [ "$status" -eq 0 ]
+    run bash -c "./sdbsc -p --order-by lname | head -1"
+    [ "$output" = "$(head -1 ids.out)" ]
+    run bash -c "./sdbsc -p --order-by lname | wc -l"
+    [ "$output" = "20000" ]
+
+    run ./sdbsc -p --order-by id
+    [ "$status" -eq 2 ]
+    rm -f ids.out
+}
+
+@test "Follower replica applies the change log incrementally" {
+    rm -rf replica
+    mkdir replica
+    ./sdbsc -a 1 john doe 345
+    ./sdbsc -a 2 jane roe 390
+    ./sdbsc -d 1
+    printf '4,amy,lee,310\n2,dup,dup,100\n5,bo,li,250\n' | ./sdbsc -b || true
+
+    # the log is started by the first follower, with the students so far
+    [ ! -e student.db.cdc ]
+    run ./sdbsc -F replica/student.db once
+    [ "$status" -eq 0 ]
+    [ "$output" = "Replica replica/student.db is at change 3, 3 change(s) applied." ]
+    [ -e student.db.cdc ]
+    [ ! -e replica/student.db.cdc ]
+    run bash -c "cd replica && ../sdbsc -p | cmp - <(cd .. && ./sdbsc -p)"
+    [ "$status" -eq 0 ]
+
+    # only the changes since the last run are applied, -z included
+    ./sdbsc -z
+    ./sdbsc -a 9 zed zee 100
+    run ./sdbsc -F replica/student.db once
+    [ "$output" = "Replica replica/student.db is at change 5, 2 change(s) applied." ]
+    run bash -c "cd replica && ../sdbsc -p"
+    [ "${#lines[@]}" -eq 2 ]
+    [ "${lines[1]}" = "9      zed                      zee                              1.00" ]
+    run ./sdbsc -F replica/student.db once
+    [ "$output" = "Replica replica/student.db is at change 5, 0 change(s) applied." ]
+
+    run ./sdbsc -F student.db once
+    [ "$status" -eq 1 ]
+    [ "$output" = "Cant follow change log student.db.cdc!" ]
+    rm -rf replica
+}
+
+@test "Zero waits for a print walking the file" {
+    seq 1 20000 | awk '{print $1", a , b , 300"}' | ./sdbsc -b > /dev/null
+    rm -f print.out print.pipe
+    mkfifo print.pipe
+    SDBSC_THREADS=1 ./sdbsc -p > print.pipe &
+    print=$!
+    exec 4< print.pipe
+    read -r line <&4
+
+    # the print is stalled on the pipe while the file is emptied
+    ./sdbsc -z > /dev/null &
+    zero=$!
+    sleep 0.2
+    cat <&4 > print.out
+    exec 4<&-
+    wait $print
+    wait $zero
+
+    run wc -l < print.out
+    [ "$output" = "20000" ]
+    rm -f print.out print.pipe
+    run ./sdbsc -c
+    [ "$output" = "Database contains no student records." ]
+
+    # a hash file is scanned read locked
+    rm -f student.db student.db.*
+    seq 1 20000 | awk '{print $1", a , b , 300"}' | SDBSC_LAYOUT=hash ./sdbsc -b > /dev/null
+    for i in 1 2 3 4 5; do ./sdbsc -p > /dev/null & done
+    ./sdbsc -z > /dev/null
+    for pid in $(jobs -p); do wait $pid; done
+}
+
+@test "Changes racing a compress land in the new file" {
+    seq 1 99999 | awk '$1 % 4 == 0 {print $1", a , b , 300"}' | ./sdbsc -b > /dev/null
+    ./sdbsc -x > /dev/null &
+    for i in $(seq 1 10); do ./sdbsc -a $((i * 4 + 1)) late add 300 > /dev/null & done
+    ./sdbsc -d 4 > /dev/null &
+    for pid in $(jobs -p); do wait $pid; done
+
+    run ./sdbsc -c
+    [ "$output" = "Database contains 25008 student record(s)." ]
+    run ./sdbsc -f 41
+    [ "${lines[1]}" = "41     late                     add                              3.00" ]
+    run ./sdbsc -f 4
+    [ "$output" = "Student 4 was not found in database." ]
+}
+
+@test "Clients and tables of a hash file take 9 digit ids" {
+    export SDBSC_LAYOUT=hash
+    ./sdbsc -a 123456789 john doe 345 > /dev/null
+    ./sdbsc -S test.sock > /dev/null &
+    server=$!
+    for i in $(seq 50); do [ -S test.sock ] && break; sleep 0.1; done
+
+    export SDBSC_SOCKET=test.sock
+    run ./sdbsc -a 987654321 jane roe 300
+    [ "$output" = "Student 987654321 added to database." ]
+    run ./sdbsc -f 987654321
+    [ "${lines[0]}" = "ID        FIRST NAME               LAST NAME                        GPA" ]
+    [ "${lines[1]}" = "987654321 jane                     roe                              3.00" ]
+    run ./sdbsc -a 1000000000 a b 100
+    [ "$status" -eq 2 ]
+    unset SDBSC_SOCKET
+
+    kill $server
+    wait $server
+
+    run ./sdbsc -p
+    [ "${#lines[@]}" -eq 3 ]
+    [ "${lines[0]}" = "ID        FIRST NAME               LAST_NAME                        GPA" ]
+    [ "$(printf '%s\n' "${lines[@]}" | sort | head -1)" = "123456789 john                     doe                              3.45" ]
+
+    # a server with a direct-slot file rejects what its file cannot hold
+    unset SDBSC_LAYOUT
+    rm -f student.db student.db.*
+    ./sdbsc -S test.sock > /dev/null &
+    server=$!
+    for i in $(seq 50); do [ -S test.sock ] && break; sleep 0.1; done
+    run env SDBSC_SOCKET=test.sock ./sdbsc -a 100001 a b 100
+    [ "$status" -eq 2 ]
+    [ "$output" = "Cant add student, either ID or GPA out of allowable range!" ]
+    kill $server
+    wait $server
+}
+
+@test "Server keeps serving past a stalled client and stops on a signal" {
+    seq 1 20000 | awk '{print $1", a , b , 300"}' | ./sdbsc -b > /dev/null
+    ./sdbsc -S test.sock > /dev/null &
+    server=$!
+    for i in $(seq 50); do [ -S test.sock ] && break; sleep 0.1; done
+    export SDBSC_SOCKET=test.sock
+    rm -f print.pipe
+    mkfifo print.pipe
+
+    # the print stops reading its reply, the server drops it in time
+    ./sdbsc -p > print.pipe &
+    exec 4< print.pipe
+    read -r line <&4
+    run timeout 10 ./sdbsc -c
+    [ "$output" = "Database contains 20000 student record(s)." ]
+    exec 4<&-
+    wait %2 || true
+
+    # a stalled client does not keep the server from stopping
+    ./sdbsc -p > print.pipe &
+    exec 4< print.pipe
+    read -r line <&4
+    kill $server
+    for i in $(seq 50); do kill -0 $server 2> /dev/null || break; sleep 0.1; done
+    ! kill -0 $server 2> /dev/null
+    [ ! -e test.sock ]
+    exec 4<&-
+    unset SDBSC_SOCKET
+    rm -f print.pipe
+}
+
+@test "Hash split cut short by a crash loses no students later" {
+    export SDBSC_LAYOUT=hash
+    seq 1 63 | awk '{ printf "%d,f%d,l%d,300\n", $1, $1, $1 }' | ./sdbsc -b > /dev/null
+    dd if=student.db of=page.old bs=4096 skip=1 count=1 2>/dev/null
+
+    # the split wrote its new page, the old page never got rewritten
+    ./sdbsc -a 64 f64 l64 300 > /dev/null
+    dd if=page.old of=student.db bs=4096 seek=1 conv=notrunc 2>/dev/null
+    rm -f page.old student.db.hdir
+
+    count=$(./sdbsc -c | awk '{ print $3 }')
+    seq 65 400 | awk '{ printf "%d,f%d,l%d,300\n", $1, $1, $1 }' | ./sdbsc -b > /dev/null
+    run ./sdbsc -c
+    [ "$output" = "Database contains $((count + 336)) student record(s)." ]
+    for i in $(seq 1 63) $(seq 65 400); do ./sdbsc -f $i > /dev/null; done
+}
+
+@test "A failed add is not replayed from the logs" {
+    rm -rf replica
+    mkdir replica
+    ./sdbsc -a 1 a b 300
+    ./sdbsc -F replica/student.db once
+
+    # the log records fit under the file size limit, the record does not
+    run bash -c "trap '' XFSZ; ulimit -f 200; ./sdbsc -a 99999 big id 300"
+    [ "$status" -eq 1 ]
+    [ "$(stat -c %s student.db.wal)" -eq 280 ]
+
+    printf 'x' | dd of=student.db.wal bs=1 seek=16 conv=notrunc 2>/dev/null
+    run ./sdbsc -f 99999
+    [ "$status" -eq 1 ]
+    # the replay logs the add and its undo again, followers apply both
+    run ./sdbsc -F replica/student.db once
+    [ "$output" = "Replica replica/student.db is at change 6, 5 change(s) applied." ]
+    run bash -c "cd replica && ../sdbsc -c"
+    [ "$output" = "Database contains 1 student record(s)." ]
+    rm -rf replica
+}